@@ -0,0 +1,57 @@
+#!/usr/bin/env python3
+# 对比两次 microbench 的 JSON 结果（--benchmark_out_format=json），列出每项耗时变化，
+# 变慢超过阈值的标为 REGRESSION 并以返回码1退出，可直接放进CI：
+#   ./build/microbench --benchmark_out=new.json --benchmark_out_format=json
+#   bench/compare_micro.py old.json new.json [--threshold 10] [--metric cpu_time]
+import argparse
+import json
+import sys
+
+
+def load(path, metric):
+    with open(path) as f:
+        data = json.load(f)
+    result = {}
+    for b in data.get("benchmarks", []):
+        if b.get("run_type") == "aggregate" and b.get("aggregate_name") != "median":
+            continue
+        if b.get("error_occurred"):
+            continue
+        result[b.get("run_name", b["name"])] = (b[metric], b.get("time_unit", "ns"))
+    return result
+
+
+def main():
+    parser = argparse.ArgumentParser(description="compare two microbench JSON results")
+    parser.add_argument("baseline")
+    parser.add_argument("contender")
+    parser.add_argument("--threshold", type=float, default=10.0, help="regression threshold in percent")
+    parser.add_argument("--metric", default="real_time", choices=["real_time", "cpu_time"])
+    args = parser.parse_args()
+
+    old = load(args.baseline, args.metric)
+    new = load(args.contender, args.metric)
+    regressions = 0
+    width = max([len(n) for n in old] + [len(n) for n in new] + [9])
+    print("%-*s %14s %14s %9s" % (width, "benchmark", "baseline", "contender", "change"))
+    for name in sorted(set(old) | set(new)):
+        if name not in old or name not in new:
+            print("%-*s %s" % (width, name, "only in " + ("contender" if name in new else "baseline")))
+            continue
+        (t0, unit), (t1, _) = old[name], new[name]
+        change = (t1 - t0) / t0 * 100 if t0 else 0.0
+        flag = ""
+        if change > args.threshold:
+            flag = "  REGRESSION"
+            regressions += 1
+        elif change < -args.threshold:
+            flag = "  improved"
+        print("%-*s %11.1f %-2s %11.1f %-2s %+8.1f%%%s" % (width, name, t0, unit, t1, unit, change, flag))
+    if regressions:
+        print("%d benchmark(s) slower than %.0f%%" % (regressions, args.threshold))
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,535 @@
+// HTTP 压测工具：多线程，每个线程一个epoll驱动若干条连接，只走本机回环，不依赖外部网络。
+// 场景：keepalive / close / pipeline / static / login / slow，输出RPS和延迟分布。
+//   ./loadgen -p 1316 -t 4 -c 64 -d 10 -s keepalive
+// 最后一行以 "RESULT," 开头，供 bench/sweep.sh 汇总
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <algorithm>
+#include "../src/server/epoller.h"
+#include "../src/metrics/hdr_histogram.h"
+
+typedef std::chrono::steady_clock clock_;
+
+enum SCENARIO {
+    SC_KEEPALIVE = 0,   // 长连接，一问一答
+    SC_CLOSE,           // 短连接，每个请求重新建连
+    SC_PIPELINE,        // 长连接，一次发出pipeline个请求
+    SC_STATIC,          // 长连接，轮流请求resources/下的所有文件
+    SC_LOGIN,           // 长连接，POST登录
+    SC_SLOW,            // 长连接 + slowConns条慢速连接逐字节发送请求，只统计正常连接
+    SC_NUM,
+};
+
+const char* SCENARIO_NAMES[SC_NUM] = {"keepalive", "close", "pipeline", "static", "login", "slow"};
+
+struct options {
+    const char* host = "127.0.0.1";
+    int port = 1316;
+    int threads = 4;
+    int conns = 64;             // 所有线程合计的正常连接数
+    double duration = 10;       // 秒
+    SCENARIO scenario = SC_KEEPALIVE;
+    int pipeline = 4;
+    int slowConns = 16;
+    int slowIntervalMs = 50;    // 慢速连接每隔多久发一个字节
+    int timeoutMs = 3000;       // 请求超过这个时间没有响应算超时，连接重建
+    const char* resDir = "./resources";
+    const char* user = "bench";
+    const char* passwd = "bench";
+};
+
+struct threadStats {
+    uint64_t requests = 0;      // 正常连接完成的请求
+    uint64_t slowRequests = 0;  // 慢速连接完成的请求
+    uint64_t errors = 0;        // 连接失败、响应不完整就被关闭、响应格式错误
+    uint64_t timeouts = 0;
+    uint64_t bytesIn = 0;
+    uint64_t status[6] = {0};   // 按百位统计，status[2]为2xx
+    hdrHistogram hist;          // 只由所属线程写入
+};
+
+struct conn {
+    int fd = -1;
+    bool slow = false;
+    bool connecting = false;
+    std::string out;
+    size_t outOff = 0;
+    std::string in;
+    std::deque<clock_::time_point> inflight;   // 已发出未收到响应的请求的发送时刻
+    size_t next = 0;                            // 下一个请求的下标
+    clock_::time_point lastActive;
+    clock_::time_point nextSlowSend;
+};
+
+static options opt;
+static std::vector<std::string> paths;
+static std::atomic<bool> stopFlag(false);
+
+static std::string buildRequest(size_t idx, bool keepAlive) {
+    std::string conn = keepAlive ? "keep-alive" : "close";
+    if(opt.scenario == SC_LOGIN) {
+        std::string body = std::string("username=") + opt.user + "&passwd=" + opt.passwd;
+        return "POST /login.html HTTP/1.1\r\nHost: localhost\r\nConnection: " + conn +
+               "\r\nContent-Type: application/x-www-form-urlencoded\r\nContent-Length: " +
+               std::to_string(body.size()) + "\r\n\r\n" + body;
+    }
+    const std::string& path = paths[idx % paths.size()];
+    return "GET " + path + " HTTP/1.1\r\nHost: localhost\r\nConnection: " + conn + "\r\n\r\n";
+}
+
+static void listFiles(const std::string& dir, const std::string& prefix) {
+    DIR* d = opendir(dir.c_str());
+    if(!d) {
+        return;
+    }
+    struct dirent* ent;
+    while((ent = readdir(d)) != nullptr) {
+        std::string name = ent->d_name;
+        if(name == "." || name == "..") {
+            continue;
+        }
+        struct stat st;
+        if(stat((dir + "/" + name).c_str(), &st) < 0) {
+            continue;
+        }
+        if(S_ISDIR(st.st_mode)) {
+            listFiles(dir + "/" + name, prefix + "/" + name);
+        } else if(S_ISREG(st.st_mode)) {
+            paths.push_back(prefix + "/" + name);
+        }
+    }
+    closedir(d);
+}
+
+static int connectTo(bool nonBlock, bool* connecting) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | (nonBlock ? SOCK_NONBLOCK : 0), 0);
+    if(fd < 0) {
+        return -1;
+    }
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(opt.port);
+    inet_pton(AF_INET, opt.host, &addr.sin_addr);
+    *connecting = false;
+    if(connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        if(nonBlock && errno == EINPROGRESS) {
+            *connecting = true;
+        } else {
+            close(fd);
+            return -1;
+        }
+    }
+    return fd;
+}
+
+// 从缓冲区头部解析一个完整响应，返回消耗的字节数，不完整返回0，格式错误返回-1
+static ssize_t parseResponse(const std::string& in, int* status, bool* closing) {
+    size_t hdrEnd = in.find("\r\n\r\n");
+    if(hdrEnd == std::string::npos) {
+        return 0;
+    }
+    if(in.compare(0, 5, "HTTP/") != 0) {
+        return -1;
+    }
+    size_t sp = in.find(' ');
+    if(sp == std::string::npos || sp > hdrEnd) {
+        return -1;
+    }
+    *status = atoi(in.c_str() + sp + 1);
+    size_t bodyLen = 0;
+    for(size_t pos = in.find("\r\n"); pos < hdrEnd; pos = in.find("\r\n", pos + 2)) {
+        if(strncasecmp(in.c_str() + pos + 2, "Content-Length:", 15) == 0) {
+            bodyLen = strtoul(in.c_str() + pos + 17, nullptr, 10);
+        } else if(strncasecmp(in.c_str() + pos + 2, "Connection: close", 17) == 0) {
+            *closing = true;
+        }
+    }
+    size_t total = hdrEnd + 4 + bodyLen;
+    return in.size() >= total ? static_cast<ssize_t>(total) : 0;
+}
+
+class worker {
+public:
+    worker(int normalConns, int slowConns) : epoller_(4096) {
+        conns_.resize(normalConns + slowConns);
+        for(size_t i = 0; i < conns_.size(); i++) {
+            conns_[i].slow = (static_cast<int>(i) >= normalConns);
+            conns_[i].next = i;   // 错开各连接请求的文件
+        }
+    }
+
+    void run(clock_::time_point deadline) {
+        for(size_t i = 0; i < conns_.size(); i++) {
+            open_(i);
+        }
+        while(!stopFlag && clock_::now() < deadline) {
+            int n = epoller_.wait(10);
+            for(int i = 0; i < n; i++) {
+                auto it = fdIndex_.find(epoller_.getEventFd(i));
+                if(it == fdIndex_.end()) {
+                    continue;
+                }
+                onEvent_(it->second, epoller_.getEvents(i));
+            }
+            tick_();
+        }
+        for(size_t i = 0; i < conns_.size(); i++) {
+            close_(i);
+        }
+    }
+
+    threadStats stats;
+
+private:
+    void open_(size_t i) {
+        conn& c = conns_[i];
+        c.fd = connectTo(true, &c.connecting);
+        c.in.clear();
+        c.out.clear();
+        c.outOff = 0;
+        c.inflight.clear();
+        c.lastActive = clock_::now();
+        if(c.fd < 0) {
+            stats.errors++;
+            return;
+        }
+        fdIndex_[c.fd] = i;
+        epoller_.addFd(c.fd, EPOLLIN | EPOLLOUT);
+        if(!c.connecting) {
+            send_(i);
+        }
+    }
+
+    void close_(size_t i) {
+        conn& c = conns_[i];
+        if(c.fd >= 0) {
+            epoller_.delFd(c.fd);
+            fdIndex_.erase(c.fd);
+            close(c.fd);
+            c.fd = -1;
+        }
+    }
+
+    void reopen_(size_t i) {
+        close_(i);
+        open_(i);
+    }
+
+    // 排入下一批请求并尽量发出
+    void send_(size_t i) {
+        conn& c = conns_[i];
+        bool keepAlive = (opt.scenario != SC_CLOSE);
+        int depth = (opt.scenario == SC_PIPELINE && !c.slow) ? opt.pipeline : 1;
+        auto now = clock_::now();
+        for(int k = 0; k < depth; k++) {
+            c.out += buildRequest(c.next++, keepAlive);
+            c.inflight.push_back(now);
+        }
+        c.nextSlowSend = now;
+        flush_(i);
+    }
+
+    void flush_(size_t i) {
+        conn& c = conns_[i];
+        auto now = clock_::now();
+        while(c.outOff < c.out.size()) {
+            size_t len = c.out.size() - c.outOff;
+            if(c.slow) {
+                if(now < c.nextSlowSend) {
+                    break;
+                }
+                len = 1;
+                c.nextSlowSend = now + std::chrono::milliseconds(opt.slowIntervalMs);
+            }
+            ssize_t n = ::send(c.fd, c.out.data() + c.outOff, len, MSG_NOSIGNAL);
+            if(n < 0) {
+                if(errno != EAGAIN) {
+                    stats.errors++;
+                    reopen_(i);
+                    return;
+                }
+                break;
+            }
+            c.outOff += n;
+            c.lastActive = now;
+        }
+        if(c.outOff == c.out.size()) {
+            c.out.clear();
+            c.outOff = 0;
+            epoller_.modFd(c.fd, EPOLLIN);
+        } else if(!c.slow) {
+            epoller_.modFd(c.fd, EPOLLIN | EPOLLOUT);
+        } else {
+            epoller_.modFd(c.fd, EPOLLIN); // 慢速连接由tick_按时间发送
+        }
+    }
+
+    void onEvent_(size_t i, uint32_t events) {
+        conn& c = conns_[i];
+        if(c.connecting && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+            int err = 0;
+            socklen_t len = sizeof(err);
+            getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+            if(err != 0) {
+                stats.errors++;
+                reopen_(i);
+                return;
+            }
+            c.connecting = false;
+            send_(i);
+            return;
+        }
+        if(events & EPOLLIN) {
+            char buf[65536];
+            while(true) {
+                ssize_t n = ::recv(c.fd, buf, sizeof(buf), MSG_DONTWAIT);
+                if(n > 0) {
+                    c.in.append(buf, n);
+                    stats.bytesIn += n;
+                    c.lastActive = clock_::now();
+                    continue;
+                }
+                if(n < 0 && errno == EAGAIN) {
+                    break;
+                }
+                // 对端关闭：还有未完成的请求就算错误
+                onResponses_(i);
+                if(!conns_[i].inflight.empty()) {
+                    stats.errors++;
+                }
+                reopen_(i);
+                return;
+            }
+            if(!onResponses_(i)) {
+                return;
+            }
+        }
+        if((events & EPOLLOUT) && c.fd >= 0 && !c.out.empty()) {
+            flush_(i);
+        }
+    }
+
+    // 处理已收到的完整响应，连接被重建时返回false
+    bool onResponses_(size_t i) {
+        conn& c = conns_[i];
+        while(!c.inflight.empty()) {
+            int status = 0;
+            bool closing = false;
+            ssize_t used = parseResponse(c.in, &status, &closing);
+            if(used == 0) {
+                break;
+            }
+            if(used < 0) {
+                stats.errors++;
+                reopen_(i);
+                return false;
+            }
+            c.in.erase(0, used);
+            auto now = clock_::now();
+            if(c.slow) {
+                stats.slowRequests++;
+            } else {
+                stats.requests++;
+                stats.hist.record(std::chrono::duration_cast<std::chrono::microseconds>(
+                    now - c.inflight.front()).count());
+            }
+            stats.status[std::min(status / 100, 5)]++;
+            c.inflight.pop_front();
+            if(closing) { // 服务端声明关闭（如平滑升级排空），按浏览器的做法重新建连
+                if(!c.inflight.empty()) {
+                    stats.errors++;
+                }
+                reopen_(i);
+                return false;
+            }
+        }
+        if(c.inflight.empty() && !stopFlag) {
+            if(opt.scenario == SC_CLOSE) {
+                reopen_(i);
+                return false;
+            }
+            send_(i);
+        }
+        return true;
+    }
+
+    void tick_() {
+        auto now = clock_::now();
+        for(size_t i = 0; i < conns_.size(); i++) {
+            conn& c = conns_[i];
+            if(c.fd < 0) {
+                reopen_(i);
+                continue;
+            }
+            if(c.slow && !c.out.empty() && now >= c.nextSlowSend) {
+                flush_(i);
+            }
+            if((c.connecting || !c.inflight.empty()) &&
+               now - c.lastActive > std::chrono::milliseconds(opt.timeoutMs)) {
+                stats.timeouts++;
+                reopen_(i);
+            }
+        }
+    }
+
+    Epoller epoller_;
+    std::vector<conn> conns_;
+    std::unordered_map<int, size_t> fdIndex_;
+};
+
+// 登录场景先注册压测用户（已存在时服务器返回失败页面，同样可以继续）
+static bool registerUser() {
+    bool connecting = false;
+    int fd = connectTo(false, &connecting);
+    if(fd < 0) {
+        return false;
+    }
+    std::string body = std::string("username=") + opt.user + "&passwd=" + opt.passwd;
+    std::string req = "POST /register.html HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n"
+                      "Content-Type: application/x-www-form-urlencoded\r\nContent-Length: " +
+                      std::to_string(body.size()) + "\r\n\r\n" + body;
+    bool ok = ::send(fd, req.data(), req.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(req.size());
+    char buf[4096];
+    while(ok && ::recv(fd, buf, sizeof(buf), 0) > 0) {}
+    close(fd);
+    return ok;
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr,
+        "usage: %s [-h host] [-p port] [-t threads] [-c conns] [-d seconds] [-s scenario]\n"
+        "          [-P pipeline] [-S slowConns] [-i slowIntervalMs] [-T timeoutMs] [-r resDir]\n"
+        "scenarios: keepalive close pipeline static login slow\n", prog);
+}
+
+int main(int argc, char* argv[]) {
+    int ch;
+    while((ch = getopt(argc, argv, "h:p:t:c:d:s:P:S:i:T:r:")) != -1) {
+        switch(ch) {
+            case 'h': opt.host = optarg; break;
+            case 'p': opt.port = atoi(optarg); break;
+            case 't': opt.threads = std::max(1, atoi(optarg)); break;
+            case 'c': opt.conns = std::max(1, atoi(optarg)); break;
+            case 'd': opt.duration = atof(optarg); break;
+            case 's': {
+                int sc = 0;
+                while(sc < SC_NUM && strcmp(SCENARIO_NAMES[sc], optarg) != 0) { sc++; }
+                if(sc == SC_NUM) { usage(argv[0]); return 1; }
+                opt.scenario = static_cast<SCENARIO>(sc);
+                break;
+            }
+            case 'P': opt.pipeline = std::max(1, atoi(optarg)); break;
+            case 'S': opt.slowConns = std::max(0, atoi(optarg)); break;
+            case 'i': opt.slowIntervalMs = std::max(1, atoi(optarg)); break;
+            case 'T': opt.timeoutMs = std::max(1, atoi(optarg)); break;
+            case 'r': opt.resDir = optarg; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    if(opt.scenario == SC_STATIC) {
+        listFiles(opt.resDir, "");
+        std::sort(paths.begin(), paths.end());
+        if(paths.empty()) {
+            fprintf(stderr, "no files under %s\n", opt.resDir);
+            return 1;
+        }
+    } else {
+        paths.push_back("/index.html");
+    }
+    if(opt.scenario == SC_LOGIN && !registerUser()) {
+        fprintf(stderr, "cannot reach %s:%d\n", opt.host, opt.port);
+        return 1;
+    }
+    int slowConns = (opt.scenario == SC_SLOW) ? opt.slowConns : 0;
+
+    std::vector<std::unique_ptr<worker>> workers;
+    for(int t = 0; t < opt.threads; t++) { // 连接平均分给各线程
+        int normal = opt.conns / opt.threads + (t < opt.conns % opt.threads ? 1 : 0);
+        int slow = slowConns / opt.threads + (t < slowConns % opt.threads ? 1 : 0);
+        workers.emplace_back(new worker(normal, slow));
+    }
+    auto begin = clock_::now();
+    auto deadline = begin + std::chrono::microseconds(static_cast<int64_t>(opt.duration * 1e6));
+    std::vector<std::thread> threads;
+    for(auto& w : workers) {
+        threads.emplace_back([&w, deadline]() { w->run(deadline); });
+    }
+    for(auto& t : threads) {
+        t.join();
+    }
+    double secs = std::chrono::duration<double>(clock_::now() - begin).count();
+
+    threadStats total;
+    hdrHistogram::snapshot snap;
+    for(auto& w : workers) {
+        total.requests += w->stats.requests;
+        total.slowRequests += w->stats.slowRequests;
+        total.errors += w->stats.errors;
+        total.timeouts += w->stats.timeouts;
+        total.bytesIn += w->stats.bytesIn;
+        for(int s = 0; s < 6; s++) { total.status[s] += w->stats.status[s]; }
+        w->stats.hist.mergeInto(snap);
+    }
+
+    double rps = total.requests / secs;
+    printf("scenario=%s threads=%d conns=%d slow=%d pipeline=%d duration=%.2fs\n",
+           SCENARIO_NAMES[opt.scenario], opt.threads, opt.conns, slowConns,
+           opt.scenario == SC_PIPELINE ? opt.pipeline : 1, secs);
+    printf("requests=%llu rps=%.1f MB/s=%.2f errors=%llu timeouts=%llu 2xx=%llu 4xx=%llu 5xx=%llu slow_done=%llu\n",
+           (unsigned long long)total.requests, rps, total.bytesIn / secs / 1e6,
+           (unsigned long long)total.errors, (unsigned long long)total.timeouts,
+           (unsigned long long)total.status[2], (unsigned long long)total.status[4],
+           (unsigned long long)total.status[5], (unsigned long long)total.slowRequests);
+    printf("latency(us) p50=%llu p90=%llu p99=%llu p999=%llu max=%llu mean=%.1f\n",
+           (unsigned long long)snap.percentile(50), (unsigned long long)snap.percentile(90),
+           (unsigned long long)snap.percentile(99), (unsigned long long)snap.percentile(99.9),
+           (unsigned long long)snap.max, snap.total ? (double)snap.sum / snap.total : 0.0);
+
+    // 按2的幂合并桶输出直方图
+    if(snap.total > 0) {
+        printf("histogram:\n");
+        uint64_t bound = 1, seen = 0;
+        int idx = 0;
+        while(seen < snap.total && idx < hdrHistogram::BUCKET_NUM) {
+            uint64_t n = 0;
+            while(idx < hdrHistogram::BUCKET_NUM && hdrHistogram::highestEquivalent(idx) < bound) {
+                n += snap.counts[idx++];
+            }
+            seen += n;
+            if(n > 0) {
+                printf("  < %8lluus %10llu %6.2f%% %6.2f%%\n", (unsigned long long)bound, (unsigned long long)n,
+                       100.0 * n / snap.total, 100.0 * seen / snap.total);
+            }
+            bound <<= 1;
+        }
+    }
+    printf("RESULT,%s,%d,%d,%.1f,%llu,%llu,%llu,%llu,%llu,%llu\n", SCENARIO_NAMES[opt.scenario], opt.threads,
+           opt.conns, rps, (unsigned long long)snap.percentile(50), (unsigned long long)snap.percentile(99),
+           (unsigned long long)snap.percentile(99.9), (unsigned long long)snap.max,
+           (unsigned long long)total.errors, (unsigned long long)total.timeouts);
+    return 0;
+}
@@ -0,0 +1,271 @@
+// 核心组件的微基准（Google Benchmark）：Buffer、请求解析、堆定时器、阻塞队列、线程池、日志、限速表。
+//   ./microbench --benchmark_out=result.json --benchmark_out_format=json
+// 不同提交的JSON结果用 bench/compare_micro.py 对比
+#include <benchmark/benchmark.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <random>
+#include <string>
+#include <vector>
+#include "../src/buffer/buffer.h"
+#include "../src/http/http_request.h"
+#include "../src/timer/heap_timer.h"
+#include "../src/log/block_queue.h"
+#include "../src/log/log.h"
+#include "../src/pool/thread_pool.h"
+#include "../src/http/rate_limiter.h"
+
+// ---------------- Buffer ----------------
+
+// 追加后立即取走，缓冲区不需要扩容
+static void BM_BufferAppend(benchmark::State& state) {
+    std::string data(state.range(0), 'x');
+    Buffer buff;
+    for(auto _ : state) {
+        buff.append(data);
+        buff.retrieveAll();
+    }
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_BufferAppend)->RangeMultiplier(4)->Range(16, 64 << 10);
+
+// makeSpace_ 扩容分支：新缓冲区装不下，resize
+static void BM_BufferMakeSpaceGrow(benchmark::State& state) {
+    std::string data(state.range(0), 'x');
+    for(auto _ : state) {
+        Buffer buff(1024);
+        buff.append(data);
+        benchmark::DoNotOptimize(buff.peek());
+    }
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_BufferMakeSpaceGrow)->RangeMultiplier(4)->Range(2 << 10, 256 << 10);
+
+// makeSpace_ 搬移分支：前面已读的空间足够，把未读数据挪到开头
+static void BM_BufferMakeSpaceCompact(benchmark::State& state) {
+    size_t len = state.range(0);
+    std::string data(len, 'x');
+    Buffer buff(len * 2);
+    for(auto _ : state) {
+        buff.retrieveAll();
+        buff.append(data);
+        buff.append(data.data(), len / 2);
+        buff.retrieve(len);        // 留下len/2未读，前面空出len
+        buff.append(data);         // 尾部不够，前面够，触发搬移
+        benchmark::DoNotOptimize(buff.peek());
+    }
+    state.SetBytesProcessed(state.iterations() * len * 5 / 2);
+}
+BENCHMARK(BM_BufferMakeSpaceCompact)->RangeMultiplier(4)->Range(256, 64 << 10);
+
+// readFd：每轮先往socketpair另一端写入，计时包含这次write
+static void BM_BufferReadFd(benchmark::State& state) {
+    int fds[2];
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+        state.SkipWithError("socketpair failed");
+        return;
+    }
+    int size = static_cast<int>(state.range(0));
+    setsockopt(fds[0], SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    setsockopt(fds[1], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    std::string data(size, 'x');
+    Buffer buff;
+    int err = 0;
+    for(auto _ : state) {
+        size_t left = data.size();
+        while(left > 0) {
+            ssize_t n = ::write(fds[1], data.data() + data.size() - left, left);
+            if(n <= 0) { break; }
+            left -= n;
+            while(buff.readableBytes() < data.size() - left) {
+                buff.readFd(fds[0], &err);
+            }
+        }
+        buff.retrieveAll();
+    }
+    state.SetBytesProcessed(state.iterations() * data.size());
+    close(fds[0]);
+    close(fds[1]);
+}
+BENCHMARK(BM_BufferReadFd)->RangeMultiplier(8)->Range(64, 64 << 10);
+
+// ---------------- httpRequest::parse ----------------
+
+static const char* REQUEST_CORPUS[] = {
+    // 0: 最简GET
+    "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n",
+    // 1: 浏览器常见请求头
+    "GET /images/instagram-image1.jpg HTTP/1.1\r\n"
+    "Host: localhost:1316\r\n"
+    "Connection: keep-alive\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0 Safari/537.36\r\n"
+    "Accept: image/avif,image/webp,image/apng,image/svg+xml,image/*,*/*;q=0.8\r\n"
+    "Referer: http://localhost:1316/picture\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+    "Cookie: sid=0123456789abcdef0123456789abcdef\r\n\r\n",
+    // 2: 表单POST（非登录路径，不触发用户验证）
+    "POST /video HTTP/1.1\r\n"
+    "Host: localhost:1316\r\n"
+    "Connection: keep-alive\r\n"
+    "Content-Type: application/x-www-form-urlencoded\r\n"
+    "Content-Length: 58\r\n\r\n"
+    "username=%E5%BC%A0%E4%B8%89&passwd=p%40ss+word&remember=on",
+};
+
+static void BM_HttpRequestParse(benchmark::State& state) {
+    std::string req = REQUEST_CORPUS[state.range(0)];
+    httpRequest request;
+    Buffer buff;
+    for(auto _ : state) {
+        buff.append(req);
+        request.init();
+        benchmark::DoNotOptimize(request.parse(buff));
+        buff.retrieveAll();
+    }
+    state.SetBytesProcessed(state.iterations() * req.size());
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_HttpRequestParse)->DenseRange(0, 2);
+
+// ---------------- heapTimer ----------------
+
+static void BM_TimerAdd(benchmark::State& state) {
+    int n = static_cast<int>(state.range(0));
+    std::mt19937 rng(1);
+    std::vector<int> timeouts(n);
+    for(int& t : timeouts) { t = 1000 + rng() % 60000; }
+    for(auto _ : state) {
+        heapTimer timer;
+        for(int i = 0; i < n; i++) {
+            timer.add(i, timeouts[i], []() {});
+        }
+        benchmark::DoNotOptimize(&timer);
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_TimerAdd)->RangeMultiplier(10)->Range(1000, 1000000)->Unit(benchmark::kMillisecond);
+
+// 已有n个定时器时延长随机一个（对应每次读写事件的extentTime_）
+static void BM_TimerAdjust(benchmark::State& state) {
+    int n = static_cast<int>(state.range(0));
+    std::mt19937 rng(1);
+    heapTimer timer;
+    for(int i = 0; i < n; i++) {
+        timer.add(i, 1000 + rng() % 60000, []() {});
+    }
+    for(auto _ : state) {
+        timer.adjust(rng() % n, 60000 + rng() % 1000);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TimerAdjust)->RangeMultiplier(10)->Range(1000, 1000000);
+
+// n个定时器全部到期，一次tick清空
+static void BM_TimerTick(benchmark::State& state) {
+    int n = static_cast<int>(state.range(0));
+    for(auto _ : state) {
+        state.PauseTiming();
+        heapTimer timer;
+        for(int i = 0; i < n; i++) {
+            timer.add(i, 0, []() {});
+        }
+        state.ResumeTiming();
+        timer.tick();
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_TimerTick)->RangeMultiplier(10)->Range(1000, 1000000)->Unit(benchmark::kMillisecond);
+
+// ---------------- blockQueue / threadPool ----------------
+
+// 多线程争用同一个队列，每个线程push后pop
+static void BM_BlockQueuePushPop(benchmark::State& state) {
+    static blockQueue<std::string>* queue = nullptr;
+    if(state.thread_index() == 0) {
+        queue = new blockQueue<std::string>(1 << 16);
+    }
+    std::string item(64, 'x'), out;
+    for(auto _ : state) {
+        queue->push_back(item);
+        queue->pop(out);
+    }
+    state.SetItemsProcessed(state.iterations());
+    if(state.thread_index() == 0) {
+        delete queue;   // 所有线程结束循环后才会执行到这里
+        queue = nullptr;
+    }
+}
+BENCHMARK(BM_BlockQueuePushPop)->ThreadRange(1, 8)->UseRealTime();
+
+// 投递空任务，只计投递；循环结束后等任务执行完再销毁线程池
+static void BM_ThreadPoolAddTask(benchmark::State& state) {
+    threadPool pool(static_cast<int>(state.range(0)));
+    std::atomic<int64_t> done(0);
+    int64_t posted = 0;
+    for(auto _ : state) {
+        pool.addTask([&done]() { done.fetch_add(1, std::memory_order_relaxed); });
+        posted++;
+    }
+    while(done.load() < posted) {
+        std::this_thread::yield();
+    }
+    state.SetItemsProcessed(posted);
+}
+BENCHMARK(BM_ThreadPoolAddTask)->RangeMultiplier(2)->Range(1, 8)->UseRealTime();
+
+// ---------------- Log ----------------
+// 同步写在前：异步写线程一旦启动就常驻
+
+static void BM_LogWriteSync(benchmark::State& state) {
+    if(state.thread_index() == 0) {
+        Log::getInstance()->init(0, "./bench_log", ".log", false);
+    }
+    for(auto _ : state) {
+        LOG_INFO("Client[%d](%s:%d) in, userCount:%d", 17, "127.0.0.1", 52314, 100);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LogWriteSync)->ThreadRange(1, 4)->UseRealTime();
+
+static void BM_LogWriteSyncMmap(benchmark::State& state) {
+    if(state.thread_index() == 0) {
+        Log::getInstance()->init(0, "./bench_log_mmap", ".log", false, 64 << 20, 2);
+    }
+    for(auto _ : state) {
+        LOG_INFO("Client[%d](%s:%d) in, userCount:%d", 17, "127.0.0.1", 52314, 100);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LogWriteSyncMmap)->ThreadRange(1, 4)->UseRealTime();
+
+static void BM_LogWriteAsync(benchmark::State& state) {
+    if(state.thread_index() == 0) {
+        Log::getInstance()->init(0, "./bench_log", ".log", true);
+    }
+    for(auto _ : state) {
+        LOG_INFO("Client[%d](%s:%d) in, userCount:%d", 17, "127.0.0.1", 52314, 100);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LogWriteAsync)->ThreadRange(1, 4)->UseRealTime();
+
+// ---------------- rateLimiter ----------------
+
+// 每个请求一次检查：range(0)个活跃地址轮流访问，多线程时各线程落在不同或相同分片上
+static void BM_RateLimiterAllow(benchmark::State& state) {
+    static std::once_flag once;
+    std::call_once(once, []() {
+        rateLimiter::getInstance()->init(65536);
+        rateLimiter::getInstance()->setLimit(rateLimiter::REQUEST, 1e9);
+    });
+    uint32_t clients = static_cast<uint32_t>(state.range(0));
+    uint32_t i = static_cast<uint32_t>(state.thread_index()) * 7919;
+    for(auto _ : state) {
+        benchmark::DoNotOptimize(rateLimiter::getInstance()->allow(0x0a000000 + (i++ % clients), rateLimiter::REQUEST));
+    }
+}
+BENCHMARK(BM_RateLimiterAllow)->Arg(16)->Arg(50000)->Arg(1000000)->ThreadRange(1, 4)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,64 @@
+#!/bin/bash
+# 压测扫参：依次用 trigMode 0~3、不同线程池线程数启动服务器，对每个场景跑一遍 loadgen，
+# 结果汇总成 CSV。服务器使用嵌入式用户存储，不需要 MySQL，全部走本机回环。
+#   bench/sweep.sh                       # 默认参数
+#   THREADS="4 8" SCENARIOS="keepalive static" DURATION=5 bench/sweep.sh
+set -e
+
+ROOT="$(cd "$(dirname "$0")/.." && pwd)"
+BUILD_DIR="${BUILD_DIR:-$ROOT/_bench_build}"
+PORT="${PORT:-19316}"
+THREADS="${THREADS:-2 4 8}"
+MODES="${MODES:-0 1 2 3}"
+SCENARIOS="${SCENARIOS:-keepalive close static login slow}"
+DURATION="${DURATION:-10}"
+CONNS="${CONNS:-64}"
+LOADGEN_THREADS="${LOADGEN_THREADS:-4}"
+OUT="${OUT:-$BUILD_DIR/sweep.csv}"
+
+cmake -S "$ROOT" -B "$BUILD_DIR" -DCMAKE_BUILD_TYPE=Release -DLOG_MIN_LEVEL=1 > /dev/null
+cmake --build "$BUILD_DIR" --target server loadgen -j"$(nproc)" > /dev/null
+SERVER="$ROOT/build/server"
+LOADGEN="$ROOT/build/loadgen"
+
+WORK="$(mktemp -d)"
+SERVER_PID=""
+cleanup() {
+    if [ -n "$SERVER_PID" ]; then kill "$SERVER_PID" 2>/dev/null || true; wait "$SERVER_PID" 2>/dev/null || true; fi
+    rm -rf "$WORK"
+}
+trap cleanup EXIT
+
+# 服务器从当前目录的 resources/ 读取静态文件，日志也写在当前目录下
+ln -s "$ROOT/resources" "$WORK/resources"
+
+wait_port() {
+    for _ in $(seq 1 100); do
+        if (exec 3<>"/dev/tcp/127.0.0.1/$PORT") 2>/dev/null; then return 0; fi
+        sleep 0.1
+    done
+    return 1
+}
+
+echo "trig_mode,server_threads,scenario,loadgen_threads,conns,rps,p50_us,p99_us,p999_us,max_us,errors,timeouts" > "$OUT"
+for mode in $MODES; do
+    for threads in $THREADS; do
+        (cd "$WORK" && exec "$SERVER" -p "$PORT" -m "$mode" -t "$threads" -u "$WORK/users.db" -r 0,0,0 > "$WORK/server.out" 2>&1) &
+        SERVER_PID=$!
+        if ! wait_port; then
+            echo "server failed to start (mode=$mode threads=$threads)" >&2
+            exit 1
+        fi
+        for sc in $SCENARIOS; do
+            line=$("$LOADGEN" -p "$PORT" -t "$LOADGEN_THREADS" -c "$CONNS" -d "$DURATION" -s "$sc" \
+                   -r "$ROOT/resources" | grep '^RESULT,' | cut -d, -f2-)
+            echo "$mode,$threads,$line" | tee -a "$OUT"
+        done
+        kill "$SERVER_PID"
+        wait "$SERVER_PID" 2>/dev/null || true
+        SERVER_PID=""
+    done
+done
+
+echo "results written to $OUT"
+if command -v column > /dev/null; then column -s, -t "$OUT"; fi
@@ -0,0 +1,208 @@
+#define LOG_MODULE Log::MODULE_HTTP
+#include "credential_cache.h"
+#include "../log/log.h"
+
+using namespace std;
+using namespace std::chrono;
+
+const size_t credentialCache::MAX_USER_SESSIONS;
+
+credentialCache::credentialCache() {
+    ttl_ = seconds(0);
+    sessionTtl_ = seconds(0);
+    maxPerShard_ = 4096;
+    hits_ = misses_ = sessionHits_ = invalidations_ = 0;
+}
+
+// 懒汉模式 局部静态变量法
+credentialCache* credentialCache::getInstance() {
+    static credentialCache cache;
+    return &cache;
+}
+
+void credentialCache::init(int ttlSec, int sessionTtlSec, size_t maxEntries) {
+    ttl_ = seconds(ttlSec > 0 ? ttlSec : 0);
+    sessionTtl_ = seconds(sessionTtlSec > 0 ? sessionTtlSec : 0);
+    maxPerShard_ = maxEntries / SHARD_NUM > 0 ? maxEntries / SHARD_NUM : 1;
+    for(int i = 0; i < SHARD_NUM; i++) {
+        lock_guard<mutex> ul(users_[i].mtx);
+        users_[i].map.clear();
+        lock_guard<mutex> sl(sessions_[i].mtx);
+        sessions_[i].map.clear();
+    }
+}
+
+bool credentialCache::hash_(const unsigned char* salt, const string& passwd, unsigned char* out) {
+    string buf(reinterpret_cast<const char*>(salt), SALT_LEN);
+    buf += passwd;
+    unsigned int len = 0;
+    return EVP_Digest(buf.data(), buf.size(), out, &len, EVP_sha256(), nullptr) == 1 && len == HASH_LEN;
+}
+
+template<class MAP>
+void credentialCache::evict_(MAP& map, timePoint now) {
+    if(map.size() < maxPerShard_) {
+        return;
+    }
+    for(auto it = map.begin(); it != map.end(); ) {
+        if(it->second.expire <= now) {
+            it = map.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    if(map.size() >= maxPerShard_) {
+        map.erase(map.begin());
+    }
+}
+
+bool credentialCache::verify(const string& name, const string& passwd) {
+    if(!isOpen()) {
+        return false;
+    }
+    unsigned char salt[SALT_LEN], hash[HASH_LEN], expect[HASH_LEN];
+    {
+        userShard& shard = userShard_(name);
+        lock_guard<mutex> locker(shard.mtx);
+        auto it = shard.map.find(name);
+        if(it == shard.map.end() || !it->second.hasCred || it->second.credExpire <= steady_clock::now()) {
+            misses_++;
+            return false;
+        }
+        memcpy(salt, it->second.salt, SALT_LEN);
+        memcpy(expect, it->second.hash, HASH_LEN);
+    }
+    // 哈希计算放在锁外
+    if(hash_(salt, passwd, hash) && CRYPTO_memcmp(hash, expect, HASH_LEN) == 0) {
+        hits_++;
+        return true;
+    }
+    misses_++; // 密码不一致时仍以数据库为准（可能刚在别处改过密码）
+    return false;
+}
+
+void credentialCache::put(const string& name, const string& passwd) {
+    if(!isOpen()) {
+        return;
+    }
+    unsigned char salt[SALT_LEN], hash[HASH_LEN];
+    if(RAND_bytes(salt, SALT_LEN) != 1 || !hash_(salt, passwd, hash)) {
+        return;
+    }
+    timePoint now = steady_clock::now();
+    userShard& shard = userShard_(name);
+    lock_guard<mutex> locker(shard.mtx);
+    if(!shard.map.count(name)) {
+        evict_(shard.map, now);
+    }
+    userEntry& entry = shard.map[name];
+    memcpy(entry.salt, salt, SALT_LEN);
+    memcpy(entry.hash, hash, HASH_LEN);
+    entry.hasCred = true;
+    entry.credExpire = now + ttl_;
+    entry.expire = max(entry.expire, entry.credExpire);
+}
+
+void credentialCache::invalidate(const string& name) {
+    vector<string> sids;
+    {
+        userShard& shard = userShard_(name);
+        lock_guard<mutex> locker(shard.mtx);
+        auto it = shard.map.find(name);
+        if(it == shard.map.end()) {
+            return;
+        }
+        sids.swap(it->second.sessions);
+        shard.map.erase(it);
+    }
+    invalidations_++;
+    for(const string& sid : sids) { // 用户分片锁和会话分片锁不同时持有
+        sessionShard& shard = sessionShard_(sid);
+        lock_guard<mutex> locker(shard.mtx);
+        shard.map.erase(sid);
+    }
+}
+
+string credentialCache::createSession(const string& name) {
+    if(!isSessionOpen()) {
+        return "";
+    }
+    unsigned char raw[16];
+    if(RAND_bytes(raw, sizeof(raw)) != 1) {
+        return "";
+    }
+    static const char HEX[] = "0123456789abcdef";
+    string sid(sizeof(raw) * 2, '0');
+    for(size_t i = 0; i < sizeof(raw); i++) {
+        sid[2 * i] = HEX[raw[i] >> 4];
+        sid[2 * i + 1] = HEX[raw[i] & 0xf];
+    }
+    timePoint now = steady_clock::now();
+    timePoint expire = now + sessionTtl_;
+    string dropped;
+    {
+        // 会话挂在用户条目下，invalidate时一并作废
+        userShard& shard = userShard_(name);
+        lock_guard<mutex> locker(shard.mtx);
+        if(!shard.map.count(name)) {
+            evict_(shard.map, now);
+            shard.map[name].hasCred = false;
+        }
+        userEntry& entry = shard.map[name];
+        entry.expire = max(entry.expire, expire);
+        entry.sessions.push_back(sid);
+        if(entry.sessions.size() > MAX_USER_SESSIONS) {
+            dropped = entry.sessions.front();
+            entry.sessions.erase(entry.sessions.begin());
+        }
+    }
+    if(!dropped.empty()) {
+        sessionShard& shard = sessionShard_(dropped);
+        lock_guard<mutex> locker(shard.mtx);
+        shard.map.erase(dropped);
+    }
+    sessionShard& shard = sessionShard_(sid);
+    lock_guard<mutex> locker(shard.mtx);
+    evict_(shard.map, now);
+    shard.map[sid] = {name, expire};
+    return sid;
+}
+
+bool credentialCache::checkSession(const string& sid, const string& name) {
+    if(!isSessionOpen() || sid.empty()) {
+        return false;
+    }
+    sessionShard& shard = sessionShard_(sid);
+    lock_guard<mutex> locker(shard.mtx);
+    auto it = shard.map.find(sid);
+    if(it == shard.map.end()) {
+        return false;
+    }
+    if(it->second.expire <= steady_clock::now()) {
+        shard.map.erase(it);
+        return false;
+    }
+    if(it->second.name != name) {
+        return false;
+    }
+    sessionHits_++;
+    return true;
+}
+
+credentialCacheStats credentialCache::getStats() {
+    credentialCacheStats stats;
+    stats.hits = hits_;
+    stats.misses = misses_;
+    stats.sessionHits = sessionHits_;
+    stats.invalidations = invalidations_;
+    stats.users = stats.sessions = 0;
+    for(int i = 0; i < SHARD_NUM; i++) {
+        {
+            lock_guard<mutex> locker(users_[i].mtx);
+            stats.users += users_[i].map.size();
+        }
+        lock_guard<mutex> locker(sessions_[i].mtx);
+        stats.sessions += sessions_[i].map.size();
+    }
+    return stats;
+}
@@ -0,0 +1,96 @@
+#ifndef CREDENTIAL_CACHE_H
+#define CREDENTIAL_CACHE_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <unordered_map>
+#include <stdint.h>
+#include <openssl/evp.h>    // EVP_Digest
+#include <openssl/rand.h>   // RAND_bytes
+#include <openssl/crypto.h> // CRYPTO_memcmp
+#include <string.h>         // memcpy
+
+struct credentialCacheStats {
+    uint64_t hits;              // 登录命中缓存，未访问数据库
+    uint64_t misses;
+    uint64_t sessionHits;       // 凭会话cookie跳过验证的次数
+    uint64_t invalidations;
+    size_t users;
+    size_t sessions;
+};
+
+// 已验证凭据缓存：同一用户重复登录时不再借数据库连接查询
+// 1. 只保存 sha256(随机盐 + 密码)，不保存明文
+// 2. 按用户名/会话id分片加锁，条目带过期时间，每个分片有条目上限
+// 3. 注册或修改密码时调用invalidate，同时作废该用户的会话
+class credentialCache {
+public:
+    static credentialCache* getInstance();
+
+    // ttlSec为凭据缓存时间（0关闭缓存），sessionTtlSec为会话cookie有效期（0不签发会话）
+    void init(int ttlSec, int sessionTtlSec = 0, size_t maxEntries = 65536);
+    bool isOpen() const { return ttl_.count() > 0; }
+    bool isSessionOpen() const { return sessionTtl_.count() > 0; }
+    int sessionTtlSec() const { return static_cast<int>(sessionTtl_.count()); }
+
+    bool verify(const std::string& name, const std::string& passwd);        // 命中且密码一致返回true
+    void put(const std::string& name, const std::string& passwd);           // 数据库验证通过后写入
+    void invalidate(const std::string& name);
+
+    std::string createSession(const std::string& name);                    // 返回会话id，失败返回空串
+    bool checkSession(const std::string& sid, const std::string& name);     // 会话有效且属于name
+
+    credentialCacheStats getStats();
+
+private:
+    typedef std::chrono::steady_clock::time_point timePoint;
+
+    static const int SHARD_NUM = 16;
+    static const int SALT_LEN = 16;
+    static const int HASH_LEN = 32;
+    static const size_t MAX_USER_SESSIONS = 8;  // 每个用户保留的最近会话数
+
+    struct userEntry {
+        unsigned char salt[SALT_LEN];
+        unsigned char hash[HASH_LEN];
+        bool hasCred;                           // 凭据过期后条目可能只为会话保留
+        timePoint credExpire;
+        timePoint expire;                       // max(凭据, 会话)过期时间，过期才真正删除
+        std::vector<std::string> sessions;
+    };
+    struct sessionEntry {
+        std::string name;
+        timePoint expire;
+    };
+    struct userShard {
+        std::mutex mtx;
+        std::unordered_map<std::string, userEntry> map;
+    };
+    struct sessionShard {
+        std::mutex mtx;
+        std::unordered_map<std::string, sessionEntry> map;
+    };
+
+    credentialCache();
+    ~credentialCache() = default;
+
+    userShard& userShard_(const std::string& name) { return users_[std::hash<std::string>()(name) % SHARD_NUM]; }
+    sessionShard& sessionShard_(const std::string& sid) { return sessions_[std::hash<std::string>()(sid) % SHARD_NUM]; }
+    static bool hash_(const unsigned char* salt, const std::string& passwd, unsigned char* out);
+    template<class MAP>
+    void evict_(MAP& map, timePoint now);       // 分片满时清理过期条目，仍满则随意淘汰一个
+
+    std::chrono::seconds ttl_;
+    std::chrono::seconds sessionTtl_;
+    size_t maxPerShard_;
+    userShard users_[SHARD_NUM];
+    sessionShard sessions_[SHARD_NUM];
+
+    std::atomic<uint64_t> hits_, misses_, sessionHits_, invalidations_;
+};
+
+#endif
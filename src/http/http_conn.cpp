@@ -1,14 +1,38 @@
+#define LOG_MODULE Log::MODULE_HTTP
 #include "http_conn.h"
 
 // 在类外对静态成员初始化
 const char* httpConn::srcDir;
 std::atomic<int> httpConn::userCount;
+const char* httpConn::metricsPath = nullptr;
+bool httpConn::tracePhases = false;
+std::atomic<bool> httpConn::draining(false);
 bool httpConn::isET;
+size_t httpConn::writeQuantum = 0;
+int httpConn::writeSliceUs = 0;
+uint64_t httpConn::pacingRate = 0;
+const size_t httpConn::PACING_MIN_BYTES;
+size_t httpConn::prefetchWindow = 0;
 
 httpConn::httpConn() {
     fd_ = -1;
     addr_ = {0};
+    ip_[0] = '\0';
     isClose_ = true;
+    iovCnt_ = 0;
+    iov_[0] = iov_[1] = {nullptr, 0};
+    respBytes_ = 0;
+    keepAlive_ = false;
+    paced_ = false;
+    residentEnd_ = windowEnd_ = nullptr;
+    noPrefetch_ = false;
+    generation_ = 0;
+    state_ = STATE_CLOSED;
+    bytesIn_ = 0;
+    bytesOut_ = 0;
+    requests_ = 0;
+    traceWrite_ = false;
+    firstWritten_ = false;
 }
 
 httpConn::~httpConn() {
@@ -18,11 +42,21 @@ httpConn::~httpConn() {
 void httpConn::init(int fd, const sockaddr_in& addr) {
     assert(fd > 0);
     userCount++;
+    metrics::add(metrics::CONN_ACCEPTED);
+    generation_++;
     addr_ = addr;
+    inet_ntop(AF_INET, &addr_.sin_addr, ip_, sizeof(ip_));
+    request_.setClientAddr(addr_.sin_addr.s_addr);
     fd_ = fd;
     writeBuff_.retrieveAll();
     readBuff_.retrieveAll();
     isClose_ = false;
+    bytesIn_.store(0, std::memory_order_relaxed);
+    bytesOut_.store(0, std::memory_order_relaxed);
+    requests_.store(0, std::memory_order_relaxed);
+    createdAt_ = std::chrono::steady_clock::now();
+    state_.store(STATE_READ, std::memory_order_relaxed);
+    paced_ = false; // 新socket没有限速
     LOG_INFO("Client[%d](%s:%d) in , userCount:%d", fd_, getIP(), getPort(), (int)userCount);
 }
 
@@ -30,7 +64,10 @@ void httpConn::closeConn() {
     response_.unmapFile();
     if(isClose_ == false) {
         isClose_ = true;
+        state_.store(STATE_CLOSED, std::memory_order_relaxed);
+        generation_++;
         userCount--;
+        metrics::add(metrics::CONN_CLOSED);
         close(fd_);
         LOG_INFO("Client[%d](%s:%d) quit , userCount:%d", fd_, getIP(), getPort(), (int)userCount);
     }
@@ -41,39 +78,88 @@ int httpConn::getFd() const {
 }
 
 int httpConn::getPort() const {
-    return addr_.sin_port;
+    return ntohs(addr_.sin_port);
 }
 
 sockaddr_in httpConn::getAddr() const {
     return addr_;
 }
 const char* httpConn::getIP() const {
-    return inet_ntoa(addr_.sin_addr); // 将网络字节序表示的 IPv4 地址转换为点分十进制表示的字符串形式
+    return ip_;
+}
+
+const char* httpConn::stateName() const {
+    switch(state()) {
+        case STATE_READ: return "read";
+        case STATE_VERIFY: return "verify";
+        case STATE_WRITE: return "write";
+        case STATE_FILEIO: return "fileio";
+        default: return "closed";
+    }
+}
+
+int64_t httpConn::ageMs() const {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - createdAt_).count();
 }
 
 ssize_t httpConn::read(int* saveErrno) {
     ssize_t len = -1;
+    if(tracePhases) {
+        dequeueAt_ = std::chrono::steady_clock::now();
+        latencyTracker::record(latencyTracker::PHASE_QUEUE, elapsedUs_(readyAt_, dequeueAt_));
+    }
+    if(readBuff_.readableBytes() == 0) { // 新请求的开始
+        reqStart_ = std::chrono::steady_clock::now();
+        reqReadyAt_ = readyAt_;
+    }
     do{
         len = readBuff_.readFd(fd_, saveErrno);
         if(len <= 0){
             break;
         }
+        metrics::add(metrics::BYTES_IN, len);
+        bytesIn_.store(bytesIn_.load(std::memory_order_relaxed) + len, std::memory_order_relaxed); // 同一时刻只有一个线程处理该连接
     } while(isET); // ET: 边沿触发要一次性全部读出
     return len;
 }
 
 // 采用writev集中写函数（将多个缓冲区数据或文件写入同一处）
-ssize_t httpConn::write(int* saveErrno) {
+ssize_t httpConn::write(int* saveErrno, bool once) {
     ssize_t len = -1;
+    size_t written = 0;
+    std::chrono::steady_clock::time_point sliceStart;
+    if(writeSliceUs > 0) { sliceStart = std::chrono::steady_clock::now(); }
     do {
-        len = writev(fd_, iov_, iovCnt_); // 将iov_[0], iov_[1]中的内容写到fd_中
+        struct iovec iov[2] = {iov_[0], iov_[1]};
+        if(writeQuantum > 0) { // 单次writev不超过本轮剩余配额，否则一次就可能写出几MB
+            size_t budget = writeQuantum - written;
+            if(iov[0].iov_len >= budget) {
+                iov[0].iov_len = budget;
+                iov[1].iov_len = 0;
+            } else if(iov[1].iov_len > budget - iov[0].iov_len) {
+                iov[1].iov_len = budget - iov[0].iov_len;
+            }
+        }
+        if(prefetchWindow > 0 && residentEnd_ > static_cast<char*>(iov[1].iov_base) && iov[1].iov_len > 0) {
+            // 不越过已确认驻留的范围，后面的部分等下一次写前再检查
+            iov[1].iov_len = std::min<size_t>(iov[1].iov_len, residentEnd_ - static_cast<char*>(iov[1].iov_base));
+        }
+        len = writev(fd_, iov, iovCnt_); // 将iov_[0], iov_[1]中的内容写到fd_中
         if(len <= 0) {
             *saveErrno = errno; // errno 是一个全局变量，用于记录系统调用最后一次出错的错误码
             break;
         }
-        if(iov_[0].iov_len + iov_[1].iov_len == 0) { // 传输结束
-            break;
-        } else if(static_cast<size_t>(len) > iov_[0].iov_len) { // 传输数据量大于iov_[0] (Buffer) 的数据量
+        written += len;
+        metrics::add(metrics::BYTES_OUT, len);
+        bytesOut_.store(bytesOut_.load(std::memory_order_relaxed) + len, std::memory_order_relaxed);
+        WS_PROBE2(conn_write, fd_, len);
+        if(traceWrite_ && !firstWritten_) {
+            firstWritten_ = true;
+            firstByteAt_ = std::chrono::steady_clock::now();
+            latencyTracker::record(latencyTracker::PHASE_WRITE_WAIT, elapsedUs_(builtAt_, firstByteAt_));
+        }
+        if(static_cast<size_t>(len) > iov_[0].iov_len) { // 传输数据量大于iov_[0] (Buffer) 的数据量
             iov_[1].iov_base = (uint8_t*) iov_[1].iov_base + (len - iov_[0].iov_len); // iov_base 类型为 void* 通用指针，不能进行算术运算
             iov_[1].iov_len -= (len - iov_[0].iov_len);
             if(iov_[0].iov_len) {
@@ -85,7 +171,29 @@ ssize_t httpConn::write(int* saveErrno) {
             iov_[0].iov_len -= len;
             writeBuff_.retrieve(len); 
         }
-    } while(isET || writeBytesLen() > 13200); // 13200 = (8 + 1024) * 10; 8 = kCheapPrepend, 1024 = initBuffSize 
+        if(iov_[0].iov_len + iov_[1].iov_len == 0) { // 传输结束
+            break;
+        }
+        if(prefetchWindow > 0 && residentEnd_ && static_cast<char*>(iov_[1].iov_base) >= residentEnd_) {
+            break; // 本窗口写完，返回后由调用方重新注册EPOLLOUT，下一次写前检查下一个窗口
+        }
+        // 用完本轮配额或时间片：让出工作线程，由调用方重新注册EPOLLOUT，排到任务队列末尾
+        if((writeQuantum > 0 && written >= writeQuantum) ||
+           (writeSliceUs > 0 && std::chrono::steady_clock::now() - sliceStart >= std::chrono::microseconds(writeSliceUs))) {
+            metrics::add(metrics::WRITE_YIELD);
+            break;
+        }
+    } while(!once && (isET || writeBytesLen() > 13200)); // 13200 = (8 + 1024) * 10; 8 = kCheapPrepend, 1024 = initBuffSize 
+    if(writeBytesLen() == 0) {
+        WS_PROBE2(write_done, fd_, respBytes_);
+        state_.store(STATE_READ, std::memory_order_relaxed);
+    }
+    if(traceWrite_ && firstWritten_ && writeBytesLen() == 0) {
+        traceWrite_ = false;
+        auto now = std::chrono::steady_clock::now();
+        latencyTracker::record(latencyTracker::PHASE_WRITE, elapsedUs_(firstByteAt_, now));
+        latencyTracker::record(latencyTracker::PHASE_TOTAL, elapsedUs_(reqReadyAt_, now));
+    }
     return len;
 }
 
@@ -93,18 +201,139 @@ bool httpConn::process() {
     request_.init();
     if(readBuff_.readableBytes() <= 0) {
         return false;
-    } else if(request_.parse(readBuff_)) { // 解析成功
+    }
+    // 按客户端地址限速放在解析之前：超限的请求不付解析的开销，丢弃已读数据后回429并关闭连接
+    if(!rateLimiter::getInstance()->allow(addr_.sin_addr.s_addr, rateLimiter::REQUEST)) {
+        metrics::add(metrics::LIMITED_REQ);
+        readBuff_.retrieveAll();
+        keepAlive_ = false;
+        if(tracePhases) { parsedAt_ = std::chrono::steady_clock::now(); }
+        respondLimited_();
+        return true;
+    }
+    bool parsed = request_.parse(readBuff_);
+    if(tracePhases) {
+        parsedAt_ = std::chrono::steady_clock::now();
+        int64_t verifyUs = request_.verifyUs();
+        uint64_t parseUs = elapsedUs_(dequeueAt_, parsedAt_);
+        if(verifyUs >= 0) { // 同步验证计入verify阶段，不算在解析里
+            latencyTracker::record(latencyTracker::PHASE_VERIFY, verifyUs);
+            parseUs -= std::min<uint64_t>(parseUs, verifyUs);
+        }
+        latencyTracker::record(latencyTracker::PHASE_PARSE, parseUs);
+    }
+    keepAlive_ = parsed && request_.isKeepAlive() && !draining.load(std::memory_order_relaxed); // 排空期间不再保持连接
+    if(parsed) { // 解析成功
+        if(request_.isVerifyPending()) { // 等异步验证结果回来后再生成响应
+            state_.store(STATE_VERIFY, std::memory_order_relaxed);
+            return true;
+        }
         LOG_DEBUG("%s", request_.path().c_str());
-        response_.init(srcDir, request_.path(), request_.isKeepAlive(), 200);
+        if(request_.isRateLimited()) {
+            metrics::add(metrics::LIMITED_AUTH);
+            respondLimited_();
+            return true;
+        }
+        if(request_.path() == "/ready") { // 就绪探针：数据库连接预热完成前返回503，滚动发布时据此切换流量
+            bool ready = httpRequest::isAsyncVerify || userStore::getInstance()->isReady();
+            response_.initContent(ready ? 200 : 503, "text/plain", ready ? "ready\n" : "warming up\n", isKeepAlive());
+        } else if(metricsPath && request_.path() == metricsPath) {
+            response_.initContent(200, "text/plain; version=0.0.4", metrics::getInstance()->render(), isKeepAlive());
+        } else {
+            response_.init(srcDir, request_.path(), isKeepAlive(), request_.isUnavailable() ? 503 : 200);
+            response_.setNegotiation(request_.getHeader("If-None-Match"), request_.getHeader("Accept-Encoding"));
+            addSessionCookie_();
+        }
     } else {
         response_.init(srcDir, request_.path(), false, 400);
     }
+    prepareWrite_();
+    return true;
+}
+
+bool httpConn::needPrefetch(std::string* path, size_t* offset, size_t* len) {
+    if(prefetchWindow == 0 || iov_[1].iov_len == 0 || noPrefetch_) {
+        return false;
+    }
+    char* file = response_.file();
+    char* base = static_cast<char*>(iov_[1].iov_base);
+    if(residentEnd_ && base < residentEnd_) { // 还在上次确认过的窗口里
+        return false;
+    }
+    static const size_t pageSize = sysconf(_SC_PAGESIZE);
+    // mincore要求页对齐；映射起点是页对齐的（bundle中的小文件不一定），向下对齐不会越出映射
+    char* start = reinterpret_cast<char*>(reinterpret_cast<uintptr_t>(base) & ~(pageSize - 1));
+    char* end = base + std::min(iov_[1].iov_len, prefetchWindow);
+    size_t pages = (end - start + pageSize - 1) / pageSize;
+    static thread_local std::vector<unsigned char> vec;
+    if(vec.size() < pages) { vec.resize(pages); }
+    windowEnd_ = end;
+    if(mincore(start, end - start, vec.data()) < 0) { // 查不了就照常写，由缺页兜底
+        residentEnd_ = end;
+        return false;
+    }
+    size_t first = 0;
+    while(first < pages && (vec[first] & 1)) { first++; }
+    if(first == pages) {
+        residentEnd_ = end;
+        return false;
+    }
+    // 只预读第一个不驻留的页开始的部分
+    char* from = std::max(base, start + first * pageSize);
+    *path = response_.filePath();
+    *offset = response_.fileOffset() + (from - file);
+    *len = end - from;
+    state_.store(STATE_FILEIO, std::memory_order_relaxed);
+    return true;
+}
 
+void httpConn::markPrefetched() {
+    residentEnd_ = windowEnd_;
+    state_.store(STATE_WRITE, std::memory_order_relaxed);
+}
+
+void httpConn::prefetchFailed() {
+    noPrefetch_ = true; // 再次预读多半同样失败；写时缺页由内核读盘兜底
+    state_.store(STATE_WRITE, std::memory_order_relaxed);
+}
+
+void httpConn::resume(httpRequest::VERIFY_RESULT ret) {
+    if(tracePhases) { // 异步验证：从解析完成到结果回来都算verify阶段
+        auto now = std::chrono::steady_clock::now();
+        latencyTracker::record(latencyTracker::PHASE_VERIFY, elapsedUs_(parsedAt_, now));
+        parsedAt_ = now;
+    }
+    request_.finishVerify(ret);
+    keepAlive_ = keepAlive_ && !draining.load(std::memory_order_relaxed);
+    response_.init(srcDir, request_.path(), isKeepAlive(), request_.isUnavailable() ? 503 : 200);
+    addSessionCookie_();
+    prepareWrite_();
+}
+
+void httpConn::respondLimited_() {
+    response_.initContent(429, "text/plain", "Too many requests\n", isKeepAlive());
+    response_.addHeader("Retry-After", "1");
+    prepareWrite_();
+}
+
+void httpConn::addSessionCookie_() {
+    if(request_.sessionId().empty()) {
+        return;
+    }
+    response_.addHeader("Set-Cookie", "sid=" + request_.sessionId() + "; Path=/; HttpOnly; Max-Age=" +
+                        std::to_string(credentialCache::getInstance()->sessionTtlSec()));
+}
+
+void httpConn::prepareWrite_() {
     response_.makeResponse(writeBuff_); // 生成响应写入writeBuff_中
+    metrics::addRequest(response_.code());
     // 响应头
     iov_[0].iov_base = const_cast<char*>(writeBuff_.peek());
     iov_[0].iov_len = writeBuff_.readableBytes();
+    iov_[1] = {nullptr, 0};
     iovCnt_ = 1;
+    residentEnd_ = windowEnd_ = nullptr; // 新的映射，驻留情况重新检查
+    noPrefetch_ = false;
 
     // 文件
     if(response_.fileLen() > 0 && response_.file()) {
@@ -112,6 +341,62 @@ bool httpConn::process() {
         iov_[1].iov_len = response_.fileLen();
         iovCnt_ = 2;
     }
+    respBytes_ = writeBytesLen();
+    // 按连接限速：大响应由内核TCP pacing按pacingRate发送，发送缓冲区满后EAGAIN，自然让出工作线程；小响应不受影响
+    bool pace = pacingRate > 0 && respBytes_ >= PACING_MIN_BYTES;
+    if(pace != paced_) {
+        unsigned int rate = pace ? static_cast<unsigned int>(std::min<uint64_t>(pacingRate, ~0U - 1)) : ~0U;
+        if(setsockopt(fd_, SOL_SOCKET, SO_MAX_PACING_RATE, &rate, sizeof(rate)) == 0) {
+            paced_ = pace;
+        } else {
+            LOG_DEBUG("Client[%d] set pacing rate error: %s", fd_, strerror(errno));
+        }
+    }
+    requests_.store(requests_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    state_.store(STATE_WRITE, std::memory_order_relaxed);
+    WS_PROBE3(response_build, fd_, response_.code(), respBytes_);
+    if(tracePhases) {
+        builtAt_ = std::chrono::steady_clock::now();
+        latencyTracker::record(latencyTracker::PHASE_BUILD, elapsedUs_(parsedAt_, builtAt_));
+        traceWrite_ = true;
+        firstWritten_ = false;
+    }
     LOG_DEBUG("File size: %dB(response header) + %dB(content) = %dB", iov_[0].iov_len, iov_[1].iov_len, writeBytesLen());
-    return true;
+}
+
+uint64_t httpConn::elapsedUs_(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to) {
+    if(to <= from) { // 时间戳来自上一个请求或尚未设置
+        return 0;
+    }
+    return std::chrono::duration_cast<std::chrono::microseconds>(to - from).count();
+}
+
+void httpConn::logAccess() {
+    accessLog* log = accessLog::getInstance();
+    if(!log->isOpen() || !log->shouldSample(response_.code())) {
+        return;
+    }
+    accessRecord rec;
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts); // vdso，不陷入内核
+    rec.timeUs = static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+    rec.latencyUs = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - reqStart_).count());
+    rec.ip = addr_.sin_addr.s_addr;
+    rec.port = ntohs(addr_.sin_port);
+    rec.status = static_cast<uint16_t>(response_.code());
+    rec.bytes = respBytes_;
+    // 定长字段：超长截断，其余补0，保证以'\0'结尾
+    std::string method = request_.method();
+    size_t n = std::min(method.size(), sizeof(rec.method) - 1);
+    memcpy(rec.method, method.data(), n);
+    memset(rec.method + n, 0, sizeof(rec.method) - n);
+    const std::string& path = request_.path();
+    n = std::min(path.size(), sizeof(rec.path) - 1);
+    for(size_t i = 0; i < n; i++) { // 制表符/换行会破坏按列解析，替换掉
+        char ch = path[i];
+        rec.path[i] = (ch == '\t' || ch == '\n' || ch == '\r') ? '_' : ch;
+    }
+    memset(rec.path + n, 0, sizeof(rec.path) - n);
+    log->record(rec);
 }
@@ -4,19 +4,35 @@
 #include <atomic>       // std::atomic<int> userCount;
 #include <sys/types.h>
 #include <sys/uio.h>    // readv/writev
+#include <sys/socket.h> // SO_MAX_PACING_RATE
 #include <arpa/inet.h>  // sockaddr_in
 #include <stdlib.h>     // atoi() 字符串转换为整数
 #include <errno.h>
+#include <chrono>
+#include <vector>
+#include <sys/mman.h>   // mincore
 
 
 #include "../log/log.h"
+#include "../log/access_log.h"
 #include "../buffer/buffer.h"
+#include "../metrics/metrics.h"
+#include "../metrics/latency_tracker.h"
 #include "http_request.h"
 #include "http_response.h"
 
 // 进行读写数据并调用httprequest解析数据以及调用httpresponse来生成响应
 class httpConn {
 public:
+    // 连接当前所处阶段，供管理接口查看
+    enum STATE {
+        STATE_CLOSED = 0,
+        STATE_READ,     // 等待/读取请求
+        STATE_VERIFY,   // 等待异步验证结果
+        STATE_WRITE,    // 响应已生成，等待写出
+        STATE_FILEIO,   // 响应文件不在页缓存中，等待文件I/O线程读入
+    };
+
     httpConn();
     ~httpConn();
 
@@ -28,29 +44,102 @@ public:
     const char* getIP() const;
     
     ssize_t read(int* saveErrno);
-    ssize_t write(int* saveErrno);
+    ssize_t write(int* saveErrno, bool once = false);  // once：只做一次writev（过载时在事件循环里写）
     bool process();
+    // 写之前检查接下来prefetchWindow字节的文件是否都在页缓存中（mincore）；不在时返回true并给出要预读的范围，
+    // 预读完成后调用markPrefetched。write()不会越过已确认驻留的范围，下一次写时再检查下一个窗口
+    bool needPrefetch(std::string* path, size_t* offset, size_t* len);
+    void markPrefetched();
+    void prefetchFailed();          // 预读失败：窗口不算驻留，本响应余下部分不再预读，直接写
+    void resume(httpRequest::VERIFY_RESULT ret);    // 异步验证完成后继续生成响应，数据库不可用时回503
+    void logAccess();   // 响应发送完毕后记录访问日志（按采样率）
+    void markReadReady() {  // 事件循环收到读就绪时调用，用于统计线程池排队时间
+        if(tracePhases) { readyAt_ = std::chrono::steady_clock::now(); }
+    }
 
     // 写的总长度
     int writeBytesLen() {
         return iov_[0].iov_len + iov_[1].iov_len;
     }
 
-    bool isKeepAlive() const {
-        return request_.isKeepAlive();
+    size_t fileBytesLen() const { // 其中还没写出的文件部分
+        return iov_[1].iov_len;
+    }
+
+    bool isKeepAlive() const { // 与已生成的响应头一致：排空开始前生成的响应仍保持连接，下一个响应再带 Connection: close
+        return keepAlive_;
+    }
+
+    bool isVerifyPending() const {
+        return request_.isVerifyPending();
+    }
+
+    const httpRequest& request() const {
+        return request_;
+    }
+
+    // 以下统计由工作线程写、事件循环线程读，只用于管理接口展示
+    int state() const { return state_.load(std::memory_order_relaxed); }
+    const char* stateName() const;
+    uint64_t bytesIn() const { return bytesIn_.load(std::memory_order_relaxed); }
+    uint64_t bytesOut() const { return bytesOut_.load(std::memory_order_relaxed); }
+    uint32_t requests() const { return requests_.load(std::memory_order_relaxed); }
+    int64_t ageMs() const; // 连接建立至今的毫秒数
+
+    // 每次init/close递增，异步回调据此判断连接是否已被关闭或复用
+    uint64_t generation() const {
+        return generation_.load(std::memory_order_acquire);
     }
 
     static bool isET;
     static const char* srcDir;
     static std::atomic<int> userCount; // 原子，支持锁
+    static const char* metricsPath;    // 指标抓取路径，nullptr关闭
+    static bool tracePhases;           // 统计请求各阶段耗时
+    static std::atomic<bool> draining; // 平滑升级后旧进程正在排空连接
+    // 写公平调度：一次write最多写writeQuantum字节或writeSliceUs微秒后让出，0不限
+    static size_t writeQuantum;
+    static int writeSliceUs;
+    static uint64_t pacingRate;        // 大响应的按连接限速（字节/秒，SO_MAX_PACING_RATE），0不限
+    static const size_t PACING_MIN_BYTES = 64 * 1024;  // 不小于该大小的响应才限速
+    static size_t prefetchWindow;      // 写前检查驻留的文件窗口大小，0关闭（不检查，冷页在工作线程里缺页）
 
     
 private:
+    void prepareWrite_();   // 生成响应并填好iov_
+    void respondLimited_(); // 超过限速：429 + Retry-After
+    void addSessionCookie_(); // 登录成功时下发会话cookie
+    static uint64_t elapsedUs_(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to);
+
     int fd_;
     struct sockaddr_in addr_;
+    char ip_[INET_ADDRSTRLEN];  // init时转换好的点分十进制地址，inet_ntoa 不是线程安全的
     bool isClose_;
     int iovCnt_;
     struct iovec iov_[2];
+    size_t respBytes_;  // 本次响应的总字节数
+    bool keepAlive_;    // 本次响应是否保持连接
+    bool paced_;        // socket当前设置了pacing限速
+    char* residentEnd_; // 文件映射中已确认驻留的范围的末尾，nullptr为还未检查
+    char* windowEnd_;   // 最近一次检查的窗口末尾
+    bool noPrefetch_;   // 本响应预读失败过
+    std::atomic<uint64_t> generation_;
+    std::atomic<int> state_;
+    std::atomic<uint64_t> bytesIn_;     // 本连接累计读入字节数
+    std::atomic<uint64_t> bytesOut_;    // 本连接累计写出字节数
+    std::atomic<uint32_t> requests_;    // 本连接已生成的响应数
+    std::chrono::steady_clock::time_point createdAt_; // 连接建立时刻
+    std::chrono::steady_clock::time_point reqStart_; // 开始读取本次请求的时刻
+
+    // 阶段耗时统计的时间戳，tracePhases关闭时不取时间
+    std::chrono::steady_clock::time_point readyAt_;     // 最近一次读就绪
+    std::chrono::steady_clock::time_point reqReadyAt_;  // 本次请求第一次读就绪
+    std::chrono::steady_clock::time_point dequeueAt_;   // 工作线程开始读
+    std::chrono::steady_clock::time_point parsedAt_;    // 解析完成（异步验证时为验证完成）
+    std::chrono::steady_clock::time_point builtAt_;     // 响应生成
+    std::chrono::steady_clock::time_point firstByteAt_; // 写出第一个字节
+    bool traceWrite_;   // 响应已生成、还未写完
+    bool firstWritten_;
 
     Buffer readBuff_; // 读缓冲区
     Buffer writeBuff_; // 写缓冲区
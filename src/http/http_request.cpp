@@ -1,3 +1,4 @@
+#define LOG_MODULE Log::MODULE_HTTP
 #include "http_request.h"
 using namespace std;
 
@@ -11,10 +12,18 @@ const unordered_map<string, int> httpRequest::DEFAULT_HTML_TAG {
     {"/login.html", 1}, {"/register.html", 0},
 };
 
+bool httpRequest::isAsyncVerify = false;
+
 // 初始化
 void httpRequest::init() {
     state_ = REQUEST_LINE;
+    verifyPending_ = false;
+    verifyIsLogin_ = false;
+    unavailable_ = false;
+    rateLimited_ = false;
+    verifyUs_ = -1;
     method_ = path_ = version_ = body_ = "";
+    sessionId_.clear();
     header_.clear();
     post_.clear();
 }
@@ -23,6 +32,7 @@ void httpRequest::init() {
 bool httpRequest::parse(Buffer& buff) {
     const char END[] = "\r\n"; // 结束符：回车、换行
     if(buff.readableBytes() == 0) return false; // 无可读数据
+    WS_PROBE1(parse_start, buff.readableBytes());
     // 读取数据开始
     while(buff.readableBytes() && state_ != FINISH) {
         // 从buffer中读指针开始到写指针结束（前闭后开），并去除"\r\n"，返回有效数据的行末指针
@@ -33,6 +43,7 @@ bool httpRequest::parse(Buffer& buff) {
             case REQUEST_LINE:
                 // 解析错误
                 if(!parseRequestLine_(line)) {
+                    WS_PROBE2(parse_end, 0, path_.c_str());
                     return false;
                 }
                 parsePath_(); // 解析路径
@@ -56,6 +67,7 @@ bool httpRequest::parse(Buffer& buff) {
         buff.retrieveUntil(lineend + 2); // 跳过回车换行符
     }
     LOG_DEBUG("[%s], [%s], [%s]", method_.c_str(), path_.c_str(), version_.c_str());
+    WS_PROBE2(parse_end, 1, path_.c_str());
     return true;
 }
 
@@ -109,11 +121,30 @@ void httpRequest::parsePost_() {
             int tag = DEFAULT_HTML_TAG.find(path_)->second;
             LOG_DEBUG("Tag: %d", tag);
             if(tag == 0 || tag == 1) {
+                if(!rateLimiter::getInstance()->allow(clientAddr_, rateLimiter::AUTH)) {
+                    rateLimited_ = true; // 同一地址登录/注册过于频繁（撞库、批量注册），不查缓存和数据库
+                    return;
+                }
                 bool isLogin = (tag == 1); // 为1则是登录
-                if(userVerify_(post_["username"], post_["passwd"], isLogin)) {
+                const string& name = post_["username"];
+                const string& passwd = post_["passwd"];
+                auto begin = std::chrono::steady_clock::now();
+                if(isLogin && verifyCached_(name, passwd)) {
                     path_ = "/welcome.html";
+                } else if(isAsyncVerify) { // 交给事件循环异步查询，不阻塞工作线程
+                    verifyPending_ = true;
+                    verifyIsLogin_ = isLogin;
                 } else {
-                    path_ = "/error.html";
+                    VERIFY_RESULT ret = userVerify_(name, passwd, isLogin);
+                    unavailable_ = (ret == VERIFY_UNAVAILABLE);
+                    if(ret == VERIFY_OK) {
+                        onVerified_(name, passwd, isLogin);
+                    }
+                    path_ = (ret == VERIFY_OK) ? "/welcome.html" : "/error.html";
+                }
+                if(!verifyPending_) {
+                    verifyUs_ = std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - begin).count();
                 }
             }
         }
@@ -162,73 +193,107 @@ void httpRequest::parseFromUrlEncoded_() {
     }
 }
 
-bool httpRequest::userVerify_(const std::string& name, const std::string& passwd, bool isLogin) {
+httpRequest::VERIFY_RESULT httpRequest::userVerify_(const std::string& name, const std::string& passwd, bool isLogin) {
     // 1. 检查用户名或密码是否为空
     if(name == "" || passwd == "") {
-        return false;
+        return VERIFY_FAIL;
     }
 
-    LOG_INFO("Verify Name: %s, Password: %s", name.c_str(), passwd.c_str());
-
-    // 2. 获取数据库连接
-    MYSQL* sql;
-    sqlConnRAII(&sql, sqlConnPool::getInstance());
-    assert(sql);
-
-    // 构建通用的查询语句相关变量
-    char order[256] = {0};
-    MYSQL_RES* res = nullptr;
+    LOG_INFO("Verify Name: %s", name.c_str());
 
-    // 构建查询用户名和密码的SQL语句
-    snprintf(order, 256, "SELECT username, password FROM user WHERE username='%s' LIMIT 1", name.c_str());
-    LOG_DEBUG("SQL: %s", order);
-
-    if(mysql_query(sql, order)) {  // 如果查询失败
-        mysql_free_result(res);
-        return false;
+    // 2. 交给启动时选定的用户存储后端（MySQL 或嵌入式存储）
+    userStore* store = userStore::getInstance();
+    userStore::RESULT ret = isLogin ? store->login(name, passwd) : store->registerUser(name, passwd);
+    if(ret == userStore::STORE_OK) {
+        return VERIFY_OK;
     }
-    res = mysql_store_result(sql);
+    return ret == userStore::STORE_UNAVAILABLE ? VERIFY_UNAVAILABLE : VERIFY_FAIL;
+}
 
-    // 登录或注册
-    if(isLogin) {  // 登录逻辑
-        if(res) {
-            MYSQL_ROW row = mysql_fetch_row(res);
-            if (row) {
-                std::string password(row[1]);
-                if (passwd == password) {
-                    LOG_INFO("Password Correct!");
-                    return true;
-                } else {
-                    LOG_INFO("Password Error!");
-                    return false;
-                }
+// 登录：查询密码后比对；注册：用户名不存在时在同一连接上继续执行INSERT
+void httpRequest::verifyAsync(asyncSqlClient* sql, const std::function<void(VERIFY_RESULT)>& done) const {
+    assert(sql && verifyPending_);
+    std::string name = getPost("username"), passwd = getPost("passwd");
+    if(name == "" || passwd == "") {
+        done(VERIFY_FAIL);
+        return;
+    }
+    LOG_INFO("Verify Name: %s", name.c_str());
+    bool isLogin = verifyIsLogin_;
+    // 用户输入只作为参数，由派发查询的连接转义绑定
+    sqlStatement insertStmt = {"INSERT INTO user(username, password) VALUES(?, ?)", {name, passwd}};
+    sqlStatement selectStmt = {"SELECT password FROM user WHERE username=? LIMIT 1", {name}};
+    // 注册时布隆过滤器判定用户名一定不存在，直接INSERT，由唯一键兜底
+    bool needSelect = isLogin || userFilter::getInstance()->mayContain(name);
+    std::shared_ptr<bool> inserting(new bool(!needSelect));
+    sql->query(needSelect ? selectStmt : insertStmt,
+        [=](MYSQL_RES* res, asyncSqlClient::QUERY_RESULT result) -> sqlStatement {
+            if(result == asyncSqlClient::QUERY_UNAVAILABLE) { // 数据库不可用或超过查询期限，不能判定用户名密码
+                LOG_WARN("Verify unavailable: %s", name.c_str());
+                done(VERIFY_UNAVAILABLE);
+                return sqlStatement();
             }
-            mysql_free_result(res);
-        }
-    } else {  // 注册逻辑
-        // 先查询用户名是否已存在
-        bool usernameExists = (res && mysql_num_rows(res) > 0);
-        mysql_free_result(res);
-        if (usernameExists) {
-            LOG_INFO("Username used!");
-            return false;
-        }
+            bool ok = (result == asyncSqlClient::QUERY_OK);
+            if(*inserting) { // INSERT 的结果，唯一键冲突同样算失败
+                LOG_INFO(ok ? "Register success!" : "Insert error!");
+                userFilter::getInstance()->add(name);
+                done(ok ? VERIFY_OK : VERIFY_FAIL);
+                return sqlStatement();
+            }
+            MYSQL_ROW row = (ok && res) ? mysql_fetch_row(res) : nullptr;
+            if(isLogin) {
+                bool correct = row && row[0] && passwd == row[0];
+                LOG_INFO(correct ? "Password Correct!" : "Password Error!");
+                done(correct ? VERIFY_OK : VERIFY_FAIL);
+                return sqlStatement();
+            }
+            if(ok) {
+                userFilter::getInstance()->reportLookup(row != nullptr);
+            }
+            if(!ok || row) {
+                LOG_INFO("Username used!");
+                done(VERIFY_FAIL);
+                return sqlStatement();
+            }
+            *inserting = true;
+            return insertStmt;
+        });
+}
 
-        // 用户名不存在，执行插入注册信息的操作
-        bzero(order, 256);
-        snprintf(order, 256,"INSERT INTO user(username, password) VALUES('%s','%s')", name.c_str(), passwd.c_str());
-        LOG_DEBUG( "SQL: %s", order);
+bool httpRequest::verifyCached_(const string& name, const string& passwd) {
+    if(name == "") {
+        return false;
+    }
+    credentialCache* cache = credentialCache::getInstance();
+    if(cache->checkSession(getCookie("sid"), name)) {
+        LOG_DEBUG("Session hit: %s", name.c_str());
+        return true;
+    }
+    if(passwd != "" && cache->verify(name, passwd)) {
+        LOG_DEBUG("Credential cache hit: %s", name.c_str());
+        sessionId_ = cache->createSession(name);
+        return true;
+    }
+    return false;
+}
 
-        if (mysql_query(sql, order)) {
-            LOG_DEBUG( "Insert error!");
-            return false;
-        }
+void httpRequest::onVerified_(const string& name, const string& passwd, bool isLogin) {
+    credentialCache* cache = credentialCache::getInstance();
+    if(isLogin) {
+        cache->put(name, passwd);
+        sessionId_ = cache->createSession(name);
+    } else { // 注册成功：该用户名之前的缓存条目（如有）一律作废
+        cache->invalidate(name);
+    }
+}
 
-        LOG_INFO("Register success!");
-        return true;
+void httpRequest::finishVerify(VERIFY_RESULT ret) {
+    verifyPending_ = false;
+    unavailable_ = (ret == VERIFY_UNAVAILABLE);
+    if(ret == VERIFY_OK) {
+        onVerified_(getPost("username"), getPost("passwd"), verifyIsLogin_);
     }
-    // sqlConnPool::getInstance()->freeConn(sql); 因为 sqlConnRAII 析构函数中调用了freeConn
-    return true;
+    path_ = (ret == VERIFY_OK) ? "/welcome.html" : "/error.html";
 }
 
 // 16进制单字符转10进制int
@@ -272,6 +337,32 @@ string httpRequest::getPost(const char* key) const{
     return "";
 }
 
+string httpRequest::getHeader(const string& key) const {
+    auto it = header_.find(key);
+    return it == header_.end() ? "" : it->second;
+}
+
+// Cookie: a=1; sid=xxx
+string httpRequest::getCookie(const string& key) const {
+    auto it = header_.find("Cookie");
+    if(it == header_.end()) {
+        return "";
+    }
+    const string& cookie = it->second;
+    size_t pos = 0;
+    while(pos < cookie.size()) {
+        size_t end = cookie.find(';', pos);
+        if(end == string::npos) { end = cookie.size(); }
+        while(pos < end && cookie[pos] == ' ') { pos++; }
+        size_t eq = cookie.find('=', pos);
+        if(eq != string::npos && eq < end && cookie.compare(pos, eq - pos, key) == 0) {
+            return cookie.substr(eq + 1, end - eq - 1);
+        }
+        pos = end + 1;
+    }
+    return "";
+}
+
 bool httpRequest::isKeepAlive() const{
     if(header_.count("Connection") == 1) {
         return header_.find("Connection")->second == "keep-alive" && version_ == "1.1";
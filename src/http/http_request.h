@@ -5,13 +5,21 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <regex> // 正则表达式
+#include <functional>
 #include <algorithm> // search
 #include <errno.h>
+#include <chrono>
 #include <mysql/mysql.h> // mysql
 
 #include "../buffer/buffer.h"
 #include "../log/log.h"
 #include "../pool/sqlconn_pool.h"
+#include "../pool/async_sqlconn.h"
+#include "../pool/user_filter.h"
+#include "../pool/user_store.h"
+#include "credential_cache.h"
+#include "rate_limiter.h"
+#include "../metrics/usdt.h"
 
 class httpRequest {
 public:
@@ -34,9 +42,28 @@ public:
     std::string version() const;
     std::string getPost(const std::string& key) const;
     std::string getPost(const char* key) const;
+    std::string getCookie(const std::string& key) const;
+    std::string getHeader(const std::string& key) const;   // 没有该字段时返回空串
+    const std::string& sessionId() const { return sessionId_; }    // 本次登录新签发的会话id，需要写入Set-Cookie
 
     bool isKeepAlive() const;
 
+    // 异步验证模式下，parsePost_ 只记录用户名密码，由事件循环中的asyncSqlClient完成查询后再恢复
+    bool isVerifyPending() const { return verifyPending_; }
+    bool isUnavailable() const { return unavailable_; }    // 数据库连接池借不到连接，应返回503
+    int64_t verifyUs() const { return verifyUs_; }          // 同步验证耗时（微秒），没有验证为-1
+    bool isRateLimited() const { return rateLimited_; }     // 登录/注册超过该地址的限额，未做验证，应返回429
+    void setClientAddr(uint32_t addr) { clientAddr_ = addr; }   // 连接建立时设置，init不清除
+    enum VERIFY_RESULT {
+        VERIFY_FAIL = 0,
+        VERIFY_OK,
+        VERIFY_UNAVAILABLE,     // 连接池超时或数据库不可用
+    };
+    void verifyAsync(asyncSqlClient* sql, const std::function<void(VERIFY_RESULT)>& done) const;
+    void finishVerify(VERIFY_RESULT ret);
+
+    static bool isAsyncVerify;
+
 private:
     bool parseRequestLine_(const std::string& line); // 处理请求行
     void parseHeader_(const std::string& header);    // 处理请求头部字段
@@ -45,12 +72,21 @@ private:
     void parsePath_();                               // 处理请求路径
     void parsePost_();                               // 处理Post事件
     void parseFromUrlEncoded_();                     // 从url解析编码
+    bool verifyCached_(const std::string& name, const std::string& passwd); // 会话或凭据缓存命中则跳过数据库
+    void onVerified_(const std::string& name, const std::string& passwd, bool isLogin); // 验证通过后更新缓存、签发会话
 
-    static bool userVerify_(const std::string& name, const std::string& passwd, bool isLogin); // 用户验证
+    static VERIFY_RESULT userVerify_(const std::string& name, const std::string& passwd, bool isLogin); // 用户验证
     static int convertHexToDecimal_(char ch); // 16进制转10进制
 
     PARSE_STATE state_;
+    bool verifyPending_;
+    bool unavailable_;
+    bool verifyIsLogin_;
+    bool rateLimited_;
+    uint32_t clientAddr_ = 0;   // 网络字节序，限速的键
+    int64_t verifyUs_;
     std::string method_, path_, version_, body_;
+    std::string sessionId_;
     std::unordered_map<std::string, std::string> header_;
     std::unordered_map<std::string, std::string> post_;
 
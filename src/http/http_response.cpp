@@ -1,48 +1,36 @@
+#define LOG_MODULE Log::MODULE_HTTP
 #include "http_response.h"
 
 using namespace std;
 
-const unordered_map<string, string> httpResponse::SUFFIX_TYPE = {
-    { ".html",  "text/html" },
-    { ".xml",   "text/xml" },
-    { ".xhtml", "application/xhtml+xml" },
-    { ".txt",   "text/plain" },
-    { ".rtf",   "application/rtf" },
-    { ".pdf",   "application/pdf" },
-    { ".word",  "application/nsword" },
-    { ".png",   "image/png" },
-    { ".gif",   "image/gif" },
-    { ".jpg",   "image/jpeg" },
-    { ".jpeg",  "image/jpeg" },
-    { ".au",    "audio/basic" },
-    { ".mpeg",  "video/mpeg" },
-    { ".mpg",   "video/mpeg" },
-    { ".avi",   "video/x-msvideo" },
-    { ".gz",    "application/x-gzip" },
-    { ".tar",   "application/x-tar" },
-    { ".css",   "text/css "},
-    { ".js",    "text/javascript "},
-};
-
 const unordered_map<int, string> httpResponse::CODE_STATUS = {
     { 200, "OK" },
+    { 304, "Not Modified" },
     { 400, "Bad Request" },
     { 403, "Forbidden" },
     { 404, "Not Found" },
+    { 429, "Too Many Requests" },
+    { 503, "Service Unavailable" },
 };
 
 const unordered_map<int, string> httpResponse::CODE_PATH = {
     { 400, "/400.html" },
     { 403, "/403.html" },
     { 404, "/404.html" },
+    { 503, "/503.html" },
 };
 
 httpResponse::httpResponse() {
     code_ = -1;
     path_ = srcDir_ = "";
     isKeepAlive_ = false;
+    hasContent_ = false;
     mmFile_ = nullptr; 
     mmFileStat_ = { 0 };
+    fromBundle_ = false;
+    fileOffset_ = 0;
+    bundleMime_ = nullptr;
+    acceptGzip_ = false;
 };
 
 httpResponse::~httpResponse() {
@@ -56,11 +44,51 @@ void httpResponse::init(const std::string& srcDir, std::string& path, bool isKee
     isKeepAlive_ = isKeepAlive;
     path_ = path;
     srcDir_ = srcDir;
+    hasContent_ = false;
+    content_.clear();
+    extraHeaders_.clear();
+    mmFile_ = nullptr;
+    mmFileStat_ = { 0 };
+    fileOffset_ = 0;
+    bundleMime_ = nullptr;
+    ifNoneMatch_.clear();
+    acceptGzip_ = false;
+}
+
+void httpResponse::initContent(int code, const std::string& contentType, const std::string& body, bool isKeepAlive) {
+    if(mmFile_) { unmapFile();}
+    code_ = code;
+    isKeepAlive_ = isKeepAlive;
+    hasContent_ = true;
+    content_ = body;
+    contentType_ = contentType;
+    extraHeaders_.clear();
+    path_.clear();
     mmFile_ = nullptr;
     mmFileStat_ = { 0 };
 }
 
+void httpResponse::addHeader(const std::string& key, const std::string& value) {
+    extraHeaders_ += key + ": " + value + "\r\n";
+}
+
+void httpResponse::setNegotiation(const std::string& ifNoneMatch, const std::string& acceptEncoding) {
+    ifNoneMatch_ = ifNoneMatch;
+    acceptGzip_ = acceptEncoding.find("gzip") != string::npos;
+}
+
 void httpResponse::makeResponse(Buffer& buff) {
+    if(hasContent_) { // 内存内容直接写入响应缓冲区，fileLen()为0
+        addStateLine_(buff);
+        addHeader_(buff);
+        buff.append("Content-length: " + to_string(content_.size()) + "\r\n\r\n");
+        buff.append(content_);
+        return;
+    }
+    if(resourceBundle::getInstance()->isOpen()) {
+        makeBundleResponse_(buff);
+        return;
+    }
     /* 判断请求的资源文件 */
     if(stat((srcDir_ + path_).data(), &mmFileStat_) < 0 || S_ISDIR(mmFileStat_.st_mode)) { // 如果路径对应的文件不存在或者对应的路径是目录
         code_ = 404; // 请求的资源未找到
@@ -81,9 +109,12 @@ char* httpResponse::file() {
 
 void httpResponse::unmapFile() {
     if(mmFile_) {
-        munmap(mmFile_, mmFileStat_.st_size);
+        if(!fromBundle_) {
+            munmap(mmFile_, mmFileStat_.st_size);
+        }
         mmFile_ = nullptr;
     }
+    fromBundle_ = false;
 }
 
 size_t httpResponse::fileLen() const{
@@ -126,7 +157,10 @@ void httpResponse::addHeader_(Buffer& buff) {
     } else {
         buff.append("close\r\n");
     }
-    buff.append("Content-type: " + getFileType_() + "\r\n");
+    buff.append("Content-type: " + (hasContent_ ? contentType_ : getFileType_()) + "\r\n");
+    if(!extraHeaders_.empty()) {
+        buff.append(extraHeaders_);
+    }
 }
 
 void httpResponse::addContent_(Buffer& buff) {
@@ -145,7 +179,56 @@ void httpResponse::addContent_(Buffer& buff) {
     }
     mmFile_ = (char*) mmRet;
     close(srcFd);
-    buff.append("Content-legth: " + to_string(mmFileStat_.st_size) + "\r\n\r\n");
+    buff.append("Content-length: " + to_string(mmFileStat_.st_size) + "\r\n\r\n");
+}
+
+void httpResponse::makeBundleResponse_(Buffer& buff) {
+    resourceBundle* bundle = resourceBundle::getInstance();
+    resourceBundle::file f;
+    bool found = bundle->find(path_, &f);
+    if(!found) {
+        code_ = 404;
+    } else if(!f.readable) {
+        code_ = 403;
+    } else if(code_ == -1) {
+        code_ = 200;
+    }
+    if(CODE_PATH.count(code_) == 1) { // 错误页同样从bundle取
+        path_ = CODE_PATH.find(code_)->second;
+        found = bundle->find(path_, &f) && f.readable;
+    }
+    if(!found) {
+        addStateLine_(buff);
+        addHeader_(buff);
+        errorContent(buff, "File NotFound!");
+        return;
+    }
+    bundleMime_ = f.mime;
+    bool gzip = acceptGzip_ && f.gzData;
+    string etag = "\"" + string(f.etag) + (gzip ? "-gz\"" : "\""); // 两种编码的内容不同，ETag也要区分
+    if(code_ == 200 && !ifNoneMatch_.empty() && (ifNoneMatch_ == "*" || ifNoneMatch_.find(etag) != string::npos)) {
+        code_ = 304;
+    }
+    addStateLine_(buff);
+    addHeader_(buff);
+    if(code_ == 200 || code_ == 304) {
+        buff.append("ETag: " + etag + "\r\n");
+    }
+    if(f.gzData) {
+        buff.append("Vary: Accept-Encoding\r\n");
+    }
+    if(code_ == 304) { // 没有响应体
+        buff.append("\r\n");
+        return;
+    }
+    if(gzip) {
+        buff.append("Content-Encoding: gzip\r\n");
+    }
+    mmFile_ = const_cast<char*>(gzip ? f.gzData : f.data);
+    mmFileStat_.st_size = gzip ? f.gzLen : f.len;
+    fileOffset_ = gzip ? f.gzOffset : f.offset;
+    fromBundle_ = true;
+    buff.append("Content-length: " + to_string(mmFileStat_.st_size) + "\r\n\r\n");
 }
 
 void httpResponse::errorHtml_() {
@@ -157,14 +240,5 @@ void httpResponse::errorHtml_() {
 
 // 判断 mmFile_ 文件类型
 string httpResponse::getFileType_() {
-    string::size_type idx = path_.find_last_of('.');
-    if(idx == string::npos) { // 最大值find函数再找不到指定值的情况下返回string::npos
-        return "text/plain";
-    }
-    string suffix = path_.substr(idx); // 截取文件名后缀
-    if(SUFFIX_TYPE.count(suffix) == 1) {
-        return SUFFIX_TYPE.find(suffix)->second;
-    }
-    return "text/plain";
-
+    return bundleMime_ ? bundleMime_ : resourceBundle::mimeType(path_);
 }
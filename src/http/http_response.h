@@ -9,6 +9,7 @@
 
 #include "../buffer/buffer.h"
 #include "../log/log.h"
+#include "resource_bundle.h"
 
 class httpResponse {
 public:
@@ -16,17 +17,26 @@ public:
     ~httpResponse();
 
     void init(const std::string& srcDir, std::string& path, bool isKeepAlive = false, int code = -1);
+    // 直接以内存中的内容作为响应体（探针、状态接口等），不读取文件
+    void initContent(int code, const std::string& contentType, const std::string& body, bool isKeepAlive = false);
+    void addHeader(const std::string& key, const std::string& value); // 附加响应头，init后调用
+    // 请求的 If-None-Match / Accept-Encoding，init后调用；只对bundle中的资源生效（ETag、gzip预压缩版本）
+    void setNegotiation(const std::string& ifNoneMatch, const std::string& acceptEncoding);
     void makeResponse(Buffer& buff);
     char* file();
     void unmapFile();
     
     size_t fileLen() const;
+    // 响应体所在的文件（错误码时为对应的错误页）及响应体在其中的偏移，冷页预读时用
+    std::string filePath() const { return fromBundle_ ? resourceBundle::getInstance()->path() : srcDir_ + path_; }
+    size_t fileOffset() const { return fileOffset_; }
     void errorContent(Buffer& buff, std::string message);
     int code() const { return code_; };
 private:
     void addStateLine_(Buffer& buff);
     void addHeader_(Buffer& buff);
     void addContent_(Buffer& buff);
+    void makeBundleResponse_(Buffer& buff);    // 从bundle取资源，不访问文件系统
 
     void errorHtml_();
     std::string getFileType_();
@@ -36,11 +46,19 @@ private:
 
     std::string path_;
     std::string srcDir_;
+    bool hasContent_;
+    std::string content_;
+    std::string contentType_;
+    std::string extraHeaders_;
 
     char* mmFile_;
     struct stat mmFileStat_;
+    bool fromBundle_;           // mmFile_指向bundle的映射区，不需要munmap
+    size_t fileOffset_;
+    const char* bundleMime_;
+    std::string ifNoneMatch_;
+    bool acceptGzip_;
 
-    static const std::unordered_map<std::string, std::string> SUFFIX_TYPE;  // 后缀类型集
     static const std::unordered_map<int, std::string> CODE_STATUS;          // 编码状态集
     static const std::unordered_map<int, std::string> CODE_PATH;            // 编码路径集
 };
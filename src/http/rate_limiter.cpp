@@ -0,0 +1,213 @@
+#include "rate_limiter.h"
+#include <algorithm>
+
+rateLimiter::rateLimiter() : open_(false), perShard_(0) {
+    for(int k = 0; k < KIND_NUM; k++) {
+        rate_[k].store(0, std::memory_order_relaxed);
+        burst_[k].store(0, std::memory_order_relaxed);
+    }
+}
+
+// 懒汉模式 局部静态变量法
+rateLimiter* rateLimiter::getInstance() {
+    static rateLimiter inst;
+    return &inst;
+}
+
+const char* rateLimiter::kindName(KIND kind) {
+    static const char* NAMES[KIND_NUM] = {"conn", "req", "auth"};
+    return NAMES[kind];
+}
+
+void rateLimiter::init(size_t maxClients) {
+    perShard_ = std::max<size_t>(16, maxClients / SHARD_NUM);
+    size_t buckets = 1;
+    while(buckets < perShard_) { buckets <<= 1; } // 桶数取2的幂，平均链长不超过1
+    for(shard& s : shards_) {
+        std::lock_guard<std::mutex> locker(s.mtx);
+        s.entries.assign(perShard_, entry());
+        s.heads.assign(buckets, -1);
+        s.used = 0;
+        s.lruHead = s.lruTail = -1;
+        std::fill(s.allowed, s.allowed + KIND_NUM, 0);
+        std::fill(s.limited, s.limited + KIND_NUM, 0);
+        s.evictions = 0;
+    }
+    open_.store(true, std::memory_order_release);
+}
+
+void rateLimiter::setLimit(KIND kind, double rate, double burst) {
+    rate = std::max(0.0, rate);
+    if(burst <= 0) {
+        burst = std::max(1.0, rate * 2);
+    }
+    // 关闭期间已有条目的该种令牌停留在旧容量（可能为0），开启时补满，否则开启后每个已知地址都先被拒绝。
+    // 先按旧限额把所有种类补到当前时刻再改该种，lastUs是各种共用的，不能让其他种类丢掉已流逝的时间
+    bool enabling = rate > 0 && rate_[kind].load(std::memory_order_relaxed) <= 0;
+    if(open_.load(std::memory_order_acquire)) {
+        int64_t nowUs = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        for(shard& s : shards_) {
+            std::lock_guard<std::mutex> locker(s.mtx);
+            for(int32_t i = 0; i < s.used; i++) {
+                entry& e = s.entries[i];
+                int64_t elapsed = std::max<int64_t>(0, nowUs - e.lastUs);
+                for(int k = 0; k < KIND_NUM; k++) {
+                    double cap = burst_[k].load(std::memory_order_relaxed);
+                    e.tokens[k] = std::min(cap, e.tokens[k] + elapsed * rate_[k].load(std::memory_order_relaxed) / 1e6);
+                }
+                e.tokens[kind] = enabling ? burst : std::min(burst, e.tokens[kind]);
+                e.lastUs = nowUs;
+            }
+        }
+    }
+    burst_[kind].store(burst, std::memory_order_relaxed);
+    rate_[kind].store(rate, std::memory_order_relaxed);
+}
+
+double rateLimiter::rate(KIND kind) {
+    return rate_[kind].load(std::memory_order_relaxed);
+}
+
+double rateLimiter::burst(KIND kind) {
+    return burst_[kind].load(std::memory_order_relaxed);
+}
+
+uint32_t rateLimiter::hash_(uint32_t addr) {
+    // murmur3的fmix32：每一位输入都影响每一位输出。只做乘法的话低位只取决于输入的低位，
+    // 而s_addr的低位是地址的第一段，同一网段的地址会全部落在同一个桶里
+    addr ^= addr >> 16;
+    addr *= 0x85ebca6bu;
+    addr ^= addr >> 13;
+    addr *= 0xc2b2ae35u;
+    addr ^= addr >> 16;
+    return addr;   // 高6位选分片，低位选桶
+}
+
+bool rateLimiter::allow(uint32_t addr, KIND kind) {
+    if(!open_.load(std::memory_order_acquire) || rate_[kind].load(std::memory_order_relaxed) <= 0) {
+        return true;
+    }
+    int64_t nowUs = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    uint32_t h = hash_(addr);
+    shard& s = shards_[h >> 26];
+    uint32_t bucket = h & static_cast<uint32_t>(s.heads.size() - 1);
+
+    std::lock_guard<std::mutex> locker(s.mtx);
+    int32_t idx = find_(s, addr, bucket);
+    if(idx < 0) {
+        idx = insert_(s, addr, bucket, nowUs);
+    } else {
+        touch_(s, idx);
+    }
+    entry& e = s.entries[idx];
+    int64_t elapsed = nowUs - e.lastUs;
+    if(elapsed > 0) { // 惰性补充：所有种类一起按流逝时间补，上限为桶容量
+        for(int k = 0; k < KIND_NUM; k++) {
+            double cap = burst_[k].load(std::memory_order_relaxed);
+            e.tokens[k] = std::min(cap, e.tokens[k] + elapsed * rate_[k].load(std::memory_order_relaxed) / 1e6);
+        }
+        e.lastUs = nowUs;
+    }
+    if(e.tokens[kind] >= 1.0) {
+        e.tokens[kind] -= 1.0;
+        s.allowed[kind]++;
+        return true;
+    }
+    s.limited[kind]++;
+    return false;
+}
+
+int32_t rateLimiter::find_(shard& s, uint32_t addr, uint32_t bucket) {
+    for(int32_t i = s.heads[bucket]; i >= 0; i = s.entries[i].next) {
+        if(s.entries[i].addr == addr) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int32_t rateLimiter::insert_(shard& s, uint32_t addr, uint32_t bucket, int64_t nowUs) {
+    int32_t idx;
+    if(s.used < static_cast<int32_t>(perShard_)) {
+        idx = s.used++;
+    } else { // 分片已满，复用最久未访问的条目
+        idx = s.lruTail;
+        unlinkHash_(s, idx);
+        s.lruTail = s.entries[idx].prev;
+        if(s.lruTail >= 0) {
+            s.entries[s.lruTail].lruNext = -1;
+        } else {
+            s.lruHead = -1;
+        }
+        s.evictions++;
+    }
+    entry& e = s.entries[idx];
+    e.addr = addr;
+    e.lastUs = nowUs;
+    for(int k = 0; k < KIND_NUM; k++) {
+        e.tokens[k] = burst_[k].load(std::memory_order_relaxed); // 新客户端满桶
+    }
+    e.next = s.heads[bucket];
+    s.heads[bucket] = idx;
+    e.prev = -1;
+    e.lruNext = s.lruHead;
+    if(s.lruHead >= 0) {
+        s.entries[s.lruHead].prev = idx;
+    }
+    s.lruHead = idx;
+    if(s.lruTail < 0) {
+        s.lruTail = idx;
+    }
+    return idx;
+}
+
+void rateLimiter::unlinkHash_(shard& s, int32_t idx) {
+    uint32_t bucket = hash_(s.entries[idx].addr) & static_cast<uint32_t>(s.heads.size() - 1);
+    int32_t* link = &s.heads[bucket];
+    while(*link >= 0 && *link != idx) {
+        link = &s.entries[*link].next;
+    }
+    if(*link == idx) {
+        *link = s.entries[idx].next;
+    }
+}
+
+void rateLimiter::touch_(shard& s, int32_t idx) {
+    if(s.lruHead == idx) {
+        return;
+    }
+    entry& e = s.entries[idx];
+    // 从原位置摘下（idx不是表头，prev一定存在）
+    s.entries[e.prev].lruNext = e.lruNext;
+    if(e.lruNext >= 0) {
+        s.entries[e.lruNext].prev = e.prev;
+    } else {
+        s.lruTail = e.prev;
+    }
+    e.prev = -1;
+    e.lruNext = s.lruHead;
+    s.entries[s.lruHead].prev = idx;
+    s.lruHead = idx;
+}
+
+rateLimiterStats rateLimiter::getStats() {
+    rateLimiterStats stats = {};
+    for(shard& s : shards_) {
+        std::lock_guard<std::mutex> locker(s.mtx);
+        for(int k = 0; k < KIND_NUM; k++) {
+            stats.allowed[k] += s.allowed[k];
+            stats.limited[k] += s.limited[k];
+        }
+        stats.evictions += s.evictions;
+        stats.clients += s.used;
+        for(int32_t head : s.heads) {
+            size_t len = 0;
+            for(int32_t i = head; i >= 0; i = s.entries[i].next) { len++; }
+            stats.maxChain = std::max(stats.maxChain, len);
+        }
+    }
+    stats.capacity = perShard_ * SHARD_NUM;
+    return stats;
+}
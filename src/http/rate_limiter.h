@@ -0,0 +1,88 @@
+#ifndef RATE_LIMITER_H
+#define RATE_LIMITER_H
+
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <stdint.h>
+
+struct rateLimiterStats {
+    uint64_t allowed[3];        // 按rateLimiter::KIND
+    uint64_t limited[3];
+    uint64_t evictions;         // 表满时淘汰的最久未访问条目
+    size_t clients;             // 当前跟踪的客户端地址数
+    size_t capacity;
+    size_t maxChain;            // 最长的哈希链，分布均匀时应为个位数
+};
+
+// 按客户端IPv4地址限速：每个地址三个令牌桶（新建连接、请求、登录/注册POST），速率为0的种类不限。
+// - 固定大小的表，按地址哈希分片，每个分片一把锁、一个预分配的条目数组，检查路径上不分配内存
+// - 令牌在访问时按流逝时间惰性补充，没有后台线程
+// - 分片满时淘汰最久未访问的条目（分片内LRU链表）；长时间没访问的条目令牌早已补满，淘汰后重建等价
+// 一次检查是一次哈希、一次加锁和几次浮点运算，远低于一微秒，可以在每个请求上调用
+class rateLimiter {
+public:
+    enum KIND {
+        CONNECT = 0,    // 新建连接（accept后）
+        REQUEST,        // 请求（每次解析前）
+        AUTH,           // POST /login.html、/register.html
+        KIND_NUM,
+    };
+
+    static rateLimiter* getInstance();
+
+    // rate为每秒令牌数（0不限），burst为桶容量（<=0时取2秒的量且至少为1）；maxClients为跟踪的地址数上限
+    void init(size_t maxClients = 65536);
+    void setLimit(KIND kind, double rate, double burst = 0);    // 运行中开启某种限速时，已跟踪地址的该种令牌补满
+    double rate(KIND kind);
+    double burst(KIND kind);
+    bool isOpen() const { return open_.load(std::memory_order_acquire); }
+
+    bool allow(uint32_t addr, KIND kind);   // addr为网络字节序（sockaddr_in.sin_addr.s_addr）
+    rateLimiterStats getStats();
+
+    static const char* kindName(KIND kind);
+
+private:
+    static const int SHARD_NUM = 64;
+
+    struct entry {
+        uint32_t addr;
+        int32_t next;               // 哈希链
+        int32_t prev;               // LRU链，表头为最近访问
+        int32_t lruNext;
+        int64_t lastUs;             // 上次补充令牌的时刻
+        double tokens[KIND_NUM];
+    };
+    struct alignas(64) shard {
+        std::mutex mtx;
+        std::vector<entry> entries;
+        std::vector<int32_t> heads;     // 哈希桶 -> 条目下标，-1为空
+        int32_t used;                   // 已使用的条目数（只增不减，满后靠淘汰复用）
+        int32_t lruHead;
+        int32_t lruTail;
+        uint64_t allowed[KIND_NUM];
+        uint64_t limited[KIND_NUM];
+        uint64_t evictions;
+    };
+
+    rateLimiter();
+    ~rateLimiter() = default;
+
+    static uint32_t hash_(uint32_t addr);
+    int32_t find_(shard& s, uint32_t addr, uint32_t bucket);
+    int32_t insert_(shard& s, uint32_t addr, uint32_t bucket, int64_t nowUs);
+    void unlinkHash_(shard& s, int32_t idx);
+    void touch_(shard& s, int32_t idx);
+
+    std::atomic<bool> open_;    // init完成后置位，之前allow一律放行
+    size_t perShard_;
+    shard shards_[SHARD_NUM];
+    // 限额可由管理接口运行中修改，检查路径上relaxed读取
+    std::atomic<double> rate_[KIND_NUM];
+    std::atomic<double> burst_[KIND_NUM];
+};
+
+#endif
@@ -0,0 +1,387 @@
+#include "resource_bundle.h"
+#include <map>
+#include <algorithm>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <dirent.h>
+#include <zlib.h>
+
+const uint32_t resourceBundle::VERSION;
+const size_t resourceBundle::DATA_ALIGN;
+const size_t resourceBundle::SMALL_ALIGN;
+
+const std::unordered_map<std::string, std::string> resourceBundle::SUFFIX_TYPE = {
+    { ".html",  "text/html" },
+    { ".xml",   "text/xml" },
+    { ".xhtml", "application/xhtml+xml" },
+    { ".txt",   "text/plain" },
+    { ".rtf",   "application/rtf" },
+    { ".pdf",   "application/pdf" },
+    { ".word",  "application/nsword" },
+    { ".png",   "image/png" },
+    { ".gif",   "image/gif" },
+    { ".jpg",   "image/jpeg" },
+    { ".jpeg",  "image/jpeg" },
+    { ".au",    "audio/basic" },
+    { ".mpeg",  "video/mpeg" },
+    { ".mpg",   "video/mpeg" },
+    { ".avi",   "video/x-msvideo" },
+    { ".gz",    "application/x-gzip" },
+    { ".tar",   "application/x-tar" },
+    { ".css",   "text/css "},
+    { ".js",    "text/javascript "},
+};
+
+static const char BUNDLE_MAGIC[8] = {'R', 'W', 'S', 'B', 'N', 'D', 'L', '\0'};
+
+resourceBundle::resourceBundle()
+    : base_(nullptr), size_(0), count_(0), populated_(false), entries_(nullptr), strings_(nullptr) {}
+
+resourceBundle::~resourceBundle() {
+    close();
+}
+
+// 懒汉模式 局部静态变量法
+resourceBundle* resourceBundle::getInstance() {
+    static resourceBundle inst;
+    return &inst;
+}
+
+std::string resourceBundle::mimeType(const std::string& path) {
+    std::string::size_type idx = path.find_last_of('.');
+    if(idx == std::string::npos) {
+        return "text/plain";
+    }
+    auto it = SUFFIX_TYPE.find(path.substr(idx)); // 按文件名后缀查找
+    return it != SUFFIX_TYPE.end() ? it->second : "text/plain";
+}
+
+bool resourceBundle::open(const char* path, bool populate) {
+    close();
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if(fstat(fd, &st) < 0 || st.st_size < static_cast<off_t>(sizeof(header))) {
+        ::close(fd);
+        return false;
+    }
+    // 只读共享映射：和页缓存共用物理页，多个worker进程打开同一个bundle也只有一份
+    void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED | (populate ? MAP_POPULATE : 0), fd, 0);
+    ::close(fd);
+    if(addr == MAP_FAILED) {
+        return false;
+    }
+    base_ = static_cast<char*>(addr);
+    size_ = st.st_size;
+    if(!validate_()) {
+        close();
+        errno = EINVAL;
+        return false;
+    }
+    const header* h = reinterpret_cast<const header*>(base_);
+    count_ = h->count;
+    entries_ = reinterpret_cast<const entry*>(base_ + sizeof(header));
+    strings_ = base_ + h->stringsOffset;
+    populated_ = populate;
+    path_ = path;
+    return true;
+}
+
+void resourceBundle::close() {
+    if(base_) {
+        munmap(base_, size_);
+    }
+    base_ = nullptr;
+    size_ = count_ = 0;
+    entries_ = nullptr;
+    strings_ = nullptr;
+    populated_ = false;
+    path_.clear();
+}
+
+bool resourceBundle::validate_() const {
+    // 打开时把所有偏移检查一遍，查找路径上不再做边界检查
+    const header* h = reinterpret_cast<const header*>(base_);
+    if(memcmp(h->magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC)) != 0 || h->version != VERSION || h->totalSize != size_) {
+        return false;
+    }
+    uint64_t entriesEnd = sizeof(header) + static_cast<uint64_t>(h->count) * sizeof(entry);
+    if(entriesEnd > h->stringsOffset || h->stringsOffset > h->dataOffset || h->dataOffset > size_) {
+        return false;
+    }
+    const entry* entries = reinterpret_cast<const entry*>(base_ + sizeof(header));
+    const char* strings = base_ + h->stringsOffset;
+    uint64_t stringsLen = h->dataOffset - h->stringsOffset;
+    auto inString = [&](uint64_t off, uint64_t len) {
+        return off + len < stringsLen && strings[off + len] == '\0';
+    };
+    auto inData = [&](uint64_t off, uint64_t len) {
+        return off >= h->dataOffset && off <= size_ && len <= size_ - off;
+    };
+    for(uint32_t i = 0; i < h->count; i++) {
+        const entry& e = entries[i];
+        if(!inString(e.pathOff, e.pathLen) || e.mimeOff >= stringsLen ||
+           !memchr(strings + e.mimeOff, '\0', stringsLen - e.mimeOff) ||
+           !inData(e.dataOff, e.dataLen) || (e.gzLen && !inData(e.gzOff, e.gzLen)) ||
+           !memchr(e.etag, '\0', sizeof(e.etag))) {
+            return false;
+        }
+        if(i > 0) { // 二分查找依赖路径有序
+            const entry& p = entries[i - 1];
+            int cmp = memcmp(strings + p.pathOff, strings + e.pathOff, std::min(p.pathLen, e.pathLen));
+            if(cmp > 0 || (cmp == 0 && p.pathLen >= e.pathLen)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+size_t resourceBundle::residentBytes() const {
+    if(!base_) {
+        return 0;
+    }
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    std::vector<unsigned char> vec((size_ + pageSize - 1) / pageSize);
+    if(mincore(base_, size_, vec.data()) < 0) {
+        return 0;
+    }
+    return std::count_if(vec.begin(), vec.end(), [](unsigned char v) { return v & 1; }) * pageSize;
+}
+
+const char* resourceBundle::string_(uint32_t off) const {
+    return strings_ + off;
+}
+
+bool resourceBundle::find(const std::string& path, file* out) const {
+    if(!base_) {
+        return false;
+    }
+    size_t lo = 0, hi = count_;
+    while(lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        const entry& e = entries_[mid];
+        int cmp = memcmp(string_(e.pathOff), path.data(), std::min<size_t>(e.pathLen, path.size()));
+        if(cmp == 0) {
+            if(e.pathLen == path.size()) {
+                out->data = base_ + e.dataOff;
+                out->len = e.dataLen;
+                out->offset = e.dataOff;
+                out->gzData = e.gzLen ? base_ + e.gzOff : nullptr;
+                out->gzLen = e.gzLen;
+                out->gzOffset = e.gzOff;
+                out->mime = string_(e.mimeOff);
+                out->etag = e.etag;
+                out->readable = e.flags & FLAG_READABLE;
+                return true;
+            }
+            cmp = e.pathLen < path.size() ? -1 : 1;
+        }
+        if(cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return false;
+}
+
+namespace {
+
+struct packedFile {
+    std::string path;       // 以'/'开头，相对srcDir
+    std::string data;
+    std::string gz;
+    std::string mime;
+    std::string etag;
+    bool readable;
+};
+
+bool readFile(const std::string& name, std::string* out) {
+    FILE* fp = fopen(name.c_str(), "rb");
+    if(!fp) {
+        return false;
+    }
+    char buf[64 * 1024];
+    size_t n;
+    out->clear();
+    while((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        out->append(buf, n);
+    }
+    bool ok = !ferror(fp);
+    fclose(fp);
+    return ok;
+}
+
+bool walk(const std::string& dir, const std::string& rel, std::vector<packedFile>* files, std::string* err) {
+    DIR* d = opendir(dir.c_str());
+    if(!d) {
+        *err = "opendir " + dir + ": " + strerror(errno);
+        return false;
+    }
+    bool ok = true;
+    while(struct dirent* ent = readdir(d)) {
+        std::string name = ent->d_name;
+        if(name == "." || name == "..") {
+            continue;
+        }
+        std::string full = dir + "/" + name;
+        struct stat st;
+        if(stat(full.c_str(), &st) < 0) { // 跟随符号链接，与运行时按路径访问的行为一致
+            continue;
+        }
+        if(S_ISDIR(st.st_mode)) {
+            ok = walk(full, rel + "/" + name, files, err);
+        } else if(S_ISREG(st.st_mode)) {
+            packedFile f;
+            f.path = rel + "/" + name;
+            f.readable = st.st_mode & S_IROTH;
+            if(f.readable && !readFile(full, &f.data)) {
+                *err = "read " + full + ": " + strerror(errno);
+                ok = false;
+            }
+            files->push_back(std::move(f));
+        }
+        if(!ok) {
+            break;
+        }
+    }
+    closedir(d);
+    return ok;
+}
+
+bool gzipCompress(const std::string& in, std::string* out) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if(deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) { // +16: gzip封装
+        return false;
+    }
+    out->resize(deflateBound(&zs, in.size()));
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+    zs.avail_in = in.size();
+    zs.next_out = reinterpret_cast<Bytef*>(&(*out)[0]);
+    zs.avail_out = out->size();
+    int ret = deflate(&zs, Z_FINISH);
+    out->resize(zs.total_out);
+    deflateEnd(&zs);
+    return ret == Z_STREAM_END;
+}
+
+std::string contentTag(const std::string& data) {
+    uint64_t h = 1469598103934665603ULL; // FNV-1a 64
+    for(unsigned char ch : data) {
+        h ^= ch;
+        h *= 1099511628211ULL;
+    }
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(h));
+    return buf;
+}
+
+size_t alignUp(size_t n, size_t align) {
+    return (n + align - 1) / align * align;
+}
+
+} // namespace
+
+bool resourceBundle::pack(const std::string& srcDir, const std::string& outPath, bool gzip, std::string* err) {
+    std::vector<packedFile> files;
+    if(!walk(srcDir, "", &files, err)) {
+        return false;
+    }
+    std::sort(files.begin(), files.end(), [](const packedFile& a, const packedFile& b) { return a.path < b.path; });
+    for(packedFile& f : files) {
+        f.mime = mimeType(f.path);
+        f.etag = contentTag(f.data);
+        // 只预压缩文本类资源，图片、压缩包本身已压缩过
+        bool text = f.mime.compare(0, 5, "text/") == 0 || f.mime.find("xml") != std::string::npos;
+        if(gzip && text && f.data.size() >= 256) {
+            if(!gzipCompress(f.data, &f.gz) || f.gz.size() >= f.data.size() / 10 * 9) {
+                f.gz.clear();
+            }
+        }
+    }
+
+    // 字符串区：路径逐个存放，MIME类型去重
+    std::string strings;
+    std::map<std::string, uint32_t> mimeOff;
+    std::vector<entry> entries(files.size());
+    for(size_t i = 0; i < files.size(); i++) {
+        entries[i] = entry();
+        entries[i].pathOff = strings.size();
+        entries[i].pathLen = files[i].path.size();
+        strings.append(files[i].path).push_back('\0');
+        auto it = mimeOff.find(files[i].mime);
+        if(it == mimeOff.end()) {
+            it = mimeOff.emplace(files[i].mime, strings.size()).first;
+            strings.append(files[i].mime).push_back('\0');
+        }
+        entries[i].mimeOff = it->second;
+        entries[i].flags = files[i].readable ? FLAG_READABLE : 0;
+        snprintf(entries[i].etag, sizeof(entries[i].etag), "%s", files[i].etag.c_str());
+    }
+
+    header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC));
+    h.version = VERSION;
+    h.count = files.size();
+    h.stringsOffset = sizeof(header) + entries.size() * sizeof(entry);
+    h.dataOffset = alignUp(h.stringsOffset + strings.size(), DATA_ALIGN);
+    // 数据区：不小于一页的文件按页对齐，便于按页检查驻留和预读；小文件按缓存行对齐紧凑存放
+    uint64_t off = h.dataOffset;
+    auto place = [&](size_t len) {
+        off = alignUp(off, len >= DATA_ALIGN ? DATA_ALIGN : SMALL_ALIGN);
+        uint64_t at = off;
+        off += len;
+        return at;
+    };
+    for(size_t i = 0; i < files.size(); i++) {
+        entries[i].dataOff = place(files[i].data.size());
+        entries[i].dataLen = files[i].data.size();
+        if(!files[i].gz.empty()) {
+            entries[i].gzOff = place(files[i].gz.size());
+            entries[i].gzLen = files[i].gz.size();
+        }
+    }
+    h.totalSize = off;
+
+    // 先写临时文件再rename，运行中的进程映射的旧文件不受影响
+    std::string tmp = outPath + ".tmp";
+    FILE* fp = fopen(tmp.c_str(), "wb");
+    if(!fp) {
+        *err = "open " + tmp + ": " + strerror(errno);
+        return false;
+    }
+    uint64_t pos = 0;
+    auto put = [&](const void* p, size_t len, uint64_t at) {
+        static const char zeros[DATA_ALIGN] = {0};
+        while(pos < at) { // 对齐填充
+            size_t n = std::min<uint64_t>(at - pos, sizeof(zeros));
+            fwrite(zeros, 1, n, fp);
+            pos += n;
+        }
+        fwrite(p, 1, len, fp);
+        pos += len;
+    };
+    put(&h, sizeof(h), 0);
+    put(entries.data(), entries.size() * sizeof(entry), pos);
+    put(strings.data(), strings.size(), pos);
+    for(size_t i = 0; i < files.size(); i++) {
+        put(files[i].data.data(), files[i].data.size(), entries[i].dataOff);
+        if(entries[i].gzLen) {
+            put(files[i].gz.data(), files[i].gz.size(), entries[i].gzOff);
+        }
+    }
+    bool ok = !ferror(fp);
+    ok = (fclose(fp) == 0) && ok;
+    if(!ok || rename(tmp.c_str(), outPath.c_str()) < 0) {
+        *err = "write " + outPath + ": " + strerror(errno);
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,95 @@
+#ifndef RESOURCE_BUNDLE_H
+#define RESOURCE_BUNDLE_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+#include <fcntl.h>          // open
+#include <unistd.h>         // close
+#include <sys/stat.h>       // fstat
+#include <sys/mman.h>       // mmap, munmap
+
+// 打包后的静态资源：构建时由 respack（tools/resource_packer.cpp）把 resources/ 打成一个文件，
+// 运行时整体mmap一次，请求按路径在排好序的索引里二分查找，不再有 stat/open/mmap/munmap 系统调用。
+// 文件布局（主机字节序，构建和运行在同一架构上）：
+//   header | entry[count]（按路径排序）| 字符串区（路径、MIME类型）| 数据区（4K对齐）
+// 每个条目带预先算好的MIME类型、ETag，以及可选的gzip预压缩版本；不小于一页的文件按页对齐，
+// 小文件紧凑存放。打开后只读，可以被多个线程并发查找
+class resourceBundle {
+public:
+    // 查找结果，指针指向映射区，bundle打开期间有效
+    struct file {
+        const char* data;
+        size_t len;
+        size_t offset;      // data在bundle文件中的偏移，预读时用
+        const char* gzData; // gzip预压缩版本，没有时为nullptr
+        size_t gzLen;
+        size_t gzOffset;
+        const char* mime;
+        const char* etag;   // 内容哈希（16位十六进制），不带引号
+        bool readable;      // 打包时源文件对其他用户可读，否则应返回403
+    };
+
+    static resourceBundle* getInstance();
+
+    bool open(const char* path, bool populate = false);    // populate时MAP_POPULATE预先建立全部映射
+    void close();
+    bool isOpen() const { return base_ != nullptr; }
+    bool find(const std::string& path, file* out) const;    // path以'/'开头，如 "/index.html"
+
+    const std::string& path() const { return path_; }
+    size_t fileCount() const { return count_; }
+    size_t size() const { return size_; }
+    bool populated() const { return populated_; }
+    size_t residentBytes() const;  // 映射中当前在页缓存里的字节数（mincore），管理接口用
+
+    static std::string mimeType(const std::string& path);  // 按后缀取Content-type，服务器和打包工具共用
+    // 把srcDir下的所有普通文件打包到outPath；gzip版本只在能压缩到原大小90%以下时保留
+    static bool pack(const std::string& srcDir, const std::string& outPath, bool gzip, std::string* err);
+
+private:
+    static const uint32_t VERSION = 1;
+    static const size_t DATA_ALIGN = 4096;
+    static const size_t SMALL_ALIGN = 64;
+    static const std::unordered_map<std::string, std::string> SUFFIX_TYPE;  // 后缀类型集
+
+    struct header {
+        char magic[8];          // "RWSBNDL\0"
+        uint32_t version;
+        uint32_t count;
+        uint64_t stringsOffset;
+        uint64_t dataOffset;
+        uint64_t totalSize;
+    };
+    struct entry {
+        uint32_t pathOff;       // 相对字符串区
+        uint32_t pathLen;
+        uint32_t mimeOff;
+        uint32_t flags;
+        uint64_t dataOff;       // 相对文件开头
+        uint64_t dataLen;
+        uint64_t gzOff;
+        uint64_t gzLen;         // 0表示没有预压缩版本
+        char etag[24];          // 以'\0'结尾
+    };
+    enum FLAG {
+        FLAG_READABLE = 1,
+    };
+
+    resourceBundle();
+    ~resourceBundle();
+
+    bool validate_() const;
+    const char* string_(uint32_t off) const;
+
+    std::string path_;
+    char* base_;
+    size_t size_;
+    size_t count_;
+    bool populated_;
+    const entry* entries_;
+    const char* strings_;
+};
+
+#endif
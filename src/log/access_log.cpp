@@ -0,0 +1,204 @@
+#include "access_log.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <algorithm>
+#include <arpa/inet.h>      // inet_ntop
+
+accessLog::accessLog() {
+    fd_ = -1;
+    sampleRate_ = 1;
+    errorSampleRate_ = 1;
+    batchSize_ = 256;
+    flushIntervalMS_ = 1000;
+    isOpen_ = false;
+    written_ = 0;
+    isClose_ = true;
+}
+
+accessLog::~accessLog() {
+    close();
+}
+
+// 懒汉模式 局部静态变量法
+accessLog* accessLog::getInstance() {
+    static accessLog log;
+    return &log;
+}
+
+bool accessLog::init(const char* fileName, int sampleRate, int errorSampleRate,
+                     size_t batchSize, int flushIntervalMS) {
+    assert(fileName && batchSize > 0 && flushIntervalMS > 0);
+    close();
+    std::string dir(fileName);
+    size_t slash = dir.find_last_of('/');
+    if(slash != std::string::npos) {
+        mkdir(dir.substr(0, slash).c_str(), 0777);
+    }
+    fd_ = open(fileName, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if(fd_ < 0) {
+        return false;
+    }
+    sampleRate_ = sampleRate > 0 ? sampleRate : 1;
+    errorSampleRate_ = errorSampleRate > 0 ? errorSampleRate : 1;
+    flushIntervalMS_ = flushIntervalMS;
+    std::vector<threadBuffer*> buffers;
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        batchSize_ = batchSize;
+        free_.clear();
+        full_.clear();
+        for(auto& tb : buffers_) {
+            buffers.push_back(tb.get());
+        }
+        isClose_ = false;
+    }
+    for(threadBuffer* tb : buffers) { // 已注册线程的批次按新的大小重新分配
+        std::lock_guard<std::mutex> tbLocker(tb->mtx);
+        tb->records.assign(batchSize, accessRecord());
+        tb->count = 0;
+    }
+    writeThread_.reset(new std::thread(&accessLog::asyncWrite_, this));
+    isOpen_ = true;
+    return true;
+}
+
+void accessLog::close() {
+    if(!isOpen_.exchange(false)) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        isClose_ = true;
+    }
+    cond_.notify_all();
+    writeThread_->join(); // 写线程退出前会把各线程未满的批次也写出
+    writeThread_.reset();
+    ::close(fd_);
+    fd_ = -1;
+}
+
+bool accessLog::shouldSample(int status) {
+    static thread_local uint32_t okCount = 0;
+    static thread_local uint32_t errCount = 0;
+    if(status >= 400) {
+        return errorSampleRate_ == 1 || (errCount++ % errorSampleRate_) == 0;
+    }
+    return sampleRate_ == 1 || (okCount++ % sampleRate_) == 0;
+}
+
+// 每个线程第一次记录时注册一个缓冲区，之后直接使用线程本地指针
+accessLog::threadBuffer* accessLog::localBuffer_() {
+    static thread_local threadBuffer* local = nullptr;
+    if(!local) {
+        std::unique_ptr<threadBuffer> tb(new threadBuffer());
+        std::lock_guard<std::mutex> locker(mtx_);
+        tb->records.assign(batchSize_, accessRecord());
+        tb->count = 0;
+        local = tb.get();
+        buffers_.push_back(std::move(tb));
+    }
+    return local;
+}
+
+void accessLog::record(const accessRecord& rec) {
+    if(!isOpen()) { return; }
+    threadBuffer* tb = localBuffer_();
+    std::lock_guard<std::mutex> locker(tb->mtx); // 除了定时刷新外无人竞争
+    tb->records[tb->count++] = rec;
+    if(tb->count >= tb->records.size()) {
+        submit_(tb);
+    }
+}
+
+// 把写满的批次整体交给写线程，换一个空批次回来；每批只加一次全局锁
+void accessLog::submit_(threadBuffer* tb) {
+    std::lock_guard<std::mutex> locker(mtx_);
+    std::vector<accessRecord> fresh;
+    if(!free_.empty() && free_.back().size() == batchSize_) {
+        fresh.swap(free_.back());
+        free_.pop_back();
+    } else {
+        fresh.assign(batchSize_, accessRecord());
+    }
+    full_.push_back({std::move(tb->records), tb->count});
+    tb->records.swap(fresh);
+    tb->count = 0;
+    cond_.notify_one();
+}
+
+void accessLog::asyncWrite_() {
+    std::unique_lock<std::mutex> locker(mtx_);
+    // 按上次收集的时刻计时：只靠等待超时的话，只要有线程持续写满批次，写线程就一直被唤醒、永远等不到超时，
+    // 低频线程的记录会一直留在未满的批次里
+    auto nextSweep = std::chrono::steady_clock::now() + std::chrono::milliseconds(flushIntervalMS_);
+    while(true) {
+        cond_.wait_until(locker, nextSweep, [this]() { return isClose_ || !full_.empty(); });
+        auto now = std::chrono::steady_clock::now();
+        if(now >= nextSweep || isClose_) { // 定时或退出时收集各线程未写满的批次
+            nextSweep = now + std::chrono::milliseconds(flushIntervalMS_);
+            // 记录线程是先持 tb->mtx 再取 mtx_，这里必须先放开 mtx_ 再逐个加 tb->mtx
+            std::vector<threadBuffer*> buffers;
+            for(auto& tb : buffers_) {
+                buffers.push_back(tb.get());
+            }
+            std::deque<batch> partial;
+            locker.unlock();
+            for(threadBuffer* tb : buffers) {
+                std::lock_guard<std::mutex> tbLocker(tb->mtx);
+                if(tb->count > 0) {
+                    partial.push_back({std::vector<accessRecord>(tb->records.begin(), tb->records.begin() + tb->count), tb->count});
+                    tb->count = 0;
+                }
+            }
+            locker.lock();
+            for(auto& b : partial) {
+                full_.push_back(std::move(b));
+            }
+        }
+        while(!full_.empty()) {
+            batch b = std::move(full_.front());
+            full_.pop_front();
+            locker.unlock();
+            writeBatch_(b.records, b.count);
+            locker.lock();
+            if(b.records.size() == batchSize_ && free_.size() < buffers_.size() * 2) {
+                free_.push_back(std::move(b.records));
+            }
+        }
+        if(isClose_) {
+            break;
+        }
+    }
+}
+
+// 格式化一个批次，一次write()写出
+void accessLog::writeBatch_(const std::vector<accessRecord>& records, size_t count) {
+    out_.resize(count * 256);
+    size_t len = 0;
+    char ip[INET_ADDRSTRLEN];
+    for(size_t i = 0; i < count; i++) {
+        const accessRecord& r = records[i];
+        struct in_addr addr;
+        addr.s_addr = r.ip;
+        inet_ntop(AF_INET, &addr, ip, sizeof(ip));
+        int n = snprintf(&out_[len], out_.size() - len, "%lld\t%s:%u\t%.*s\t%.*s\t%u\t%llu\t%u\n",
+                         static_cast<long long>(r.timeUs), ip, r.port,
+                         static_cast<int>(sizeof(r.method)), r.method,
+                         static_cast<int>(sizeof(r.path)), r.path,
+                         r.status, static_cast<unsigned long long>(r.bytes), r.latencyUs);
+        if(n > 0) {
+            len += std::min(static_cast<size_t>(n), out_.size() - len - 1);
+        }
+    }
+    size_t off = 0;
+    while(off < len) {
+        ssize_t n = ::write(fd_, &out_[off], len - off);
+        if(n <= 0) {
+            if(n < 0 && errno == EINTR) { continue; }
+            break;
+        }
+        off += n;
+    }
+    written_.fetch_add(count, std::memory_order_relaxed);
+}
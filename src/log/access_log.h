@@ -0,0 +1,84 @@
+#ifndef ACCESS_LOG_H
+#define ACCESS_LOG_H
+
+#include <mutex>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <stdint.h>
+#include <assert.h>
+#include <fcntl.h>          // open
+#include <unistd.h>         // write close
+#include <sys/stat.h>       // mkdir
+
+// 一条访问记录，定长结构体，记录时只做拷贝，格式化留给写线程
+struct accessRecord {
+    int64_t timeUs;         // 请求完成时刻（unix 微秒）
+    uint32_t latencyUs;     // 从读到请求到最后一个字节写出的耗时
+    uint32_t ip;            // 网络字节序
+    uint16_t port;          // 主机字节序
+    uint16_t status;
+    uint64_t bytes;         // 响应字节数（头部 + 文件）
+    char method[8];
+    char path[112];
+};
+
+// 访问日志：每个线程把记录写入自己预分配的批次，批次写满后整批交给写线程，
+// 写线程格式化为制表符分隔的文本并一次write()写出，请求路径上没有系统调用
+// 输出格式：time_us  ip:port  method  path  status  bytes  latency_us
+class accessLog {
+public:
+    static accessLog* getInstance();
+
+    // sampleRate: 状态码<400的请求每N条记一条；errorSampleRate: 状态码>=400的请求每N条记一条
+    bool init(const char* fileName, int sampleRate = 1, int errorSampleRate = 1,
+              size_t batchSize = 256, int flushIntervalMS = 1000);
+    void close();
+    bool isOpen() const { return isOpen_.load(std::memory_order_relaxed); }
+
+    bool shouldSample(int status);              // 按线程本地计数器采样，无锁
+    void record(const accessRecord& rec);
+
+    uint64_t writtenRecords() const { return written_.load(std::memory_order_relaxed); }
+
+private:
+    struct threadBuffer {
+        std::mutex mtx;                         // 只有本线程和定时刷新时竞争
+        std::vector<accessRecord> records;
+        size_t count;
+    };
+
+    accessLog();
+    ~accessLog();
+
+    threadBuffer* localBuffer_();
+    void submit_(threadBuffer* tb);             // 调用方持有 tb->mtx
+    void asyncWrite_();                         // 写线程函数
+    void writeBatch_(const std::vector<accessRecord>& batch, size_t count);
+
+    int fd_;
+    int sampleRate_;
+    int errorSampleRate_;
+    size_t batchSize_;
+    int flushIntervalMS_;
+    std::atomic<bool> isOpen_;
+    std::atomic<uint64_t> written_;
+
+    struct batch {
+        std::vector<accessRecord> records;
+        size_t count;
+    };
+    std::vector<std::unique_ptr<threadBuffer>> buffers_;   // 所有线程的缓冲区，生命周期与单例一致
+    std::deque<batch> full_;                                // 待写出的批次
+    std::vector<std::vector<accessRecord>> free_;           // 写完回收复用的批次
+    bool isClose_;
+    std::mutex mtx_;
+    std::condition_variable cond_;
+    std::unique_ptr<std::thread> writeThread_;
+    std::vector<char> out_;                                 // 写线程的格式化缓冲区
+};
+
+#endif
@@ -54,7 +54,10 @@ blockQueue<T>::~blockQueue() {
 template<typename T>
 void blockQueue<T>::close() {
     clear();
-    isClose_ = true;
+    {
+        lock_guard<mutex> locker(mtx_); // 持锁设置，避免消费者在检查和等待之间错过通知
+        isClose_ = true;
+    }
     condConsumer_.notify_all();
     condProducer_.notify_all();
 }
@@ -104,6 +107,9 @@ template<typename T>
 bool blockQueue<T>::pop(T& item) {
     unique_lock<mutex> locker(mtx_); // 获取锁
     while(deq_.empty()) {
+        if(isClose_) {
+            return false;            // 队列已关闭，让写线程退出
+        }
         condConsumer_.wait(locker);  // 队列空，消费者等待，释放锁，等待生产者唤醒消费条件变量condConsumer_，再重新获取锁
     }
     item = deq_.front();
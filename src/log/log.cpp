@@ -8,19 +8,29 @@ Log::Log() {
     lineCount_ = 0;
     today_ = 0;
     isAsync_ = false;
+    isOpen_ = false;
+    level_ = 1;
+    for(int i = 0; i < MODULE_COUNT; i++) {
+        moduleLevel_[i] = -1;
+    }
 }
 
 Log::~Log() {
-    while(!deque_->empty()) {
-        deque_->flush(); // 唤醒消费者，处理掉剩下的任务
+    if(writeThread_ && writeThread_->joinable()) { // 同步模式下没有写线程和阻塞队列
+        while(!deque_->empty()) {
+            deque_->flush(); // 唤醒消费者，处理掉剩下的任务
+        }
+        deque_->close(); // 关闭队列
+        writeThread_->join(); // 等待当前线程完成手中任务
     }
-    deque_->close(); // 关闭队列
-    writeThread_->join(); // 等待当前线程完成手中任务
+    lock_guard<mutex> locker(mtx_);
     if(fp_) { // 冲洗文件缓冲区，关闭文件描述符
-        lock_guard<mutex> locker(mtx_);
         flush(); // 清空缓冲区数据
         fclose(fp_); // 关闭日志文件
     }
+    if(mmapWriter_) {
+        mmapWriter_->close(); // 截断当前文件并等待后台压缩完成
+    }
 }
 
 // 唤醒阻塞队列消费者，开始写日志
@@ -28,7 +38,9 @@ void Log::flush() {
     if(isAsync_) { // 只有异步日志才会用到deque
         deque_->flush();
     }
-    fflush(fp_); // 强制将缓冲区中的内容写入文件fp_(调用fputs(str.c_str(), fp_)后str会先被放入内存的缓冲区中，而后根据预设策略如：全缓冲/行缓冲/无缓冲 写入磁盘)
+    if(fp_) { // mmap写入器的数据已在页缓存中，不需要fflush
+        fflush(fp_);
+    } // 强制将缓冲区中的内容写入文件fp_(调用fputs(str.c_str(), fp_)后str会先被放入内存的缓冲区中，而后根据预设策略如：全缓冲/行缓冲/无缓冲 写入磁盘)
 }
 
 // 懒汉模式 局部静态变量法 （这种方法不需要加锁解锁操作）
@@ -47,14 +59,15 @@ void Log::asyncWrite_() {
     string str = "";
     while(deque_->pop(str)) {
         lock_guard<mutex> locker(mtx_);
-        fputs(str.c_str(), fp_);
+        output_(str.c_str());
     }
 }
 
 // 初始化日志实例
-void Log::init(int level, const char* path, const char* suffix, bool isAsync) {
-    isOpen_ = true;
+void Log::init(int level, const char* path, const char* suffix, bool isAsync,
+               size_t rollSize, int maxFiles) {
     level_ = level;
+    isOpen_ = true;
     path_ = path;
     suffix_ = suffix;
     if(isAsync) { // 异步方式
@@ -80,12 +93,26 @@ void Log::init(int level, const char* path, const char* suffix, bool isAsync) {
             path_, systime->tm_year + 1900, systime->tm_mon + 1, systime->tm_mday, suffix_);
     today_ = systime->tm_mday;
 
+    int mmapErr = 0;
     {
         lock_guard<mutex> locker(mtx_);
         buff_.retrieveAll();
         if(fp_) { // 关闭fp_，然后重新重新打开
             flush();
             fclose(fp_);
+            fp_ = nullptr;
+        }
+        if(mmapWriter_) {
+            mmapWriter_->close();
+            mmapWriter_.reset();
+        }
+        if(rollSize > 0) { // mmap写入器自行管理文件名和切换
+            mmapWriter_.reset(new mmapLogWriter());
+            if(mmapWriter_->init(path_, suffix_, rollSize, maxFiles)) {
+                return;
+            }
+            mmapErr = errno ? errno : EIO;
+            mmapWriter_.reset(); // 退回按天、按行数切换的fopen方式
         }
         fp_ = fopen(fileName, "a"); // 打开文件读取并附加写入
         if(fp_ == nullptr) {
@@ -94,7 +121,14 @@ void Log::init(int level, const char* path, const char* suffix, bool isAsync) {
         }
         assert(fp_ != nullptr);
     }
+    if(mmapErr) {
+        LOG_ERROR("mmap log writer init error: %s, fall back to %s", strerror(mmapErr), fileName);
+    }
+}
 
+size_t Log::droppedBytes() {
+    lock_guard<mutex> locker(mtx_);
+    return mmapWriter_ ? mmapWriter_->droppedBytes() : 0;
 }
 
 void Log::write(int level, const char* format, ...) {
@@ -106,8 +140,8 @@ void Log::write(int level, const char* format, ...) {
     struct tm t = *sysTime;
     va_list vaList; // va_list （字符指针），这个变量会被后续的宏（va_start、va_end 等）用来指向可变参数列表中的参数，从而实现对可变参数的访问操作。
 
-    // 日志日期 日志行数 如果不是今天或行数超了
-    if(today_ != t.tm_mday || (lineCount_ && (lineCount_ % MAX_LINES == 0))){
+    // 日志日期 日志行数 如果不是今天或行数超了（mmap写入器按大小在后台切换，不走这里）
+    if(!mmapWriter_ && (today_ != t.tm_mday || (lineCount_ && (lineCount_ % MAX_LINES == 0)))){
         unique_lock<mutex> locker(mtx_);
         locker.unlock();
 
@@ -151,12 +185,20 @@ void Log::write(int level, const char* format, ...) {
         if(isAsync_ && deque_ && !deque_->full()) { // 异步方式（加入阻塞队列中，等待写线程读取日志信息）
             deque_->push_back(buff_.retrieveAllAsString());
         } else { // 同步方式
-            fputs(buff_.peek(), fp_); // 同步就直接写入文件，从 buff_ 可读位置开始直到遇到结束标志"\0"
+            output_(buff_.peek()); // 同步就直接写入文件，从 buff_ 可读位置开始直到遇到结束标志"\0"
         }
         buff_.retrieveAll(); // 清空buff
     }
 }
 
+void Log::output_(const char* line) {
+    if(mmapWriter_) {
+        mmapWriter_->append(line, strlen(line));
+    } else {
+        fputs(line, fp_);
+    }
+}
+
 // 添加日志等级
 void Log::appendLogLevelTitle_(int level) {
     switch(level) {
@@ -178,12 +220,22 @@ void Log::appendLogLevelTitle_(int level) {
     }
 }
 
-int Log::getLevel() {
-    lock_guard<mutex> locker(mtx_);
-    return level_;
+// 等级只是一个整数开关，用 relaxed 原子操作即可，不需要与日志内容同步
+int Log::getLevel() const {
+    return level_.load(std::memory_order_relaxed);
 }
 
 void Log::setLevel(int level) {
-    lock_guard<mutex> locker(mtx_);
-    level_ = level;
+    level_.store(level, std::memory_order_relaxed);
+}
+
+int Log::getLevel(int module) const {
+    assert(module >= 0 && module < MODULE_COUNT);
+    int level = moduleLevel_[module].load(std::memory_order_relaxed);
+    return level >= 0 ? level : getLevel();
+}
+
+void Log::setModuleLevel(int module, int level) {
+    assert(module >= 0 && module < MODULE_COUNT);
+    moduleLevel_[module].store(level < 0 ? -1 : level, std::memory_order_relaxed);
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 #define LOG_H
 
 #include <mutex>
+#include <atomic>
 #include <string>
 #include <thread>
 #include <sys/time.h>
@@ -10,14 +11,32 @@
 #include <assert.h>
 #include <sys/stat.h>         // mkdir
 #include "block_queue.h"
+#include "mmap_log_writer.h"
 #include "../buffer/buffer.h"
 
+// 编译期最低日志等级，低于该等级的日志调用点在预处理后被常量折叠掉（0:debug 1:info 2:warn 3:error）
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 0
+#endif
+
 class Log {
 public:
-    // 初始化日志实例（阻塞队列最大容量、日志保存路径、日志文件后缀）
+    // 日志所属模块，每个模块可单独设置运行期日志等级
+    enum MODULE {
+        MODULE_DEFAULT = 0,
+        MODULE_HTTP,
+        MODULE_SERVER,
+        MODULE_POOL,
+        MODULE_TIMER,
+        MODULE_COUNT,
+    };
+
+    // 初始化日志实例（日志等级、日志保存路径、日志文件后缀、是否异步）
+    // rollSize > 0 时改用mmap写入器：按字节大小切换文件，旧文件由后台压缩，最多保留maxFiles个
     void init(int level, const char* path = "./log", 
                 const char* suffix =".log",
-                bool isAsync = false);
+                bool isAsync = false,
+                size_t rollSize = 0, int maxFiles = 0);
 
     static Log* getInstance();
     static void flushLogThread();   // 异步写日志公有方法，调用私有方法asyncWrite_
@@ -25,14 +44,19 @@ public:
     void write(int level, const char *format,...);  // 将输出内容按照标准格式整理
     void flush();
 
-    int getLevel();
+    int getLevel() const;
     void setLevel(int level);
-    bool isOpen() { return isOpen_; }
+    int getLevel(int module) const;             // 模块等级，未单独设置时沿用全局等级
+    void setModuleLevel(int module, int level); // level < 0 表示恢复沿用全局等级
+    bool isOpen() const { return isOpen_.load(std::memory_order_relaxed); }
+    bool isEnabled(int module, int level) const { return isOpen() && getLevel(module) <= level; }
+    size_t droppedBytes();                      // mmap写入器因下一个文件未就绪而丢弃的字节数
     
 private:
     Log();
     virtual ~Log();
     void appendLogLevelTitle_(int level);
+    void output_(const char* line);         // 将一条日志写到FILE*或mmap写入器
     void asyncWrite_(); // 异步写日志方法
 
 private:
@@ -46,22 +70,30 @@ private:
     int lineCount_;             // 日志行数记录
     int today_;                 // 按当天日期区分文件
 
-    bool isOpen_;               
+    std::atomic<bool> isOpen_;
  
     Buffer buff_;       // 输出的内容，缓冲区
-    int level_;         // 日志等级
+    std::atomic<int> level_;                        // 全局日志等级，原子读取，判断时无需加锁
+    std::atomic<int> moduleLevel_[MODULE_COUNT];    // 各模块日志等级，-1 表示沿用全局等级
     bool isAsync_;      // 是否开启异步日志
 
     FILE* fp_;                                          // 打开log的文件指针
+    std::unique_ptr<mmapLogWriter> mmapWriter_;         // mmap写入器，非空时取代fp_
     std::unique_ptr<blockQueue<std::string>> deque_;    // 阻塞队列
     std::unique_ptr<std::thread> writeThread_;          // 写线程的指针
     std::mutex mtx_;                                    // 同步日志必需的互斥量
 };
 
+// 源文件可在包含头文件前定义 LOG_MODULE 指定所属模块，例如 #define LOG_MODULE Log::MODULE_HTTP
+#ifndef LOG_MODULE
+#define LOG_MODULE Log::MODULE_DEFAULT
+#endif
+
 #define LOG_BASE(level, format, ...)\
     do {\
+        if (LOG_MIN_LEVEL > (level)) break;\
         Log* log = Log::getInstance();\
-        if (log->isOpen() && log->getLevel() <= level) {\
+        if (log->isEnabled(LOG_MODULE, level)) {\
             log->write(level, format, ##__VA_ARGS__);\
             log->flush();\
         }\
@@ -0,0 +1,209 @@
+#include "mmap_log_writer.h"
+#include <time.h>
+#include <zlib.h>               // gzopen gzwrite
+#include <sys/resource.h>       // setpriority
+#include <sys/syscall.h>        // SYS_gettid
+
+mmapLogWriter::mmapLogWriter() {
+    rollSize_ = 0;
+    maxFiles_ = 0;
+    compress_ = false;
+    fileSeq_ = 0;
+    cur_ = {-1, nullptr, 0, ""};
+    next_ = {-1, nullptr, 0, ""};
+    hasNext_ = false;
+    dropped_ = 0;
+    isClose_ = true;
+}
+
+mmapLogWriter::~mmapLogWriter() {
+    close();
+}
+
+bool mmapLogWriter::init(const char* path, const char* suffix, size_t rollSize,
+                         int maxFiles, bool compress) {
+    assert(rollSize > 0);
+    close();
+    path_ = path;
+    suffix_ = suffix;
+    rollSize_ = rollSize;
+    maxFiles_ = maxFiles;
+    compress_ = compress;
+    fileSeq_ = 0;
+    dropped_ = 0;
+
+    mkdir(path_.c_str(), 0777);
+    if(!createFile_(cur_)) { // 第一个文件在启动时同步创建
+        return false;
+    }
+    isClose_ = false;
+    bgThread_.reset(new std::thread(&mmapLogWriter::backgroundThread_, this)); // 启动后立即预创建下一个文件
+    return true;
+}
+
+// 热路径：只做memcpy，文件写满时与后台预创建的文件交换，绝不在这里创建/关闭文件
+void mmapLogWriter::append(const char* data, size_t len) {
+    if(len > rollSize_) { len = rollSize_; }
+    if(!cur_.addr || cur_.used + len > rollSize_) {
+        std::unique_lock<std::mutex> locker(mtx_); // 后台线程只在交换指针时持锁，这里不会等待磁盘IO
+        if(cur_.addr) {
+            retired_.push_back(cur_);
+            cur_ = {-1, nullptr, 0, ""};
+        }
+        if(hasNext_) {
+            cur_ = next_;
+            hasNext_ = false;
+        }
+        cond_.notify_one();
+        if(!cur_.addr) { // 后台还没准备好下一个文件，丢弃本条而不是阻塞
+            dropped_.fetch_add(len, std::memory_order_relaxed);
+            return;
+        }
+    }
+    memcpy(cur_.addr + cur_.used, data, len);
+    cur_.used += len;
+}
+
+void mmapLogWriter::close() {
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        if(isClose_) { return; }
+        isClose_ = true;
+    }
+    cond_.notify_all();
+    if(bgThread_ && bgThread_->joinable()) {
+        bgThread_->join(); // 后台线程退出前会处理完所有待压缩文件
+    }
+    bgThread_.reset();
+    if(cur_.addr) {
+        retireFile_(cur_);
+    }
+    if(hasNext_) { // 预创建但没用上的空文件直接删除
+        retireFile_(next_);
+        unlink(next_.name.c_str());
+        hasNext_ = false;
+    }
+}
+
+bool mmapLogWriter::createFile_(mappedFile& file) {
+    time_t timer = time(nullptr);
+    struct tm t;
+    localtime_r(&timer, &t);
+    char name[256] = {0};
+    int fd = -1;
+    // 用O_EXCL跳过上次运行遗留的同名文件
+    for(int tries = 0; tries < 1024 && fd < 0; tries++) {
+        snprintf(name, sizeof(name) - 1, "%s/%04d_%02d_%02d-%d%s",
+                 path_.c_str(), t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, fileSeq_++, suffix_.c_str());
+        fd = open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if(fd < 0 && errno != EEXIST) { return false; }
+    }
+    if(fd < 0) { return false; }
+    // 必须真正分配磁盘块：ftruncate只产生稀疏文件，磁盘满时写映射区会收到SIGBUS。
+    // 分配失败就不用这个文件，写入方丢弃日志（启动时由Log退回fopen）
+    int err = posix_fallocate(fd, 0, rollSize_);
+    if(err != 0) {
+        ::close(fd);
+        unlink(name);
+        errno = err;
+        return false;
+    }
+    // MAP_POPULATE 把文件页预先读入页缓存并建立只读映射，首次写入每页时仍有一次写保护缺页（标记脏页），
+    // 但不会再有读盘或分配磁盘块的阻塞
+    void* addr = mmap(nullptr, rollSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    if(addr == MAP_FAILED) {
+        err = errno;
+        ::close(fd);
+        unlink(name);
+        errno = err;
+        return false;
+    }
+    file = {fd, static_cast<char*>(addr), 0, name};
+    return true;
+}
+
+void mmapLogWriter::retireFile_(mappedFile& file) {
+    munmap(file.addr, rollSize_);
+    if(ftruncate(file.fd, file.used) < 0) { // 去掉预分配但未写入的尾部
+        fprintf(stderr, "truncate log file %s error!\n", file.name.c_str());
+    }
+    ::close(file.fd);
+    file.addr = nullptr;
+    file.fd = -1;
+}
+
+void mmapLogWriter::compressFile_(const std::string& name) {
+    int fd = open(name.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) { return; }
+    std::string gzName = name + ".gz";
+    gzFile gz = gzopen(gzName.c_str(), "wb6");
+    if(!gz) {
+        ::close(fd);
+        return;
+    }
+    char buff[65536];
+    ssize_t n = 0;
+    bool ok = true;
+    while((n = read(fd, buff, sizeof(buff))) > 0) {
+        if(gzwrite(gz, buff, static_cast<unsigned>(n)) != n) {
+            ok = false;
+            break;
+        }
+    }
+    ::close(fd);
+    if(gzclose(gz) != Z_OK || !ok || n < 0) {
+        unlink(gzName.c_str()); // 压缩失败则保留原文件
+        history_.push_back(name);
+        return;
+    }
+    unlink(name.c_str());
+    history_.push_back(gzName);
+}
+
+void mmapLogWriter::pruneFiles_() {
+    while(maxFiles_ > 0 && history_.size() > static_cast<size_t>(maxFiles_)) {
+        unlink(history_.front().c_str());
+        history_.pop_front();
+    }
+}
+
+// 后台线程：降低调度优先级，负责预创建下一个文件以及处理写满的文件。
+// 先预创建：写入方刚切换到next_，此时压缩旧文件会让新的下一个文件迟迟不能就绪，期间再写满就只能丢日志
+void mmapLogWriter::backgroundThread_() {
+    setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 19);
+    std::unique_lock<std::mutex> locker(mtx_);
+    bool createFailed = false;  // 创建失败后先处理写满的文件（压缩、清理可能腾出空间），再等待重试
+    while(true) {
+        cond_.wait(locker, [this]() { return isClose_ || !hasNext_ || !retired_.empty(); });
+        if(!hasNext_ && !isClose_ && !createFailed) {
+            locker.unlock();
+            mappedFile file;
+            bool ok = createFile_(file);
+            locker.lock();
+            if(ok) {
+                next_ = file;
+                hasNext_ = true;
+            } else {
+                createFailed = true;
+            }
+        } else if(!retired_.empty()) {
+            mappedFile file = retired_.front();
+            retired_.pop_front();
+            locker.unlock(); // 截断、压缩、清理都不持锁
+            retireFile_(file);
+            if(compress_) {
+                compressFile_(file.name);
+            } else {
+                history_.push_back(file.name);
+            }
+            pruneFiles_();
+            locker.lock();
+            createFailed = false;
+        } else if(isClose_) {
+            break;
+        } else if(createFailed) {
+            cond_.wait_for(locker, std::chrono::seconds(1)); // 磁盘异常时不要空转
+            createFailed = false;
+        }
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef MMAP_LOG_WRITER_H
+#define MMAP_LOG_WRITER_H
+
+#include <mutex>
+#include <memory>
+#include <deque>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <assert.h>
+#include <string.h>         // memcpy
+#include <errno.h>
+#include <fcntl.h>          // open
+#include <unistd.h>         // close ftruncate
+#include <sys/mman.h>       // mmap munmap
+#include <sys/stat.h>       // mkdir
+
+// 基于mmap的日志文件写入器：
+// 1. 日志直接memcpy到预先分配并映射好的文件区域，没有stdio缓冲和逐行fflush
+// 2. 按字节大小切换文件，下一个文件由后台线程提前创建并映射好，切换只是交换指针
+// 3. 写满的文件交给后台低优先级线程截断、gzip压缩，并清理超出数量的旧文件
+// append() 由调用方保证串行（Log的互斥量或异步写线程），内部锁只用于和后台线程交换文件
+class mmapLogWriter {
+public:
+    mmapLogWriter();
+    ~mmapLogWriter();
+
+    // 文件名形如 path/2024_11_25-3.log，rollSize为单个文件大小，maxFiles为保留的历史文件数（0不清理）
+    // 第一个文件创建或分配磁盘空间失败时返回false，errno为失败原因
+    bool init(const char* path, const char* suffix, size_t rollSize,
+              int maxFiles = 0, bool compress = true);
+    void append(const char* data, size_t len);
+    void close();
+
+    size_t droppedBytes() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    struct mappedFile {
+        int fd;
+        char* addr;
+        size_t used;
+        std::string name;
+    };
+
+    bool createFile_(mappedFile& file);     // 创建、分配磁盘块并映射一个新文件
+    void retireFile_(mappedFile& file);     // 截断到实际长度并解除映射
+    void compressFile_(const std::string& name);
+    void pruneFiles_();
+    void backgroundThread_();
+
+    std::string path_;
+    std::string suffix_;
+    size_t rollSize_;
+    int maxFiles_;
+    bool compress_;
+    int fileSeq_;
+
+    mappedFile cur_;                        // 当前写入的文件，只由写入方访问
+    mappedFile next_;                       // 后台预先创建好的下一个文件
+    bool hasNext_;
+    std::deque<mappedFile> retired_;        // 待后台处理的写满文件
+    std::deque<std::string> history_;       // 已完成的历史文件，用于按数量清理
+
+    std::atomic<size_t> dropped_;           // 下一个文件未就绪时丢弃的字节数
+    bool isClose_;
+    std::mutex mtx_;
+    std::condition_variable cond_;
+    std::unique_ptr<std::thread> bgThread_;
+};
+
+#endif
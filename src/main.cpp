@@ -1,13 +1,110 @@
 #include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string>
 #include "./server/webserver.h"
+#include "./server/prefork.h"
 
-int main() {
-    // 守护进程 后台运行
-    webServer server(
-        1316, 3, 60000,              // 端口 ET模式 timeoutMs 
-        3306, "root", "qq105311", "mydb", /* mysql配置 */
-        16, 8, true, 1, true);             /* 连接池数量 线程池数量 日志开关 日志等级 日志异步or同步 */
-    server.start();
-    
-    return 0;
-} 
+int main(int argc, char* argv[]) {
+    // 命令行可覆盖部分配置，压测时用于切换触发模式和线程数：
+    //   -p 端口 -m 触发模式(0~3) -t 线程池线程数 -u 嵌入式用户存储文件(不连MySQL)
+    //   -w 预派生worker进程数(0为单进程多线程模式)，每个worker绑定一个CPU，-t 为每个worker的线程数，不能与 -u 同时使用
+    //   -r 按客户端地址限速 "新建连接,请求,登录注册"（每秒，0不限），默认关闭；直接面向公网时可用如 -r 200,2000,10
+    //   -a 服务CPU集合(如 "0-7")，事件循环和线程池绑定其中 -k 后台CPU集合(日志、压缩、SQL预热)，默认为其余CPU
+    //   -b 打包的静态资源(respack生成，如 "./build/resources.bundle")，代替resources目录
+    int port = 1316, trigMode = 3, threadNum = 8, workers = 0;
+    const char* userStoreFile = nullptr;
+    const char* servingCpus = nullptr;
+    const char* housekeepingCpus = nullptr;
+    const char* bundlePath = nullptr;
+    double connRate = 0, reqRate = 0, authRate = 0;
+    int ch;
+    while((ch = getopt(argc, argv, "p:m:t:u:w:a:k:r:b:")) != -1) {
+        switch(ch) {
+            case 'p': port = atoi(optarg); break;
+            case 'm': trigMode = atoi(optarg); break;
+            case 't': threadNum = atoi(optarg); break;
+            case 'u': userStoreFile = optarg; break;
+            case 'w': workers = atoi(optarg); break;
+            case 'a': servingCpus = optarg; break;
+            case 'k': housekeepingCpus = optarg; break;
+            case 'b': bundlePath = optarg; break;
+            case 'r':
+                if(sscanf(optarg, "%lf,%lf,%lf", &connRate, &reqRate, &authRate) != 3) {
+                    fprintf(stderr, "bad rate limits '%s', expect conn,req,auth\n", optarg);
+                    return 1;
+                }
+                break;
+            default: return 1;
+        }
+    }
+    if(workers > 0 && userStoreFile) {
+        // 嵌入式用户存储的内存索引每个进程一份，各worker看不到彼此的注册，且同时追加同一数据文件
+        fprintf(stderr, "-u (embedded user store) cannot be used with -w (prefork workers), use MySQL instead\n");
+        return 1;
+    }
+    if(!cpuPlacement::getInstance()->init(servingCpus, housekeepingCpus)) {
+        fprintf(stderr, "bad cpu list (-a %s -k %s), or no allowed cpu in it\n",
+                servingCpus ? servingCpus : "", housekeepingCpus ? housekeepingCpus : "");
+        return 1;
+    }
+    // worker < 0 为单进程模式
+    auto runServer = [&](int worker) {
+        std::string adminPath = "./webserver.sock";
+        if(worker >= 0) { adminPath += "." + std::to_string(worker); } // 每个worker一个管理socket
+        webServerConfig config;
+        config.port = port;
+        config.trigMode = trigMode;                 // ET模式
+        config.timeoutMS = 60000;
+        config.sqlPort = 3306;                      // mysql配置
+        config.sqlUser = "root";
+        config.sqlPasswd = "qq105311";
+        config.dbName = "mydb";
+        config.connPoolNum = 16;                    // 连接池数量
+        config.threadNum = threadNum;               // 线程池数量
+        config.openLog = true;                      // 日志开关 日志等级 日志异步or同步
+        config.logLevel = 1;
+        config.isAsync = true;
+        config.logRollSize = 64 << 20;              // 单个日志文件大小(mmap写入) 保留的历史日志数
+        config.logMaxFiles = 10;
+        config.accessLogSample = 1;                 // 访问日志采样率(每N条记一条, 0关闭)
+        config.asyncSql = false;                    // 异步SQL模式, 验证期限(ms)超时回503
+        config.sqlQueryTimeoutMS = 1000;
+        config.lazySqlWarmUp = true;                // SQL连接池后台并行预热
+        config.credCacheTTL = 300;                  // 登录凭据缓存时间(秒) 会话cookie有效期(秒), 0关闭
+        config.sessionTTL = 1800;
+        config.userFilterItems = 1000000;           // 用户名布隆过滤器: 预计用户数(0关闭) 目标误判率 位数组上限(字节, 0不限)
+        config.userFilterFpr = 0.01;
+        config.userFilterMaxBytes = 16 << 20;
+        config.regBatchMS = 5;                      // 注册组提交窗口(ms) 每批最多条数(<=1关闭)
+        config.regBatchRows = 64;
+        config.userStoreFile = userStoreFile;       // 嵌入式用户存储文件(如 "./data/users.db"), nullptr使用MySQL
+        config.metricsPath = "/metrics";            // Prometheus指标路径, nullptr关闭
+        config.adminPath = adminPath.c_str();       // 管理控制socket路径, nullptr关闭
+        config.reusePort = worker >= 0;             // SO_REUSEPORT(预派生模式)
+        config.overloadTargetMS = 10;               // 过载控制: 任务排队时间目标(ms) 判定窗口(ms), 目标为0关闭
+        config.overloadIntervalMS = 100;
+        config.connRate = connRate;                 // 按客户端地址限速(每秒): 新建连接 请求 登录/注册, 0不限
+        config.reqRate = reqRate;
+        config.authRate = authRate;
+        config.writeQuantum = 256 << 10;            // 写配额(字节) 写时间片(us) 大响应按连接限速(字节/秒), 0不限
+        config.writeSliceUs = 2000;
+        config.pacingRate = 0;
+        config.fileIOThreads = 2;                   // 冷文件预读I/O线程数 写前检查驻留的窗口(字节), 0关闭
+        config.prefetchWindow = 1 << 20;
+        config.bundlePath = bundlePath;             // 打包的静态资源(nullptr从resources目录读取) 启动时预先载入
+        config.bundlePopulate = true;
+        // 守护进程 后台运行
+        webServer server(config);
+        server.start();
+        return 0;
+    };
+
+    if(workers > 0) {
+        // master只写同步日志（不起线程，fork安全），worker在webServer中重新初始化日志
+        Log::getInstance()->init(1, "./webserver_log", ".log", false);
+        preforkMaster master(workers, runServer);
+        return master.run();
+    }
+    return runServer(-1);
+}
@@ -0,0 +1,67 @@
+#include "hdr_histogram.h"
+#include <assert.h>
+
+const int hdrHistogram::SUB_BITS;
+const int hdrHistogram::SUB_COUNT;
+const int hdrHistogram::MAX_BITS;
+const int hdrHistogram::BUCKET_NUM;
+const uint64_t hdrHistogram::MAX_VALUE;
+
+hdrHistogram::hdrHistogram() {
+    for(int i = 0; i < BUCKET_NUM; i++) {
+        counts_[i] = 0;
+    }
+    sum_ = 0;
+    max_ = 0;
+}
+
+int hdrHistogram::index(uint64_t value) {
+    if(value < 2 * SUB_COUNT) {
+        return static_cast<int>(value);
+    }
+    // shift >= 1：值右移shift位后落在 [SUB_COUNT, 2*SUB_COUNT)
+    int shift = 63 - __builtin_clzll(value) - SUB_BITS;
+    return (shift + 1) * SUB_COUNT + static_cast<int>((value >> shift) - SUB_COUNT);
+}
+
+uint64_t hdrHistogram::highestEquivalent(int idx) {
+    assert(idx >= 0 && idx < BUCKET_NUM);
+    if(idx < 2 * SUB_COUNT) {
+        return idx;
+    }
+    int shift = idx / SUB_COUNT - 1;
+    uint64_t low = static_cast<uint64_t>(idx % SUB_COUNT + SUB_COUNT) << shift;
+    return low + (1ULL << shift) - 1;
+}
+
+void hdrHistogram::mergeInto(snapshot& snap) const {
+    uint64_t total = 0;
+    for(int i = 0; i < BUCKET_NUM; i++) {
+        uint64_t n = counts_[i].load(std::memory_order_relaxed);
+        snap.counts[i] += n;
+        total += n;
+    }
+    // total由桶计数累加得到，与counts保持一致（写者可能正在更新）
+    snap.total += total;
+    snap.sum += sum_.load(std::memory_order_relaxed);
+    uint64_t max = max_.load(std::memory_order_relaxed);
+    if(max > snap.max) { snap.max = max; }
+}
+
+uint64_t hdrHistogram::snapshot::percentile(double p) const {
+    if(total == 0) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(p / 100.0 * total + 0.5);
+    if(rank < 1) { rank = 1; }
+    if(rank > total) { rank = total; }
+    uint64_t seen = 0;
+    for(int i = 0; i < BUCKET_NUM; i++) {
+        seen += counts[i];
+        if(seen >= rank) {
+            uint64_t v = highestEquivalent(i);
+            return v < max ? v : max;
+        }
+    }
+    return max;
+}
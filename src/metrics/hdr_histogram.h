@@ -0,0 +1,56 @@
+#ifndef HDR_HISTOGRAM_H
+#define HDR_HISTOGRAM_H
+
+#include <atomic>
+#include <vector>
+#include <stdint.h>
+
+// 对数线性分桶的直方图（HDR histogram 的简化版）：按最高位分组，每组再线性分SUB_COUNT个子桶，
+// 相对误差不超过 1/SUB_COUNT；小于 2*SUB_COUNT 的值精确记录。
+// 单写者：只允许一个线程record（relaxed load + store，不加锁），其他线程随时可以merge读取
+class hdrHistogram {
+public:
+    static const int SUB_BITS = 6;
+    static const int SUB_COUNT = 1 << SUB_BITS;
+    static const int MAX_BITS = 32;                                     // 可记录的最大值 2^32-1，超出按最大值记录
+    static const int BUCKET_NUM = (MAX_BITS - SUB_BITS + 1) * SUB_COUNT;
+
+    hdrHistogram();
+
+    void record(uint64_t value) {
+        if(value > MAX_VALUE) { value = MAX_VALUE; }
+        bump_(counts_[index(value)], 1);
+        bump_(sum_, value);
+        if(value > max_.load(std::memory_order_relaxed)) {
+            max_.store(value, std::memory_order_relaxed);
+        }
+    }
+
+    static int index(uint64_t value);
+    static uint64_t highestEquivalent(int idx);    // 桶内最大值，分位数按它报告
+
+    // 合并后的快照，用于计算分位数；可以把多个线程的直方图合并到同一个快照
+    struct snapshot {
+        std::vector<uint64_t> counts;
+        uint64_t total;
+        uint64_t sum;
+        uint64_t max;
+
+        snapshot() : counts(BUCKET_NUM, 0), total(0), sum(0), max(0) {}
+        uint64_t percentile(double p) const;    // p取值0~100
+    };
+    void mergeInto(snapshot& snap) const;
+
+private:
+    static const uint64_t MAX_VALUE = (1ULL << MAX_BITS) - 1;
+
+    static void bump_(std::atomic<uint64_t>& v, uint64_t n) {
+        v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t> counts_[BUCKET_NUM];
+    std::atomic<uint64_t> sum_;
+    std::atomic<uint64_t> max_;
+};
+
+#endif
@@ -0,0 +1,61 @@
+#include "latency_tracker.h"
+#include <stdio.h>
+
+namespace {
+
+const char* PHASE_NAMES[latencyTracker::PHASE_NUM] = {
+    "queue", "parse", "verify", "build", "write_wait", "write", "total",
+};
+
+const double QUANTILES[] = {0.5, 0.99, 0.999};
+
+} // namespace
+
+// 懒汉模式 局部静态变量法
+latencyTracker* latencyTracker::getInstance() {
+    static latencyTracker tracker;
+    return &tracker;
+}
+
+const char* latencyTracker::phaseName(PHASE phase) {
+    return PHASE_NAMES[phase];
+}
+
+latencyTracker::threadHistograms* latencyTracker::registerThread_() {
+    std::unique_ptr<threadHistograms> local(new threadHistograms());
+    threadHistograms* ptr = local.get();
+    std::lock_guard<std::mutex> locker(mtx_);
+    threads_.push_back(std::move(local));
+    return ptr;
+}
+
+hdrHistogram::snapshot latencyTracker::merge(PHASE phase) {
+    hdrHistogram::snapshot snap;
+    std::lock_guard<std::mutex> locker(mtx_);
+    for(auto& local : threads_) {
+        local->hist[phase].mergeInto(snap);
+    }
+    return snap;
+}
+
+void latencyTracker::render(std::string& out) {
+    const char* name = "webserver_request_phase_microseconds";
+    out += "# HELP ";
+    out += name;
+    out += " Request latency by phase.\n# TYPE ";
+    out += name;
+    out += " summary\n";
+    char buf[160];
+    for(int p = 0; p < PHASE_NUM; p++) {
+        hdrHistogram::snapshot snap = merge(static_cast<PHASE>(p));
+        for(double q : QUANTILES) {
+            snprintf(buf, sizeof(buf), "%s{phase=\"%s\",quantile=\"%g\"} %llu\n", name, PHASE_NAMES[p], q,
+                     static_cast<unsigned long long>(snap.percentile(q * 100)));
+            out += buf;
+        }
+        snprintf(buf, sizeof(buf), "%s_sum{phase=\"%s\"} %llu\n%s_count{phase=\"%s\"} %llu\n",
+                 name, PHASE_NAMES[p], static_cast<unsigned long long>(snap.sum),
+                 name, PHASE_NAMES[p], static_cast<unsigned long long>(snap.total));
+        out += buf;
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef LATENCY_TRACKER_H
+#define LATENCY_TRACKER_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <memory>
+#include "hdr_histogram.h"
+
+// 请求各阶段耗时（微秒）。每个线程一组直方图，记录时只写本线程的，不加锁；
+// 抓取时合并所有线程的直方图，输出各阶段的 p50/p99/p999
+class latencyTracker {
+public:
+    enum PHASE {
+        PHASE_QUEUE = 0,    // 读就绪 -> 工作线程取到任务（线程池排队）
+        PHASE_PARSE,        // 取到任务 -> 解析完成（读socket + 解析，不含用户验证）
+        PHASE_VERIFY,       // 登录/注册验证（缓存、数据库或异步SQL）
+        PHASE_BUILD,        // 解析完成 -> 响应生成（文件映射、响应头）
+        PHASE_WRITE_WAIT,   // 响应生成 -> 第一个字节写出（等待写就绪 + 排队）
+        PHASE_WRITE,        // 第一个字节 -> 最后一个字节
+        PHASE_TOTAL,        // 读就绪 -> 最后一个字节
+        PHASE_NUM,
+    };
+
+    static latencyTracker* getInstance();
+
+    static void record(PHASE phase, uint64_t us) {
+        localHistograms_()->hist[phase].record(us);
+    }
+
+    hdrHistogram::snapshot merge(PHASE phase);
+    void render(std::string& out);      // 追加 Prometheus summary 格式的输出
+
+    static const char* phaseName(PHASE phase);
+
+private:
+    struct threadHistograms {
+        hdrHistogram hist[PHASE_NUM];
+    };
+
+    latencyTracker() = default;
+    ~latencyTracker() = default;
+
+    static threadHistograms* localHistograms_() {
+        static thread_local threadHistograms* local = getInstance()->registerThread_(); // 每个线程只注册一次
+        return local;
+    }
+    threadHistograms* registerThread_();
+
+    std::mutex mtx_;        // 保护threads_，只在线程第一次记录和抓取时使用
+    std::vector<std::unique_ptr<threadHistograms>> threads_;   // 线程退出后保留，计数不丢
+};
+
+#endif
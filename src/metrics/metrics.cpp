@@ -0,0 +1,165 @@
+#include "metrics.h"
+#include "latency_tracker.h"
+#include "shared_stats.h"
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <algorithm>
+
+namespace {
+
+struct counterDesc {
+    const char* name;
+    const char* help;
+    const char* label;      // 非空时与同名的其他计数器合并为一个带标签的指标
+};
+
+// 与 metrics::COUNTER 一一对应
+const counterDesc COUNTER_DESC[metrics::COUNTER_NUM] = {
+    {"webserver_connections_accepted_total", "Accepted client connections.", nullptr},
+    {"webserver_connections_closed_total", "Closed client connections.", nullptr},
+    {"webserver_bytes_received_total", "Bytes read from clients.", nullptr},
+    {"webserver_bytes_sent_total", "Bytes written to clients.", nullptr},
+    {"webserver_requests_total", "Responses by status code.", "code=\"200\""},
+    {"webserver_requests_total", "Responses by status code.", "code=\"400\""},
+    {"webserver_requests_total", "Responses by status code.", "code=\"403\""},
+    {"webserver_requests_total", "Responses by status code.", "code=\"404\""},
+    {"webserver_requests_total", "Responses by status code.", "code=\"503\""},
+    {"webserver_requests_total", "Responses by status code.", "code=\"other\""},
+    {"webserver_threadpool_tasks_total", "Tasks run by the worker pool.", nullptr},
+    {"webserver_threadpool_wait_microseconds_total", "Time tasks spent queued before a worker picked them up.", nullptr},
+    {"webserver_timer_expirations_total", "Connection timers that expired.", nullptr},
+    {"webserver_overload_shed_total", "Work rejected with 503 by overload control.", "what=\"request\""},
+    {"webserver_overload_shed_total", "Work rejected with 503 by overload control.", "what=\"connection\""},
+    {"webserver_overload_accept_pauses_total", "Times the listener was paused because the worker pool was overloaded.", nullptr},
+    {"webserver_overload_inline_tasks_total", "Tasks run on the event loop instead of the overloaded worker pool.", nullptr},
+    {"webserver_rate_limited_total", "Work rejected by the per-client rate limiter.", "kind=\"conn\""},
+    {"webserver_rate_limited_total", "Work rejected by the per-client rate limiter.", "kind=\"req\""},
+    {"webserver_rate_limited_total", "Work rejected by the per-client rate limiter.", "kind=\"auth\""},
+    {"webserver_write_yields_total", "Writes that stopped after the write quantum or time slice and were requeued.", nullptr},
+    {"webserver_file_prefetch_total", "Response file windows that were not in the page cache and were read by the file I/O threads.", nullptr},
+    {"webserver_file_prefetch_bytes_total", "Bytes read into the page cache by the file I/O threads.", nullptr},
+    {"webserver_file_prefetch_failed_total", "Prefetches that failed; the response was written without them.", nullptr},
+};
+
+void appendHeader(std::string& out, const char* name, const char* help, const char* type) {
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+} // namespace
+
+const int metrics::MAX_SLOTS;
+
+metrics::metrics() {
+    slotNum_ = 0;
+    for(int i = 0; i < MAX_SLOTS; i++) {
+        for(int c = 0; c < COUNTER_NUM; c++) {
+            slots_[i].counters[c] = 0;
+        }
+    }
+    for(int c = 0; c < COUNTER_NUM; c++) {
+        overflow_[c] = 0;
+    }
+}
+
+// 懒汉模式 局部静态变量法
+metrics* metrics::getInstance() {
+    static metrics inst;
+    return &inst;
+}
+
+metrics::threadSlot* metrics::registerSlot_() {
+    // 每个线程第一次记录时领一个槽，之后只走thread_local指针；线程退出后槽不回收，计数保留
+    int idx = slotNum_.fetch_add(1, std::memory_order_relaxed);
+    if(idx < MAX_SLOTS) {
+        return &slots_[idx];
+    }
+    return nullptr;
+}
+
+void metrics::addRequest(int status) {
+    switch(status) {
+        case 200: add(REQ_200); break;
+        case 400: add(REQ_400); break;
+        case 403: add(REQ_403); break;
+        case 404: add(REQ_404); break;
+        case 503: add(REQ_503); break;
+        default: add(REQ_OTHER); break;
+    }
+}
+
+void metrics::addGauge(const std::string& name, const std::string& help, const gaugeFunc& func, const char* type) {
+    std::lock_guard<std::mutex> locker(mtx_);
+    for(gauge& g : gauges_) { // 重复注册（如webServer重建）时替换回调
+        if(g.name == name) {
+            g.help = help;
+            g.type = type;
+            g.func = func;
+            return;
+        }
+    }
+    gauges_.push_back({name, help, type, func});
+}
+
+void metrics::removeGauge(const std::string& name) {
+    std::lock_guard<std::mutex> locker(mtx_);
+    for(auto it = gauges_.begin(); it != gauges_.end(); ++it) {
+        if(it->name == name) {
+            gauges_.erase(it);
+            return;
+        }
+    }
+}
+
+uint64_t metrics::value(COUNTER c) {
+    assert(c >= 0 && c < COUNTER_NUM);
+    int n = std::min(slotNum_.load(std::memory_order_relaxed), MAX_SLOTS);
+    uint64_t sum = overflow_[c].load(std::memory_order_relaxed);
+    for(int i = 0; i < n; i++) {
+        sum += slots_[i].counters[c].load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+std::string metrics::render() {
+    std::string out;
+    out.reserve(4096);
+    char buf[64];
+    const char* last = nullptr;
+    sharedStats* shared = sharedStats::getInstance(); // 预派生模式下输出所有worker的合计
+    bool cluster = shared->isAttached();
+    for(int c = 0; c < COUNTER_NUM; c++) {
+        const counterDesc& desc = COUNTER_DESC[c];
+        if(!last || strcmp(last, desc.name) != 0) { // 同名带标签的计数器只输出一次HELP/TYPE
+            appendHeader(out, desc.name, desc.help, "counter");
+            last = desc.name;
+        }
+        out += desc.name;
+        if(desc.label) {
+            out += '{';
+            out += desc.label;
+            out += '}';
+        }
+        snprintf(buf, sizeof(buf), " %llu\n", static_cast<unsigned long long>(
+                 cluster ? shared->total(static_cast<COUNTER>(c)) : value(static_cast<COUNTER>(c))));
+        out += buf;
+    }
+
+    std::lock_guard<std::mutex> locker(mtx_);
+    for(const gauge& g : gauges_) {
+        appendHeader(out, g.name.c_str(), g.help.c_str(), g.type.c_str());
+        snprintf(buf, sizeof(buf), " %.17g\n", g.func());
+        out += g.name;
+        out += buf;
+    }
+    latencyTracker::getInstance()->render(out);
+    return out;
+}
@@ -0,0 +1,95 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <stdint.h>
+
+// 指标子系统：计数器按线程分槽，每个槽独占缓存行，记录时只读写本线程的槽（relaxed load + store，
+// 没有锁也没有带lock前缀的原子指令）；抓取时把所有槽相加，再加上注册的瞬时值（gauge）回调，
+// 输出 Prometheus 文本格式
+class metrics {
+public:
+    enum COUNTER {
+        CONN_ACCEPTED = 0,
+        CONN_CLOSED,
+        BYTES_IN,
+        BYTES_OUT,
+        REQ_200,            // 按响应状态码统计的请求数
+        REQ_400,
+        REQ_403,
+        REQ_404,
+        REQ_503,
+        REQ_OTHER,
+        TASKS,              // 线程池执行的任务数
+        TASK_WAIT_US,       // 任务在队列中等待的累计时间
+        TIMER_EXPIRED,      // 定时器到期触发的次数（超时关闭的连接）
+        SHED_REQUEST,       // 过载时以503拒绝的请求
+        SHED_CONN,          // 连接数达到上限时以503拒绝的连接
+        ACCEPT_PAUSE,       // 过载时暂停accept的次数
+        INLINE_TASK,        // 过载时在事件循环内直接执行、未进线程池的任务
+        LIMITED_CONN,       // 按客户端地址限速拒绝的连接
+        LIMITED_REQ,        // 按客户端地址限速拒绝的请求
+        LIMITED_AUTH,       // 按客户端地址限速拒绝的登录/注册
+        WRITE_YIELD,        // 写满配额/时间片后让出工作线程的次数
+        FILE_PREFETCH,      // 响应文件不在页缓存中、交给文件I/O线程预读的次数
+        FILE_PREFETCH_BYTES,
+        FILE_PREFETCH_FAILED,   // 预读失败（文件被删除、截断等），该响应不再预读，直接写
+        COUNTER_NUM,
+    };
+
+    typedef std::function<double()> gaugeFunc;
+
+    static metrics* getInstance();
+
+    static void add(COUNTER c, uint64_t n = 1) {
+        threadSlot* slot = localSlot_();
+        if(slot) {
+            std::atomic<uint64_t>& v = slot->counters[c];
+            v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); // 本槽只有本线程写
+        } else {
+            getInstance()->overflow_[c].fetch_add(n, std::memory_order_relaxed);
+        }
+    }
+    static void addRequest(int status);
+
+    // 启动时注册瞬时值，抓取时调用；type为 "gauge" 或 "counter"（回调返回累计值时）
+    void addGauge(const std::string& name, const std::string& help, const gaugeFunc& func,
+                  const char* type = "gauge");
+    void removeGauge(const std::string& name);     // 回调引用的对象销毁前注销
+    uint64_t value(COUNTER c);
+    std::string render();
+
+private:
+    static const int MAX_SLOTS = 256;   // 超出的线程共用overflow_，改用原子加
+
+    struct alignas(64) threadSlot {
+        std::atomic<uint64_t> counters[COUNTER_NUM];
+    };
+    struct gauge {
+        std::string name;
+        std::string help;
+        std::string type;
+        gaugeFunc func;
+    };
+
+    metrics();
+    ~metrics() = default;
+
+    static threadSlot* localSlot_() {
+        static thread_local threadSlot* slot = getInstance()->registerSlot_(); // 每个线程只注册一次
+        return slot;
+    }
+    threadSlot* registerSlot_();                   // 槽用完时返回nullptr
+
+    threadSlot slots_[MAX_SLOTS];
+    std::atomic<int> slotNum_;
+    std::atomic<uint64_t> overflow_[COUNTER_NUM];  // 超出MAX_SLOTS的线程写这里
+    std::mutex mtx_;                                // 只保护gauges_
+    std::vector<gauge> gauges_;
+};
+
+#endif
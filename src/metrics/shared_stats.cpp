@@ -0,0 +1,131 @@
+#include "shared_stats.h"
+#include <new>
+#include <chrono>
+#include <assert.h>
+
+const int sharedStats::MAX_WORKERS;
+
+sharedStats::sharedStats() : slots_(nullptr), workerNum_(0), self_(-1), stop_(false) {
+    for(int c = 0; c < metrics::COUNTER_NUM; c++) {
+        base_[c] = 0;
+    }
+}
+
+sharedStats::~sharedStats() {
+    stop_ = true;
+    if(thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+// 懒汉模式 局部静态变量法
+sharedStats* sharedStats::getInstance() {
+    static sharedStats inst;
+    return &inst;
+}
+
+bool sharedStats::init(int workers) {
+    assert(workers > 0 && workers <= MAX_WORKERS && !slots_);
+    static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "cross-process counters need lock-free 64-bit atomics");
+    void* addr = mmap(nullptr, sizeof(workerSlot) * workers, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(addr == MAP_FAILED) {
+        return false;
+    }
+    slots_ = static_cast<workerSlot*>(addr);
+    for(int i = 0; i < workers; i++) {
+        new (&slots_[i]) workerSlot(); // 值初始化，计数从0开始
+    }
+    workerNum_ = workers;
+    return true;
+}
+
+void sharedStats::attach(int worker, int publishMS) {
+    assert(slots_ && worker >= 0 && worker < workerNum_ && self_ < 0);
+    self_ = worker;
+    for(int c = 0; c < metrics::COUNTER_NUM; c++) {
+        base_[c] = slots_[worker].counters[c].load(std::memory_order_relaxed);
+    }
+    metrics* m = metrics::getInstance();
+    m->addGauge("webserver_prefork_workers_alive", "Worker processes currently running.",
+                [this]() { return static_cast<double>(aliveWorkers()); });
+    m->addGauge("webserver_prefork_worker_restarts_total", "Worker processes restarted by the master.",
+                [this]() { return static_cast<double>(restarts()); }, "counter");
+    m->addGauge("webserver_prefork_connections_active", "Open client connections across all workers.",
+                [this]() { return static_cast<double>(connections()); });
+    thread_ = std::thread(&sharedStats::publisher_, this, publishMS);
+}
+
+void sharedStats::publisher_(int publishMS) {
+    while(!stop_.load(std::memory_order_relaxed)) {
+        publish();
+        // 分段睡眠，进程退出时不必等满一个周期
+        for(int slept = 0; slept < publishMS && !stop_.load(std::memory_order_relaxed); slept += 50) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+    }
+    publish();
+}
+
+void sharedStats::publish() {
+    if(self_ < 0) {
+        return;
+    }
+    metrics* m = metrics::getInstance();
+    workerSlot& slot = slots_[self_];
+    for(int c = 0; c < metrics::COUNTER_NUM; c++) {
+        slot.counters[c].store(base_[c] + m->value(static_cast<metrics::COUNTER>(c)), std::memory_order_relaxed);
+    }
+    int64_t conns = static_cast<int64_t>(m->value(metrics::CONN_ACCEPTED)) -
+                    static_cast<int64_t>(m->value(metrics::CONN_CLOSED));
+    slot.connections.store(conns, std::memory_order_relaxed);
+}
+
+void sharedStats::workerStarted(int worker, pid_t pid) {
+    assert(slots_ && worker >= 0 && worker < workerNum_);
+    slots_[worker].pid.store(pid, std::memory_order_relaxed);
+    slots_[worker].starts.fetch_add(1, std::memory_order_relaxed);
+}
+
+void sharedStats::workerExited(int worker) {
+    assert(slots_ && worker >= 0 && worker < workerNum_);
+    slots_[worker].pid.store(0, std::memory_order_relaxed);
+    slots_[worker].connections.store(0, std::memory_order_relaxed); // 进程退出时连接已被内核关闭
+}
+
+int sharedStats::aliveWorkers() {
+    int alive = 0;
+    for(int i = 0; i < workerNum_; i++) {
+        alive += slots_[i].pid.load(std::memory_order_relaxed) > 0 ? 1 : 0;
+    }
+    return alive;
+}
+
+uint64_t sharedStats::restarts() {
+    uint64_t sum = 0;
+    for(int i = 0; i < workerNum_; i++) {
+        uint32_t starts = slots_[i].starts.load(std::memory_order_relaxed);
+        sum += starts > 1 ? starts - 1 : 0;
+    }
+    return sum;
+}
+
+int64_t sharedStats::connections() {
+    int64_t sum = 0;
+    for(int i = 0; i < workerNum_; i++) {
+        sum += slots_[i].connections.load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+uint64_t sharedStats::total(metrics::COUNTER c) {
+    uint64_t sum = 0;
+    for(int i = 0; i < workerNum_; i++) {
+        if(i == self_) {
+            sum += base_[c] + metrics::getInstance()->value(c);
+        } else {
+            sum += slots_[i].counters[c].load(std::memory_order_relaxed);
+        }
+    }
+    return sum;
+}
@@ -0,0 +1,54 @@
+#ifndef SHARED_STATS_H
+#define SHARED_STATS_H
+
+#include <atomic>
+#include <thread>
+#include <string>
+#include <sys/mman.h>       // mmap
+#include <sys/types.h>
+#include "metrics.h"
+
+// 预派生多进程模式下的计数器汇总：master在fork前用匿名共享映射分配，每个worker一个槽。
+// worker的后台线程定期把本进程的metrics计数器发布到自己的槽；worker崩溃重启后从槽里原来的值接着累加，
+// 所以各槽和总数都是单调的，Prometheus不会误判为计数器重置。
+// 任一worker的 /metrics 输出全体worker的计数器之和（本进程用实时值，其余用最近一次发布的值）
+class sharedStats {
+public:
+    static const int MAX_WORKERS = 256;
+
+    static sharedStats* getInstance();
+
+    bool init(int workers);                 // master，fork之前调用
+    void attach(int worker, int publishMS); // worker进程启动时调用，启动发布线程
+    void publish();                         // 把本进程的计数器写入自己的槽
+    void workerStarted(int worker, pid_t pid);  // master：fork出worker后
+    void workerExited(int worker);              // master：回收worker后，连接数清零
+
+    bool isAttached() const { return self_ >= 0; }
+    int workerNum() const { return workerNum_; }
+    int aliveWorkers();
+    uint64_t restarts();
+    int64_t connections();                  // 各worker当前连接数之和
+    uint64_t total(metrics::COUNTER c);     // 各worker计数器之和
+
+private:
+    struct alignas(64) workerSlot {
+        std::atomic<int> pid;                   // 0表示未运行
+        std::atomic<uint32_t> starts;           // 启动次数，大于1说明重启过
+        std::atomic<int64_t> connections;
+        std::atomic<uint64_t> counters[metrics::COUNTER_NUM];
+    };
+
+    sharedStats();
+    ~sharedStats();
+    void publisher_(int publishMS);
+
+    workerSlot* slots_;     // 共享映射，多进程间用无锁原子读写
+    int workerNum_;
+    int self_;              // 本进程的槽，master为-1
+    uint64_t base_[metrics::COUNTER_NUM];   // attach时槽里已有的值（上一个同号worker留下的）
+    std::atomic<bool> stop_;
+    std::thread thread_;
+};
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef USDT_H
+#define USDT_H
+
+// USDT 静态探针（provider 为 webserver）。编译时定义 WEBSERVER_USDT 且系统有 sys/sdt.h 时展开为
+// DTRACE_PROBE，未挂载时每个探针只是一条nop（参数仍会求值，所以只传手头已有的值）；否则整个宏展开为空。
+// 挂载方式见 tools/bpftrace/ 下的脚本，例如：
+//   bpftrace -l 'usdt:./build/server:webserver:*'
+//
+// 探针及参数：
+//   conn_accept(fd, ipv4)               webServer::dealListen_ accept成功
+//   task_enqueue(queueLen)              threadPool::addTask 入队后的队列长度
+//   task_dequeue(waitUs)                工作线程取到任务，参数为排队时间
+//   parse_start(bytes)                  httpRequest::parse 开始，缓冲区可读字节数
+//   parse_end(ok, path)                 httpRequest::parse 结束
+//   response_build(fd, code, bytes)     httpConn 生成响应，bytes为响应头+文件总长
+//   conn_write(fd, bytes)               httpConn::write 每次writev写出的字节数
+//   write_done(fd, bytes)               响应最后一个字节写出
+//   timer_expire(id)                    heapTimer::tick 定时器到期
+//   sql_checkout(conn, waitUs)          sqlConnPool::getConn 借出连接，waitUs为借出耗时
+//   sql_return(conn)                    sqlConnPool::freeConn 归还连接
+#if defined(WEBSERVER_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define WS_USDT_ENABLED 1
+#endif
+#endif
+
+#ifdef WS_USDT_ENABLED
+#define WS_PROBE0(name) DTRACE_PROBE(webserver, name)
+#define WS_PROBE1(name, a1) DTRACE_PROBE1(webserver, name, a1)
+#define WS_PROBE2(name, a1, a2) DTRACE_PROBE2(webserver, name, a1, a2)
+#define WS_PROBE3(name, a1, a2, a3) DTRACE_PROBE3(webserver, name, a1, a2, a3)
+#else
+#define WS_PROBE0(name) do {} while(0)
+#define WS_PROBE1(name, a1) do {} while(0)
+#define WS_PROBE2(name, a1, a2) do {} while(0)
+#define WS_PROBE3(name, a1, a2, a3) do {} while(0)
+#endif
+
+#endif
@@ -0,0 +1,555 @@
+#define LOG_MODULE Log::MODULE_POOL
+#include "async_sqlconn.h"
+#include <mysql/errmsg.h>   // CR_SERVER_GONE_ERROR
+#include <sys/socket.h>     // shutdown
+
+#ifdef ASYNC_SQL_MARIADB
+// MYSQL_WAIT_* 与 epoll 事件互相转换
+static uint32_t waitToEpoll(int status) {
+    uint32_t events = 0;
+    if(status & MYSQL_WAIT_READ) { events |= EPOLLIN; }
+    if(status & MYSQL_WAIT_WRITE) { events |= EPOLLOUT; }
+    if(status & MYSQL_WAIT_EXCEPT) { events |= EPOLLPRI; }
+    if(status && !events) { events = EPOLLIN; } // 只等超时的情况，交给连接本身的读超时处理
+    return events;
+}
+
+static int epollToWait(uint32_t events, int waitStatus) {
+    int status = 0;
+    if(events & EPOLLIN) { status |= MYSQL_WAIT_READ; }
+    if(events & EPOLLOUT) { status |= MYSQL_WAIT_WRITE; }
+    if(events & EPOLLPRI) { status |= MYSQL_WAIT_EXCEPT; }
+    if(events & (EPOLLERR | EPOLLHUP)) { // 出错时把等待的方向都交还给客户端库，由它读出错误
+        status |= waitStatus & (MYSQL_WAIT_READ | MYSQL_WAIT_WRITE);
+    }
+    return status;
+}
+#endif
+
+asyncSqlConn::asyncSqlConn() {
+    conn_ = nullptr;
+    res_ = nullptr;
+    state_ = BROKEN;
+    ok_ = false;
+    port_ = 0;
+#ifdef ASYNC_SQL_MARIADB
+    waitStatus_ = 0;
+#endif
+}
+
+asyncSqlConn::~asyncSqlConn() {
+    if(res_) { mysql_free_result(res_); }
+    if(conn_) { mysql_close(conn_); }
+}
+
+void asyncSqlConn::initHandle_() {
+    if(conn_) { mysql_close(conn_); }
+    conn_ = mysql_init(nullptr);
+    assert(conn_);
+#ifdef ASYNC_SQL_MARIADB
+    mysql_options(conn_, MYSQL_OPT_NONBLOCK, 0);
+#endif
+}
+
+bool asyncSqlConn::connect(const char* host, int port, const char* user,
+                           const char* pwd, const char* dbName) {
+    host_ = host;
+    user_ = user;
+    pwd_ = pwd;
+    dbName_ = dbName;
+    port_ = port;
+    initHandle_();
+    if(!mysql_real_connect(conn_, host, user, pwd, dbName, port, nullptr, 0)) {
+        LOG_ERROR("MySQL async connect error: %s", mysql_error(conn_));
+        state_ = BROKEN;
+        return false;
+    }
+    state_ = IDLE;
+    return true;
+}
+
+int asyncSqlConn::fd() const {
+    if(!conn_) { return -1; }
+#ifdef ASYNC_SQL_MARIADB
+    return mysql_get_socket(conn_);
+#else
+    return conn_->net.fd;
+#endif
+}
+
+MYSQL_RES* asyncSqlConn::takeResult() {
+    MYSQL_RES* res = res_;
+    res_ = nullptr;
+    return res;
+}
+
+uint32_t asyncSqlConn::reconnectStart() {
+    initHandle_();
+    state_ = CONNECTING;
+    ok_ = false;
+    uint32_t events = connectStart_();
+    if(!events) { state_ = ok_ ? IDLE : BROKEN; }
+    return events;
+}
+
+uint32_t asyncSqlConn::start(const std::string& sql) {
+    assert(state_ == IDLE);
+    sql_ = sql;
+    ok_ = false;
+    state_ = QUERYING;
+    uint32_t events = queryStart_();
+    return events ? events : afterQuery_();
+}
+
+uint32_t asyncSqlConn::onEvent(uint32_t events) {
+    uint32_t wait = 0;
+    switch(state_) {
+        case CONNECTING:
+            wait = connectCont_(events);
+            if(!wait) { state_ = ok_ ? IDLE : BROKEN; }
+            break;
+        case QUERYING:
+            wait = queryCont_(events);
+            if(!wait) { wait = afterQuery_(); }
+            break;
+        case STORING:
+            wait = storeCont_(events);
+            if(!wait) { state_ = IDLE; }
+            break;
+        default:
+            break;
+    }
+    return wait;
+}
+
+// 超时放弃查询：先关闭socket，之后重连时mysql_close不会卡在未读完的应答上
+void asyncSqlConn::abort() {
+    int sock = fd();
+    if(sock >= 0) { ::shutdown(sock, SHUT_RDWR); }
+    if(res_) {
+        mysql_free_result(res_);
+        res_ = nullptr;
+    }
+    ok_ = false;
+    state_ = BROKEN;
+}
+
+// 查询语句已发送并收到应答，失败则结束，成功则继续取结果集
+uint32_t asyncSqlConn::afterQuery_() {
+    if(!ok_) {
+        unsigned int err = mysql_errno(conn_);
+        LOG_ERROR("MySQL async query error: %s", mysql_error(conn_));
+        state_ = (err == CR_SERVER_GONE_ERROR || err == CR_SERVER_LOST) ? BROKEN : IDLE;
+        return 0;
+    }
+    state_ = STORING;
+    uint32_t events = storeStart_();
+    if(!events) { state_ = IDLE; }
+    return events;
+}
+
+#ifdef ASYNC_SQL_MARIADB
+
+uint32_t asyncSqlConn::connectStart_() {
+    MYSQL* ret = nullptr;
+    waitStatus_ = mysql_real_connect_start(&ret, conn_, host_.c_str(), user_.c_str(), pwd_.c_str(),
+                                           dbName_.c_str(), port_, nullptr, 0);
+    if(!waitStatus_) { ok_ = (ret != nullptr); }
+    return waitToEpoll(waitStatus_);
+}
+
+uint32_t asyncSqlConn::connectCont_(uint32_t events) {
+    MYSQL* ret = nullptr;
+    waitStatus_ = mysql_real_connect_cont(&ret, conn_, epollToWait(events, waitStatus_));
+    if(!waitStatus_) { ok_ = (ret != nullptr); }
+    return waitToEpoll(waitStatus_);
+}
+
+uint32_t asyncSqlConn::queryStart_() {
+    int ret = 0;
+    waitStatus_ = mysql_real_query_start(&ret, conn_, sql_.c_str(), sql_.size());
+    if(!waitStatus_) { ok_ = (ret == 0); }
+    return waitToEpoll(waitStatus_);
+}
+
+uint32_t asyncSqlConn::queryCont_(uint32_t events) {
+    int ret = 0;
+    waitStatus_ = mysql_real_query_cont(&ret, conn_, epollToWait(events, waitStatus_));
+    if(!waitStatus_) { ok_ = (ret == 0); }
+    return waitToEpoll(waitStatus_);
+}
+
+uint32_t asyncSqlConn::storeStart_() {
+    waitStatus_ = mysql_store_result_start(&res_, conn_);
+    if(!waitStatus_) { ok_ = (res_ != nullptr || mysql_field_count(conn_) == 0); }
+    return waitToEpoll(waitStatus_);
+}
+
+uint32_t asyncSqlConn::storeCont_(uint32_t events) {
+    waitStatus_ = mysql_store_result_cont(&res_, conn_, epollToWait(events, waitStatus_));
+    if(!waitStatus_) { ok_ = (res_ != nullptr || mysql_field_count(conn_) == 0); }
+    return waitToEpoll(waitStatus_);
+}
+
+#else
+
+// libmysqlclient 的非阻塞接口不区分读写方向，未完成时等可读后再次调用同一个函数
+uint32_t asyncSqlConn::connectStart_() {
+    return connectCont_(0);
+}
+
+uint32_t asyncSqlConn::connectCont_(uint32_t) {
+    net_async_status status = mysql_real_connect_nonblocking(conn_, host_.c_str(), user_.c_str(), pwd_.c_str(),
+                                                             dbName_.c_str(), port_, nullptr, 0);
+    if(status == NET_ASYNC_NOT_READY) { return EPOLLIN; }
+    ok_ = (status == NET_ASYNC_COMPLETE);
+    return 0;
+}
+
+uint32_t asyncSqlConn::queryStart_() {
+    return queryCont_(0);
+}
+
+uint32_t asyncSqlConn::queryCont_(uint32_t) {
+    net_async_status status = mysql_real_query_nonblocking(conn_, sql_.c_str(), sql_.size());
+    if(status == NET_ASYNC_NOT_READY) { return EPOLLIN; }
+    ok_ = (status == NET_ASYNC_COMPLETE);
+    return 0;
+}
+
+uint32_t asyncSqlConn::storeStart_() {
+    return storeCont_(0);
+}
+
+uint32_t asyncSqlConn::storeCont_(uint32_t) {
+    net_async_status status = mysql_store_result_nonblocking(conn_, &res_);
+    if(status == NET_ASYNC_NOT_READY) { return EPOLLIN; }
+    ok_ = (status == NET_ASYNC_COMPLETE && (res_ != nullptr || mysql_field_count(conn_) == 0));
+    return 0;
+}
+
+#endif
+
+asyncSqlClient::asyncSqlClient() {
+    epoller_ = nullptr;
+    eventFd_ = -1;
+    timerFd_ = -1;
+    queryTimeoutMS_ = 0;
+    timerAt_ = std::chrono::steady_clock::time_point::max();
+}
+
+asyncSqlClient::~asyncSqlClient() {
+    close();
+}
+
+bool asyncSqlClient::init(Epoller* epoller, const char* host, int port,
+                          const char* user, const char* pwd,
+                          const char* dbName, int connSize, int queryTimeoutMS) {
+    assert(epoller && connSize > 0 && queryTimeoutMS >= 0);
+    epoller_ = epoller;
+    eventFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(eventFd_ < 0 || !epoller_->addFd(eventFd_, EPOLLIN)) {
+        LOG_ERROR("Async sql eventfd error!");
+        return false;
+    }
+    queryTimeoutMS_ = queryTimeoutMS;
+    if(queryTimeoutMS_ > 0) {
+        timerFd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if(timerFd_ < 0 || !epoller_->addFd(timerFd_, EPOLLIN)) {
+            LOG_ERROR("Async sql timerfd error!");
+            return false;
+        }
+    }
+    int alive = 0;
+    for(int i = 0; i < connSize; i++) {
+        std::unique_ptr<asyncSqlConn> conn(new asyncSqlConn());
+        if(conn->connect(host, port, user, pwd, dbName)) {
+            registerFd_(conn.get());
+            idle_.push_back(conn.get());
+            alive++;
+        }
+        conns_.push_back(std::move(conn));
+    }
+    LOG_INFO("Async sql connections: %d/%d", alive, connSize);
+    return alive > 0;
+}
+
+void asyncSqlClient::close() {
+    for(auto& conn : conns_) {
+        if(conn->fd() >= 0) { epoller_->delFd(conn->fd()); }
+    }
+    conns_.clear();
+    fdConn_.clear();
+    running_.clear();
+    idle_.clear();
+    pending_.clear();
+    if(eventFd_ >= 0) {
+        epoller_->delFd(eventFd_);
+        ::close(eventFd_);
+        eventFd_ = -1;
+    }
+    if(timerFd_ >= 0) {
+        epoller_->delFd(timerFd_);
+        ::close(timerFd_);
+        timerFd_ = -1;
+    }
+    timerAt_ = std::chrono::steady_clock::time_point::max();
+}
+
+void asyncSqlClient::query(const sqlStatement& stmt, const queryCallBack& cb) {
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        auto deadline = queryTimeoutMS_ > 0 ? std::chrono::steady_clock::now() + std::chrono::milliseconds(queryTimeoutMS_)
+                                            : std::chrono::steady_clock::time_point::max();
+        submitted_.push_back({stmt, cb, deadline});
+    }
+    uint64_t one = 1;
+    ssize_t ret = write(eventFd_, &one, sizeof(one)); // 唤醒事件循环
+    (void)ret;
+}
+
+bool asyncSqlClient::bind_(MYSQL* conn, const sqlStatement& stmt, std::string* out) {
+    out->clear();
+    size_t next = 0;
+    for(char ch : stmt.sql) {
+        if(ch != '?') {
+            out->push_back(ch);
+            continue;
+        }
+        if(next >= stmt.params.size()) {
+            return false;
+        }
+        const std::string& value = stmt.params[next++];
+        std::string buf(value.size() * 2 + 1, '\0');
+#ifdef ASYNC_SQL_MARIADB
+        // Connector/C 按连接的字符集转义，服务端处于NO_BACKSLASH_ESCAPES时（连接状态中可见）改为双写引号
+        unsigned long len = mysql_real_escape_string(conn, &buf[0], value.data(), value.size());
+#else
+        // libmysqlclient 在NO_BACKSLASH_ESCAPES下拒绝 mysql_real_escape_string，_quote 版本按给定引号处理
+        unsigned long len = mysql_real_escape_string_quote(conn, &buf[0], value.data(), value.size(), '\'');
+#endif
+        if(len == static_cast<unsigned long>(-1)) {
+            return false;
+        }
+        out->push_back('\'');
+        out->append(buf, 0, len);
+        out->push_back('\'');
+    }
+    return next == stmt.params.size();
+}
+
+bool asyncSqlClient::start_(asyncSqlConn* conn, const sqlStatement& stmt) {
+    std::string sql;
+    if(!bind_(conn->conn(), stmt, &sql)) {
+        LOG_ERROR("Async sql bind error: %s", stmt.sql.c_str());
+        return false;
+    }
+    uint32_t wait = conn->start(sql);
+    if(wait) {
+        wait_(conn, wait);
+    } else {
+        finish_(conn);
+    }
+    return true;
+}
+
+void asyncSqlClient::handleEvent(int fd, uint32_t events) {
+    if(fd == eventFd_) {
+        uint64_t cnt = 0;
+        ssize_t ret = read(eventFd_, &cnt, sizeof(cnt));
+        (void)ret;
+        drainSubmitted_();
+        dispatch_();
+        return;
+    }
+    if(fd == timerFd_) {
+        uint64_t cnt = 0;
+        ssize_t ret = read(timerFd_, &cnt, sizeof(cnt));
+        (void)ret;
+        timerAt_ = std::chrono::steady_clock::time_point::max();
+        expire_();
+        return;
+    }
+    auto it = fdConn_.find(fd);
+    if(it == fdConn_.end()) { return; }
+    asyncSqlConn* conn = it->second;
+    if(conn->state() == asyncSqlConn::IDLE || conn->state() == asyncSqlConn::BROKEN) {
+        // 空闲连接上出现事件只可能是服务端断开
+        LOG_WARN("Async sql connection[%d] closed by server", fd);
+        for(auto iter = idle_.begin(); iter != idle_.end(); ++iter) {
+            if(*iter == conn) {
+                idle_.erase(iter);
+                break;
+            }
+        }
+        markBroken_(conn);
+        return;
+    }
+    uint32_t wait = conn->onEvent(events);
+    if(wait) {
+        wait_(conn, wait);
+    } else {
+        finish_(conn);
+    }
+}
+
+void asyncSqlClient::drainSubmitted_() {
+    std::vector<job> jobs;
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        jobs.swap(submitted_);
+    }
+    for(auto& j : jobs) {
+        if(j.deadline < timerAt_) {
+            armTimer_(j.deadline);
+        }
+        pending_.push_back(std::move(j));
+    }
+}
+
+void asyncSqlClient::dispatch_() {
+    while(!pending_.empty() && !idle_.empty()) {
+        asyncSqlConn* conn = idle_.front();
+        idle_.pop_front();
+        job& j = running_[conn];
+        j = std::move(pending_.front());
+        pending_.pop_front();
+        if(!start_(conn, j.stmt)) { // 参数无法绑定：请求失败，连接放回空闲队列
+            queryCallBack cb = std::move(j.cb);
+            running_.erase(conn);
+            idle_.push_front(conn);
+            cb(nullptr, QUERY_ERROR);
+        }
+    }
+    if(!pending_.empty() && idle_.empty() && running_.empty()) {
+        // 没有任何可用连接：尝试重连一个断开的连接，仍然全部不可用则直接让等待的请求失败
+        auto now = std::chrono::steady_clock::now();
+        if(now - lastReconnect_ > std::chrono::seconds(1)) { // 限制重连频率，避免数据库宕机时空转
+            lastReconnect_ = now;
+            for(auto& conn : conns_) {
+                if(conn->state() == asyncSqlConn::BROKEN) { markBroken_(conn.get()); }
+            }
+        }
+        bool connecting = !idle_.empty();
+        for(auto& conn : conns_) {
+            if(conn->state() == asyncSqlConn::CONNECTING) { connecting = true; }
+        }
+        if(!connecting) {
+            LOG_ERROR("Async sql has no available connection!");
+            std::deque<job> failed;
+            failed.swap(pending_);
+            for(auto& j : failed) {
+                j.cb(nullptr, QUERY_UNAVAILABLE);
+            }
+        }
+    }
+}
+
+void asyncSqlClient::wait_(asyncSqlConn* conn, uint32_t events) {
+    epoller_->modFd(conn->fd(), events | EPOLLONESHOT);
+}
+
+void asyncSqlClient::finish_(asyncSqlConn* conn) {
+    auto it = running_.find(conn);
+    if(it == running_.end()) { // 重连结束
+        if(conn->state() == asyncSqlConn::IDLE) {
+            LOG_INFO("Async sql connection[%d] reconnected", conn->fd());
+            idle_.push_back(conn);
+        } else {
+            LOG_ERROR("Async sql reconnect error!");
+        }
+        dispatch_();
+        return;
+    }
+    MYSQL_RES* res = conn->takeResult();
+    QUERY_RESULT result = conn->ok() ? QUERY_OK : (conn->state() == asyncSqlConn::BROKEN ? QUERY_UNAVAILABLE : QUERY_ERROR);
+    sqlStatement next = it->second.cb(res, result);
+    if(res) { mysql_free_result(res); }
+
+    if(!next.sql.empty() && conn->state() == asyncSqlConn::IDLE) { // 在同一连接上执行后续语句
+        it->second.stmt = next;
+        if(start_(conn, it->second.stmt)) {
+            return;
+        }
+    }
+    if(!next.sql.empty()) { // 连接已断开或参数无法绑定，后续语句无法执行
+        it->second.cb(nullptr, conn->state() == asyncSqlConn::IDLE ? QUERY_ERROR : QUERY_UNAVAILABLE);
+    }
+    running_.erase(it);
+    if(conn->state() == asyncSqlConn::BROKEN) {
+        markBroken_(conn);
+    } else {
+        idle_.push_back(conn);
+        dispatch_();
+    }
+}
+
+void asyncSqlClient::markBroken_(asyncSqlConn* conn) {
+    int oldFd = conn->fd();
+    if(oldFd >= 0) {
+        epoller_->delFd(oldFd);
+        fdConn_.erase(oldFd);
+    }
+    uint32_t wait = conn->reconnectStart();
+    registerFd_(conn);
+    if(wait) {
+        wait_(conn, wait);
+    } else {
+        finish_(conn);
+    }
+}
+
+// 连接的socket以EPOLLONESHOT方式注册，只在等待结果时才打开需要的事件
+void asyncSqlClient::registerFd_(asyncSqlConn* conn) {
+    int fd = conn->fd();
+    if(fd < 0) { return; }
+    fdConn_[fd] = conn;
+    epoller_->addFd(fd, EPOLLONESHOT);
+}
+
+void asyncSqlClient::expire_() {
+    auto now = std::chrono::steady_clock::now();
+    auto next = std::chrono::steady_clock::time_point::max();
+    std::deque<job> expired;
+    for(auto it = pending_.begin(); it != pending_.end(); ) {
+        if(it->deadline <= now) {
+            expired.push_back(std::move(*it));
+            it = pending_.erase(it);
+        } else {
+            next = std::min(next, it->deadline);
+            ++it;
+        }
+    }
+    // 执行中的查询无法撤回：放弃该连接并重连，请求按不可用结束
+    std::vector<asyncSqlConn*> stuck;
+    for(auto& it : running_) {
+        if(it.second.deadline <= now) {
+            stuck.push_back(it.first);
+        } else {
+            next = std::min(next, it.second.deadline);
+        }
+    }
+    for(asyncSqlConn* conn : stuck) {
+        expired.push_back(std::move(running_[conn]));
+        running_.erase(conn);
+        LOG_WARN("Async sql query timeout on connection[%d]", conn->fd());
+        conn->abort();
+        markBroken_(conn);
+    }
+    if(next != std::chrono::steady_clock::time_point::max()) {
+        armTimer_(next);
+    }
+    for(auto& j : expired) {
+        j.cb(nullptr, QUERY_UNAVAILABLE);
+    }
+}
+
+void asyncSqlClient::armTimer_(std::chrono::steady_clock::time_point when) {
+    timerAt_ = when;
+    int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(when - std::chrono::steady_clock::now()).count();
+    struct itimerspec spec = {};
+    ns = std::max<int64_t>(ns, 1000); // 全0会停止定时器
+    spec.it_value.tv_sec = ns / 1000000000;
+    spec.it_value.tv_nsec = ns % 1000000000;
+    timerfd_settime(timerFd_, 0, &spec, nullptr);
+}
@@ -0,0 +1,142 @@
+#ifndef ASYNC_SQLCONN_H
+#define ASYNC_SQLCONN_H
+
+#include <mysql/mysql.h>
+#include <string>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <chrono>
+#include <unordered_map>
+#include <sys/eventfd.h>    // eventfd
+#include <sys/timerfd.h>    // timerfd
+#include "../log/log.h"
+#include "../server/epoller.h"
+
+// MariaDB Connector/C 提供 *_start/*_cont 非阻塞接口并告知等待的读写方向；
+// MySQL 8.0.16+ 的 libmysqlclient 提供 *_nonblocking 接口，只能等可读后重试
+#if defined(LIBMARIADB) || defined(MARIADB_BASE_VERSION)
+#define ASYNC_SQL_MARIADB 1
+#endif
+
+// 单个非阻塞MySQL连接的状态机：发起查询后返回需要等待的epoll事件，事件到来后继续推进，
+// 返回0表示本次查询（包括取结果集）已完成
+class asyncSqlConn {
+public:
+    enum STATE {
+        IDLE,
+        CONNECTING,
+        QUERYING,
+        STORING,
+        BROKEN,
+    };
+
+    asyncSqlConn();
+    ~asyncSqlConn();
+
+    bool connect(const char* host, int port, const char* user,
+                 const char* pwd, const char* dbName);     // 阻塞连接，只在启动时使用
+    uint32_t reconnectStart();                              // 非阻塞重连
+    uint32_t start(const std::string& sql);
+    uint32_t onEvent(uint32_t events);
+    void abort();                                           // 放弃进行中的查询，关闭socket，连接变为BROKEN
+
+    int fd() const;
+    STATE state() const { return state_; }
+    bool ok() const { return ok_; }
+    MYSQL* conn() { return conn_; }
+    MYSQL_RES* takeResult();                                // 取走结果集，调用方负责释放
+
+private:
+    uint32_t connectStart_();
+    uint32_t connectCont_(uint32_t events);
+    uint32_t queryStart_();
+    uint32_t queryCont_(uint32_t events);
+    uint32_t storeStart_();
+    uint32_t storeCont_(uint32_t events);
+    uint32_t afterQuery_();
+    void initHandle_();
+
+    MYSQL* conn_;
+    MYSQL_RES* res_;
+    STATE state_;
+    bool ok_;
+    std::string sql_;
+    std::string host_, user_, pwd_, dbName_;
+    int port_;
+#ifdef ASYNC_SQL_MARIADB
+    int waitStatus_;        // 上一次 *_start/_cont 返回的等待状态
+#endif
+};
+
+// 带占位符的语句：sql中的每个?依次替换为params中对应值的字符串字面量（sql的其余部分不能出现?）。
+// 绑定在派发时进行，用实际执行该语句的连接转义，按该连接协商的字符集和服务端的NO_BACKSLASH_ESCAPES
+struct sqlStatement {
+    std::string sql;
+    std::vector<std::string> params;
+};
+
+// 异步SQL客户端：连接的socket注册在webServer的Epoller中，由事件循环线程推进；
+// 工作线程通过query()提交查询（经eventfd唤醒事件循环），回调在事件循环线程执行
+class asyncSqlClient {
+public:
+    enum QUERY_RESULT {
+        QUERY_OK = 0,
+        QUERY_ERROR,            // 语句执行失败（如唯一键冲突）或参数无法绑定
+        QUERY_UNAVAILABLE,      // 没有可用连接、连接断开或超过查询期限
+    };
+    // 查询完成回调；返回sql非空的语句则在同一连接上继续执行，并再次回调（如注册的先查后插）
+    typedef std::function<sqlStatement(MYSQL_RES* res, QUERY_RESULT result)> queryCallBack;
+
+    asyncSqlClient();
+    ~asyncSqlClient();
+
+    bool init(Epoller* epoller, const char* host, int port,
+              const char* user, const char* pwd,
+              const char* dbName, int connSize,
+              int queryTimeoutMS = 0);  // 从提交起超过该时间（含排队和后续语句）仍未完成则按不可用结束，0不限
+    void close();
+
+    void query(const sqlStatement& stmt, const queryCallBack& cb); // 线程安全
+
+    bool ownsFd(int fd) const { return fd == eventFd_ || fd == timerFd_ || fdConn_.count(fd) > 0; }
+    void handleEvent(int fd, uint32_t events);                      // 事件循环线程调用
+
+private:
+    struct job {
+        sqlStatement stmt;
+        queryCallBack cb;
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    void drainSubmitted_();
+    void dispatch_();
+    bool start_(asyncSqlConn* conn, const sqlStatement& stmt);     // 绑定参数失败时返回false，连接未被使用
+    static bool bind_(MYSQL* conn, const sqlStatement& stmt, std::string* out);
+    void wait_(asyncSqlConn* conn, uint32_t events);
+    void finish_(asyncSqlConn* conn);
+    void markBroken_(asyncSqlConn* conn);
+    void registerFd_(asyncSqlConn* conn);
+    void expire_();                                                 // 超过期限的请求按不可用结束
+    void armTimer_(std::chrono::steady_clock::time_point when);
+
+
+    Epoller* epoller_;
+    int eventFd_;
+    int timerFd_;                                           // 查询期限，只在有请求可能超时时定时
+    int queryTimeoutMS_;
+    std::chrono::steady_clock::time_point timerAt_;        // 已设定的到期时间，max()表示未定时
+    std::vector<std::unique_ptr<asyncSqlConn>> conns_;
+    std::unordered_map<int, asyncSqlConn*> fdConn_;         // 以下成员只在事件循环线程访问
+    std::unordered_map<asyncSqlConn*, job> running_;
+    std::deque<asyncSqlConn*> idle_;
+    std::deque<job> pending_;
+    std::chrono::steady_clock::time_point lastReconnect_;
+
+    std::mutex mtx_;                                        // 保护跨线程提交的队列
+    std::vector<job> submitted_;
+};
+
+#endif
@@ -0,0 +1,51 @@
+#include "codel.h"
+#include <chrono>
+
+codelMonitor::codelMonitor()
+    : targetUs_(0), intervalUs_(100000), firstAboveUs_(0), lastSampleUs_(0), overloaded_(false), episodes_(0) {}
+
+int64_t codelMonitor::nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void codelMonitor::configure(int targetUs, int intervalUs) {
+    targetUs_.store(targetUs > 0 ? targetUs : 0, std::memory_order_relaxed);
+    intervalUs_.store(intervalUs > 0 ? intervalUs : 100000, std::memory_order_relaxed);
+    firstAboveUs_.store(0, std::memory_order_relaxed);
+    overloaded_.store(false, std::memory_order_relaxed);
+}
+
+void codelMonitor::onSample(uint64_t sojournUs, int64_t nowUs) {
+    int target = targetUs_.load(std::memory_order_relaxed);
+    if(target == 0) {
+        return;
+    }
+    lastSampleUs_.store(nowUs, std::memory_order_relaxed);
+    if(sojournUs < static_cast<uint64_t>(target)) {
+        // 多个工作线程并发采样，状态只是近似的，不影响判定的方向
+        firstAboveUs_.store(0, std::memory_order_relaxed);
+        overloaded_.store(false, std::memory_order_relaxed);
+        return;
+    }
+    int64_t first = firstAboveUs_.load(std::memory_order_relaxed);
+    if(first == 0) {
+        firstAboveUs_.compare_exchange_strong(first, nowUs, std::memory_order_relaxed);
+    } else if(nowUs - first >= intervalUs_.load(std::memory_order_relaxed) &&
+              !overloaded_.load(std::memory_order_relaxed) && !overloaded_.exchange(true)) {
+        episodes_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+bool codelMonitor::overloaded(int64_t nowUs) {
+    if(!overloaded_.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    // 过载期间新请求被拒绝，队列排空后就没有采样了：一个interval内没有出队视为已恢复
+    if(nowUs - lastSampleUs_.load(std::memory_order_relaxed) > intervalUs_.load(std::memory_order_relaxed)) {
+        firstAboveUs_.store(0, std::memory_order_relaxed);
+        overloaded_.store(false, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,34 @@
+#ifndef CODEL_H
+#define CODEL_H
+
+#include <atomic>
+#include <stdint.h>
+
+// 按任务排队时间（sojourn）判断线程池是否过载，思路同CoDel：
+// 排队时间偶尔超过目标值是正常的突发，只有在一个完整的interval内每个出队任务都超过目标（即区间内最小值也超过）才判定过载；
+// 出现一次低于目标的采样，或一个interval内没有任务出队（队列已空），即退出过载。
+// onSample由工作线程在取任务时调用，overloaded由事件循环在派发新请求前调用，都是无锁的
+class codelMonitor {
+public:
+    codelMonitor();
+
+    void configure(int targetUs, int intervalUs);   // targetUs为0时关闭，overloaded恒为false
+    void onSample(uint64_t sojournUs, int64_t nowUs);
+    bool overloaded(int64_t nowUs);
+
+    int targetUs() const { return targetUs_.load(std::memory_order_relaxed); }
+    int intervalUs() const { return intervalUs_.load(std::memory_order_relaxed); }
+    uint64_t episodes() const { return episodes_.load(std::memory_order_relaxed); }  // 进入过载的次数
+
+    static int64_t nowUs();     // steady_clock，微秒
+
+private:
+    std::atomic<int> targetUs_;
+    std::atomic<int> intervalUs_;
+    std::atomic<int64_t> firstAboveUs_;     // 连续超过目标的起始时刻，0表示最近一次采样低于目标
+    std::atomic<int64_t> lastSampleUs_;
+    std::atomic<bool> overloaded_;
+    std::atomic<uint64_t> episodes_;
+};
+
+#endif
@@ -0,0 +1,127 @@
+#define LOG_MODULE Log::MODULE_POOL
+#include "file_io_pool.h"
+#include <string.h>
+#include <errno.h>
+#include <algorithm>
+#include "../log/log.h"
+#include "../metrics/metrics.h"
+
+const size_t fileIOPool::CHUNK_SIZE;
+
+fileIOPool::fileIOPool() : epoller_(nullptr), eventFd_(-1), pending_(0), isClosed_(false) {}
+
+fileIOPool::~fileIOPool() {
+    close();
+}
+
+bool fileIOPool::init(Epoller* epoller, int threadNum) {
+    assert(epoller && threadNum > 0);
+    epoller_ = epoller;
+    eventFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(eventFd_ < 0 || !epoller_->addFd(eventFd_, EPOLLIN)) {
+        LOG_ERROR("File io eventfd error!");
+        return false;
+    }
+    for(int i = 0; i < threadNum; i++) {
+        threads_.emplace_back(&fileIOPool::worker_, this);
+    }
+    return true;
+}
+
+void fileIOPool::close() {
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        isClosed_ = true;
+        jobs_.clear();  // 未开始的读取直接丢弃，回调不再执行
+    }
+    cond_.notify_all();
+    for(std::thread& t : threads_) {
+        t.join();   // 正在读的线程读完当前请求后退出
+    }
+    threads_.clear();
+    done_.clear();
+    if(eventFd_ >= 0) {
+        epoller_->delFd(eventFd_);
+        ::close(eventFd_);
+        eventFd_ = -1;
+    }
+}
+
+void fileIOPool::read(const std::string& path, size_t offset, size_t len, const doneCallBack& cb) {
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        if(isClosed_) {
+            return;
+        }
+        jobs_.push_back({path, offset, len, cb, false});
+    }
+    pending_.fetch_add(1, std::memory_order_relaxed);
+    cond_.notify_one();
+}
+
+void fileIOPool::handleEvent(int fd, uint32_t events) {
+    uint64_t cnt = 0;
+    ssize_t ret = ::read(eventFd_, &cnt, sizeof(cnt));
+    (void)ret;
+    std::vector<job> done;
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        done.swap(done_);
+    }
+    pending_.fetch_sub(done.size(), std::memory_order_relaxed);
+    for(job& j : done) {
+        j.cb(j.ok);
+    }
+}
+
+void fileIOPool::worker_() {
+    std::unique_lock<std::mutex> locker(mtx_);
+    while(true) {
+        if(isClosed_) {
+            break;
+        } else if(!jobs_.empty()) {
+            job j = std::move(jobs_.front());
+            jobs_.pop_front();
+            locker.unlock();
+            j.ok = load_(j);    // 在这里阻塞在磁盘上，而不是在工作线程里
+            locker.lock();
+            bool wake = done_.empty();  // 事件循环还没取走上一批时不必再写eventfd
+            done_.push_back(std::move(j));
+            if(wake) {
+                uint64_t one = 1;
+                ssize_t ret = write(eventFd_, &one, sizeof(one)); // 唤醒事件循环
+                (void)ret;
+            }
+        } else {
+            cond_.wait(locker);
+        }
+    }
+}
+
+bool fileIOPool::load_(const job& j) {
+    int fd = open(j.path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        LOG_WARN("Prefetch open %s error: %s", j.path.c_str(), strerror(errno));
+        return false;
+    }
+    // 先把整个范围交给内核做一次大的预读，再逐块pread等待数据真正进入页缓存
+    posix_fadvise(fd, j.offset, j.len, POSIX_FADV_WILLNEED);
+    static thread_local std::vector<char> chunk(CHUNK_SIZE);
+    size_t done = 0;
+    bool ok = true;
+    while(done < j.len) {
+        ssize_t n = pread(fd, chunk.data(), std::min(CHUNK_SIZE, j.len - done), j.offset + done);
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+        if(n <= 0) { // 文件在映射之后被截断时可能提前读到末尾
+            ok = n == 0;
+            break;
+        }
+        done += n;
+    }
+    ::close(fd);
+    metrics::add(metrics::FILE_PREFETCH);
+    metrics::add(metrics::FILE_PREFETCH_BYTES, done);
+    return ok;
+}
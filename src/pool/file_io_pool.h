@@ -0,0 +1,67 @@
+#ifndef FILE_IO_POOL_H
+#define FILE_IO_POOL_H
+
+#include <mutex>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <string>
+#include <functional>
+#include <condition_variable>
+#include <fcntl.h>          // open, posix_fadvise
+#include <unistd.h>         // pread, close
+#include <sys/eventfd.h>    // eventfd
+
+#include "../server/epoller.h"
+
+// 冷文件预读线程组：响应文件不在页缓存中时，第一次writev触碰mmap区域会缺页并在磁盘I/O上阻塞工作线程。
+// 工作线程用mincore发现冷页后把读取交给这里的专用线程（自己打开文件pread，数据进入页缓存），
+// 完成后经eventfd唤醒事件循环，回调在事件循环线程执行，由它把连接重新派发给线程池继续写。
+// 读取不访问连接的mmap区域，连接在预读期间超时关闭（munmap）也是安全的
+class fileIOPool {
+public:
+    typedef std::function<void(bool ok)> doneCallBack;
+
+    fileIOPool();
+    ~fileIOPool();
+
+    bool init(Epoller* epoller, int threadNum);
+    void close();
+
+    // 把文件[offset, offset+len)读入页缓存，线程安全；ok为false时（文件打不开、读出错）调用方照常写，由缺页兜底
+    void read(const std::string& path, size_t offset, size_t len, const doneCallBack& cb);
+
+    bool ownsFd(int fd) const { return fd == eventFd_; }
+    void handleEvent(int fd, uint32_t events);      // 事件循环线程调用
+
+    size_t pending() const { return pending_.load(std::memory_order_relaxed); }  // 排队和读取中的请求数
+    int threadNum() const { return static_cast<int>(threads_.size()); }
+
+private:
+    struct job {
+        std::string path;
+        size_t offset;
+        size_t len;
+        doneCallBack cb;
+        bool ok;
+    };
+
+    void worker_();
+    static bool load_(const job& j);
+
+    static const size_t CHUNK_SIZE = 256 * 1024;   // 每次pread的大小，线程各自一块暂存缓冲区
+
+    Epoller* epoller_;
+    int eventFd_;
+    std::vector<std::thread> threads_;
+    std::atomic<size_t> pending_;
+
+    std::mutex mtx_;
+    std::condition_variable cond_;
+    bool isClosed_;
+    std::deque<job> jobs_;      // 待读取
+    std::vector<job> done_;     // 已完成，等事件循环取走回调
+};
+
+#endif
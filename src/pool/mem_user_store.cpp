@@ -0,0 +1,195 @@
+#define LOG_MODULE Log::MODULE_POOL
+#include "mem_user_store.h"
+#include <errno.h>
+
+const char memUserStore::FILE_MAGIC[8] = {'W', 'S', 'U', 'S', 'E', 'R', '1', '\n'};
+
+memUserStore::memUserStore() {
+    fd_ = -1;
+    sync_ = false;
+    count_ = 0;
+}
+
+memUserStore::~memUserStore() {
+    close();
+}
+
+// 懒汉模式 局部静态变量法
+memUserStore* memUserStore::getInstance() {
+    static memUserStore store;
+    return &store;
+}
+
+bool memUserStore::init(const char* path, bool syncWrites) {
+    assert(path);
+    close();
+    path_ = path;
+    sync_ = syncWrites;
+    for(int i = 0; i < SHARD_NUM; i++) {
+        std::lock_guard<std::mutex> locker(shards_[i].mtx);
+        shards_[i].map.clear();
+    }
+    count_ = 0;
+    size_t slash = path_.find_last_of('/');
+    if(slash != std::string::npos && slash > 0) {
+        mkdir(path_.substr(0, slash).c_str(), 0777);
+    }
+    fd_ = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if(fd_ < 0) {
+        LOG_ERROR("UserStore open %s error: %s", path, strerror(errno));
+        return false;
+    }
+    if(!load_()) {
+        ::close(fd_);
+        fd_ = -1;
+        return false;
+    }
+    return true;
+}
+
+void memUserStore::close() {
+    std::lock_guard<std::mutex> locker(fileMtx_);
+    if(fd_ >= 0) {
+        fdatasync(fd_);
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+bool memUserStore::load_() {
+    auto begin = std::chrono::steady_clock::now();
+    struct stat st;
+    if(fstat(fd_, &st) < 0) {
+        return false;
+    }
+    size_t fileSize = st.st_size;
+    if(fileSize == 0) { // 新文件，写入文件头
+        return write(fd_, FILE_MAGIC, sizeof(FILE_MAGIC)) == static_cast<ssize_t>(sizeof(FILE_MAGIC));
+    }
+    char* addr = static_cast<char*>(mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd_, 0));
+    if(addr == MAP_FAILED) {
+        LOG_ERROR("UserStore mmap error: %s", strerror(errno));
+        return false;
+    }
+    madvise(addr, fileSize, MADV_SEQUENTIAL);
+    if(fileSize < sizeof(FILE_MAGIC) || memcmp(addr, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0) {
+        LOG_ERROR("UserStore %s is not a user store file", path_.c_str());
+        munmap(addr, fileSize);
+        return false;
+    }
+    size_t off = sizeof(FILE_MAGIC), loaded = 0;
+    while(off + 6 <= fileSize) {
+        uint32_t crc;
+        uint16_t nameLen;
+        memcpy(&crc, addr + off, 4);
+        memcpy(&nameLen, addr + off + 4, 2);
+        size_t recLen = 6 + nameLen + SALT_LEN + HASH_LEN;
+        if(off + recLen > fileSize ||
+           crc32(0, reinterpret_cast<const Bytef*>(addr + off + 4), recLen - 4) != crc) {
+            break;
+        }
+        std::string name(addr + off + 6, nameLen);
+        credential cred;
+        memcpy(cred.salt, addr + off + 6 + nameLen, SALT_LEN);
+        memcpy(cred.hash, addr + off + 6 + nameLen + SALT_LEN, HASH_LEN);
+        shard_(name).map[name] = cred; // 加载时没有并发，重复的用户名以后写入的为准
+        loaded++;
+        off += recLen;
+    }
+    munmap(addr, fileSize);
+    if(off < fileSize) { // 上次写到一半的记录截掉，后续追加从完整记录之后开始
+        LOG_WARN("UserStore drop %zu trailing bytes of %s", fileSize - off, path_.c_str());
+        if(ftruncate(fd_, off) < 0) {
+            return false;
+        }
+    }
+    size_t count = 0;
+    for(int i = 0; i < SHARD_NUM; i++) {
+        count += shards_[i].map.size();
+    }
+    count_ = count;
+    LOG_INFO("UserStore loaded %zu users (%zu records) from %s in %lldms", count, loaded, path_.c_str(),
+             static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                 std::chrono::steady_clock::now() - begin).count()));
+    return true;
+}
+
+bool memUserStore::hash_(const unsigned char* salt, const std::string& passwd, unsigned char* out) {
+    std::string buf(reinterpret_cast<const char*>(salt), SALT_LEN);
+    buf += passwd;
+    unsigned int len = 0;
+    return EVP_Digest(buf.data(), buf.size(), out, &len, EVP_sha256(), nullptr) == 1 && len == HASH_LEN;
+}
+
+bool memUserStore::append_(const std::string& name, const credential& cred) {
+    std::string rec(4, '\0');
+    uint16_t nameLen = static_cast<uint16_t>(name.size());
+    rec.append(reinterpret_cast<const char*>(&nameLen), 2);
+    rec += name;
+    rec.append(reinterpret_cast<const char*>(cred.salt), SALT_LEN);
+    rec.append(reinterpret_cast<const char*>(cred.hash), HASH_LEN);
+    uint32_t crc = crc32(0, reinterpret_cast<const Bytef*>(rec.data() + 4), rec.size() - 4);
+    memcpy(&rec[0], &crc, 4);
+
+    std::lock_guard<std::mutex> locker(fileMtx_);
+    if(fd_ < 0) {
+        return false;
+    }
+    // O_APPEND 下一次write写入整条记录；写失败时截回原长度，不留下半条记录
+    off_t size = lseek(fd_, 0, SEEK_END);
+    if(write(fd_, rec.data(), rec.size()) != static_cast<ssize_t>(rec.size())) {
+        LOG_ERROR("UserStore append error: %s", strerror(errno));
+        if(size >= 0 && ftruncate(fd_, size) < 0) {
+            LOG_ERROR("UserStore truncate error: %s", strerror(errno));
+        }
+        return false;
+    }
+    if(sync_) {
+        fdatasync(fd_);
+    }
+    return true;
+}
+
+userStore::RESULT memUserStore::login(const std::string& name, const std::string& passwd) {
+    credential cred;
+    {
+        shard& s = shard_(name);
+        std::lock_guard<std::mutex> locker(s.mtx);
+        auto it = s.map.find(name);
+        if(it == s.map.end()) {
+            LOG_INFO("Password Error!");
+            return STORE_FAIL;
+        }
+        cred = it->second;
+    }
+    unsigned char hash[HASH_LEN];
+    if(hash_(cred.salt, passwd, hash) && CRYPTO_memcmp(hash, cred.hash, HASH_LEN) == 0) {
+        LOG_INFO("Password Correct!");
+        return STORE_OK;
+    }
+    LOG_INFO("Password Error!");
+    return STORE_FAIL;
+}
+
+userStore::RESULT memUserStore::registerUser(const std::string& name, const std::string& passwd) {
+    if(name.size() > UINT16_MAX) {
+        return STORE_FAIL;
+    }
+    credential cred;
+    if(RAND_bytes(cred.salt, SALT_LEN) != 1 || !hash_(cred.salt, passwd, cred.hash)) {
+        return STORE_UNAVAILABLE;
+    }
+    shard& s = shard_(name);
+    std::lock_guard<std::mutex> locker(s.mtx); // 持有分片锁写文件，同名注册不会重复落盘
+    if(s.map.count(name)) {
+        LOG_INFO("Username used!");
+        return STORE_FAIL;
+    }
+    if(!append_(name, cred)) {
+        return STORE_UNAVAILABLE;
+    }
+    s.map[name] = cred;
+    count_++;
+    LOG_INFO("Register success!");
+    return STORE_OK;
+}
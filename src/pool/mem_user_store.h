@@ -0,0 +1,71 @@
+#ifndef MEM_USER_STORE_H
+#define MEM_USER_STORE_H
+
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include <stdint.h>
+#include <string.h>         // memcpy
+#include <fcntl.h>          // open
+#include <unistd.h>         // write close ftruncate fdatasync
+#include <sys/stat.h>       // fstat mkdir
+#include <sys/mman.h>       // mmap munmap
+#include <zlib.h>           // crc32
+#include <openssl/evp.h>    // EVP_Digest
+#include <openssl/rand.h>   // RAND_bytes
+#include <openssl/crypto.h> // CRYPTO_memcmp
+#include "user_store.h"
+#include "../log/log.h"
+
+// 嵌入式后端：分片加锁的哈希表常驻内存，注册追加写到只追加的数据文件，启动时mmap整个文件顺序加载
+// 不依赖MySQL，用于无数据库的压测和边缘部署；只保存 sha256(随机盐 + 密码)
+// 文件格式：8字节文件头 "WSUSER1\n"，之后每条记录为
+//   crc32(4) | 用户名长度(2) | 用户名 | 盐(16) | 哈希(32)，crc32覆盖长度字段之后的全部内容
+// 进程崩溃留下的半条记录在下次加载时被截掉
+class memUserStore : public userStore {
+public:
+    static memUserStore* getInstance();
+
+    // syncWrites为true时每次注册都fdatasync，否则交给操作系统回写
+    bool init(const char* path, bool syncWrites = false);
+    void close();
+
+    RESULT login(const std::string& name, const std::string& passwd) override;
+    RESULT registerUser(const std::string& name, const std::string& passwd) override;
+    const char* name() const override { return "memory"; }
+
+    size_t size() const { return count_.load(std::memory_order_relaxed); }
+
+private:
+    static const int SHARD_NUM = 64;
+    static const int SALT_LEN = 16;
+    static const int HASH_LEN = 32;
+    static const char FILE_MAGIC[8];
+
+    struct credential {
+        unsigned char salt[SALT_LEN];
+        unsigned char hash[HASH_LEN];
+    };
+    struct shard {
+        std::mutex mtx;
+        std::unordered_map<std::string, credential> map;
+    };
+
+    memUserStore();
+    ~memUserStore();
+
+    shard& shard_(const std::string& name) { return shards_[std::hash<std::string>()(name) % SHARD_NUM]; }
+    bool load_();
+    bool append_(const std::string& name, const credential& cred);
+    static bool hash_(const unsigned char* salt, const std::string& passwd, unsigned char* out);
+
+    std::string path_;
+    int fd_;
+    bool sync_;
+    std::mutex fileMtx_;                // 串行化追加写；加锁顺序：分片锁 -> fileMtx_
+    shard shards_[SHARD_NUM];
+    std::atomic<size_t> count_;
+};
+
+#endif
@@ -0,0 +1,133 @@
+#define LOG_MODULE Log::MODULE_POOL
+#include "mysql_user_store.h"
+#include <string.h>
+
+// 懒汉模式 局部静态变量法
+mysqlUserStore* mysqlUserStore::getInstance() {
+    static mysqlUserStore store;
+    return &store;
+}
+
+bool mysqlUserStore::select_(sqlConnPool* pool, MYSQL* sql, const std::string& name, bool* found, std::string* password) {
+    // 用预编译语句按用户名查询密码，参数走二进制协议，不拼接SQL
+    MYSQL_BIND param[1];
+    memset(param, 0, sizeof(param));
+    unsigned long nameLen = name.size();
+    param[0].buffer_type = MYSQL_TYPE_STRING;
+    param[0].buffer = const_cast<char*>(name.data());
+    param[0].buffer_length = nameLen;
+    param[0].length = &nameLen;
+    MYSQL_STMT* stmt = pool->execStmt(sql, sqlConnPool::STMT_LOGIN_SELECT, param);
+    if(!stmt) {
+        return false;
+    }
+
+    char buff[256] = {0};
+    unsigned long len = 0;
+    MYSQL_BIND result[1];
+    memset(result, 0, sizeof(result));
+    result[0].buffer_type = MYSQL_TYPE_STRING;
+    result[0].buffer = buff;
+    result[0].buffer_length = sizeof(buff) - 1;
+    result[0].length = &len;
+
+    *found = false;
+    if(mysql_stmt_bind_result(stmt, result) == 0 && mysql_stmt_store_result(stmt) == 0) {
+        int ret = mysql_stmt_fetch(stmt);
+        *found = (ret == 0 || ret == MYSQL_DATA_TRUNCATED);
+    }
+    mysql_stmt_free_result(stmt);
+    if(*found && password) {
+        password->assign(buff, std::min<unsigned long>(len, sizeof(buff) - 1));
+    }
+    return true;
+}
+
+userStore::RESULT mysqlUserStore::login(const std::string& name, const std::string& passwd) {
+    MYSQL* sql;
+    sqlConnPool* pool = sqlConnPool::getInstance();
+    sqlConnRAII connRAII(&sql, pool);
+    if(!sql) { // 借连接超时：快速失败，不让请求无限等待数据库
+        LOG_WARN("No sql connection for user: %s", name.c_str());
+        return STORE_UNAVAILABLE;
+    }
+    bool found = false;
+    std::string password;
+    if(!select_(pool, sql, name, &found, &password)) {
+        return STORE_UNAVAILABLE;
+    }
+    if(found && passwd == password) {
+        LOG_INFO("Password Correct!");
+        return STORE_OK;
+    }
+    LOG_INFO("Password Error!");
+    return STORE_FAIL;
+}
+
+userStore::RESULT mysqlUserStore::registerUser(const std::string& name, const std::string& passwd) {
+    // 注册走组提交：并发的注册合并成一个事务，查重在批内完成，不占用本线程的连接
+    registerBatcher* batcher = registerBatcher::getInstance();
+    if(batcher->isOpen()) {
+        switch(batcher->submit(name, passwd)) {
+            case registerBatcher::REG_OK:
+                LOG_INFO("Register success!");
+                return STORE_OK;
+            case registerBatcher::REG_DUP:
+                LOG_INFO("Username used!");
+                return STORE_FAIL;
+            case registerBatcher::REG_UNAVAILABLE:
+                return STORE_UNAVAILABLE;
+            default:
+                LOG_DEBUG("Insert error!");
+                return STORE_FAIL;
+        }
+    }
+
+    MYSQL* sql;
+    sqlConnPool* pool = sqlConnPool::getInstance();
+    sqlConnRAII connRAII(&sql, pool);
+    if(!sql) {
+        LOG_WARN("No sql connection for user: %s", name.c_str());
+        return STORE_UNAVAILABLE;
+    }
+
+    // 布隆过滤器判定用户名一定不存在，就跳过SELECT，直接INSERT并由唯一键兜底
+    userFilter* filter = userFilter::getInstance();
+    if(filter->mayContain(name)) {
+        bool found = false;
+        if(!select_(pool, sql, name, &found, nullptr)) {
+            return STORE_UNAVAILABLE;
+        }
+        filter->reportLookup(found);
+        if(found) {
+            LOG_INFO("Username used!");
+            return STORE_FAIL;
+        }
+    }
+
+    // 用户名不存在，执行插入注册信息的操作
+    MYSQL_BIND param[2];
+    memset(param, 0, sizeof(param));
+    unsigned long nameLen = name.size(), passwdLen = passwd.size();
+    param[0].buffer_type = MYSQL_TYPE_STRING;
+    param[0].buffer = const_cast<char*>(name.data());
+    param[0].buffer_length = nameLen;
+    param[0].length = &nameLen;
+    param[1].buffer_type = MYSQL_TYPE_STRING;
+    param[1].buffer = const_cast<char*>(passwd.data());
+    param[1].buffer_length = passwdLen;
+    param[1].length = &passwdLen;
+    unsigned int err = 0;
+    if(!pool->execStmt(sql, sqlConnPool::STMT_REGISTER_INSERT, param, &err)) {
+        if(err == ER_DUP_ENTRY) { // 过滤器加载前后被其他实例注册的用户名，补进过滤器
+            LOG_INFO("Username used!");
+            filter->add(name);
+        } else {
+            LOG_DEBUG("Insert error!");
+        }
+        return STORE_FAIL;
+    }
+    filter->add(name);
+    LOG_INFO("Register success!");
+    return STORE_OK;
+}
@@ -0,0 +1,30 @@
+#ifndef MYSQL_USER_STORE_H
+#define MYSQL_USER_STORE_H
+
+#include <mysql/mysql.h>
+#include "user_store.h"
+#include "sqlconn_pool.h"
+#include "user_filter.h"
+#include "register_batcher.h"
+#include "../log/log.h"
+
+// MySQL后端：连接来自sqlConnPool，按用户名用预编译语句查询；
+// 注册优先走registerBatcher组提交，并用userFilter跳过一定不存在的用户名的查重
+class mysqlUserStore : public userStore {
+public:
+    static mysqlUserStore* getInstance();
+
+    RESULT login(const std::string& name, const std::string& passwd) override;
+    RESULT registerUser(const std::string& name, const std::string& passwd) override;
+    const char* name() const override { return "mysql"; }
+    bool isReady() const override { return sqlConnPool::getInstance()->isReady(); }
+
+private:
+    mysqlUserStore() = default;
+    ~mysqlUserStore() = default;
+
+    // 查询用户名对应的密码，语句执行失败返回false
+    static bool select_(sqlConnPool* pool, MYSQL* sql, const std::string& name, bool* found, std::string* password);
+};
+
+#endif
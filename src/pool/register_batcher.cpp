@@ -0,0 +1,254 @@
+#define LOG_MODULE Log::MODULE_POOL
+#include "register_batcher.h"
+#include "sqlconn_pool.h"
+#include "user_filter.h"
+#include <string.h>
+#include <unordered_set>
+
+registerBatcher::registerBatcher() {
+    windowMS_ = 5;
+    maxRows_ = 64;
+    isOpen_ = false;
+    isClose_ = true;
+    batches_ = rows_ = duplicates_ = fallbacks_ = maxBatch_ = 0;
+}
+
+registerBatcher::~registerBatcher() {
+    close();
+}
+
+// 懒汉模式 局部静态变量法
+registerBatcher* registerBatcher::getInstance() {
+    static registerBatcher batcher;
+    return &batcher;
+}
+
+void registerBatcher::init(int windowMS, size_t maxRows) {
+    assert(windowMS >= 0 && maxRows > 0);
+    close();
+    windowMS_ = windowMS;
+    maxRows_ = maxRows;
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        isClose_ = false;
+    }
+    thread_.reset(new std::thread(&registerBatcher::batchThread_, this));
+    isOpen_ = true;
+}
+
+void registerBatcher::close() {
+    if(!isOpen_.exchange(false)) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        isClose_ = true;
+    }
+    cond_.notify_all();
+    thread_->join(); // 退出前处理完已提交的请求
+    thread_.reset();
+}
+
+registerBatcher::RESULT registerBatcher::submit(const std::string& name, const std::string& passwd) {
+    request req = {name, passwd, REG_ERROR, false};
+    std::unique_lock<std::mutex> locker(mtx_);
+    if(isClose_) {
+        return REG_UNAVAILABLE;
+    }
+    queue_.push_back(&req);
+    if(queue_.size() == 1 || queue_.size() >= maxRows_) {
+        cond_.notify_one();
+    }
+    doneCond_.wait(locker, [&req]() { return req.done; });
+    return req.result;
+}
+
+void registerBatcher::batchThread_() {
+    std::unique_lock<std::mutex> locker(mtx_);
+    while(true) {
+        cond_.wait(locker, [this]() { return isClose_ || !queue_.empty(); });
+        if(queue_.empty()) { // 只有关闭时才会空着醒来
+            break;
+        }
+        // 第一条请求到达后再等一个窗口，让并发的注册凑进同一批
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(windowMS_);
+        cond_.wait_until(locker, deadline, [this]() { return isClose_ || queue_.size() >= maxRows_; });
+        std::vector<request*> batch;
+        while(!queue_.empty() && batch.size() < maxRows_) {
+            batch.push_back(queue_.front());
+            queue_.pop_front();
+        }
+        locker.unlock();
+        commit_(batch);
+        locker.lock();
+        for(request* req : batch) {
+            req->done = true;
+        }
+        doneCond_.notify_all();
+    }
+}
+
+void registerBatcher::commit_(std::vector<request*>& batch) {
+    // 同一批内重复的用户名只保留第一条
+    std::vector<request*> rows;
+    std::unordered_set<std::string> names;
+    for(request* req : batch) {
+        if(names.insert(req->name).second) {
+            rows.push_back(req);
+        } else {
+            req->result = REG_DUP;
+            duplicates_++;
+        }
+    }
+
+    sqlConnPool* pool = sqlConnPool::getInstance();
+    MYSQL* sql = pool->getConn();
+    if(!sql) {
+        for(request* req : rows) {
+            req->result = REG_UNAVAILABLE;
+        }
+        return;
+    }
+    if(!commitTxn_(sql, rows)) {
+        fallbacks_++;
+        insertEach_(sql, rows);
+    }
+    pool->freeConn(sql);
+
+    batches_++;
+    uint64_t size = batch.size();
+    for(uint64_t cur = maxBatch_; size > cur && !maxBatch_.compare_exchange_weak(cur, size); ) {}
+}
+
+bool registerBatcher::quote_(MYSQL* sql, const std::string& str, std::string* out) {
+    std::string buf(str.size() * 2 + 1, '\0');
+#if defined(LIBMARIADB) || defined(MARIADB_BASE_VERSION)
+    unsigned long len = mysql_real_escape_string(sql, &buf[0], str.data(), str.size());
+#else
+    // libmysqlclient 在NO_BACKSLASH_ESCAPES下拒绝 mysql_real_escape_string，与asyncSqlClient一样按单引号转义
+    unsigned long len = mysql_real_escape_string_quote(sql, &buf[0], str.data(), str.size(), '\'');
+#endif
+    if(len == static_cast<unsigned long>(-1)) {
+        LOG_WARN("Register batch escape error: %s", mysql_error(sql));
+        return false;
+    }
+    out->push_back('\'');
+    out->append(buf, 0, len);
+    out->push_back('\'');
+    return true;
+}
+
+bool registerBatcher::commitTxn_(MYSQL* sql, std::vector<request*>& rows) {
+    // 先转义整批的值再开事务：转义失败时整批退回逐行插入，逐行路径用预处理语句，不需要转义
+    std::vector<std::string> names(rows.size()), passwds(rows.size());
+    for(size_t i = 0; i < rows.size(); i++) {
+        if(!quote_(sql, rows[i]->name, &names[i]) || !quote_(sql, rows[i]->passwd, &passwds[i])) {
+            return false;
+        }
+    }
+
+    userFilter* filter = userFilter::getInstance();
+    // 布隆过滤器判定一定不存在的用户名不需要查；FOR UPDATE 锁住这些键，提交前别的事务插不进来
+    std::string inList;
+    std::vector<request*> lookups;
+    for(size_t i = 0; i < rows.size(); i++) {
+        if(filter->mayContain(rows[i]->name)) {
+            inList += (inList.empty() ? "" : ",") + names[i];
+            lookups.push_back(rows[i]);
+        }
+    }
+    if(mysql_query(sql, "BEGIN") != 0) {
+        LOG_WARN("Register batch begin error: %s", mysql_error(sql));
+        return false;
+    }
+    std::unordered_set<std::string> exists;
+    if(!inList.empty()) {
+        std::string query = "SELECT username FROM user WHERE username IN (" + inList + ") FOR UPDATE";
+        MYSQL_RES* res = nullptr;
+        if(mysql_query(sql, query.c_str()) != 0 || !(res = mysql_store_result(sql))) {
+            LOG_WARN("Register batch select error: %s", mysql_error(sql));
+            mysql_query(sql, "ROLLBACK");
+            return false;
+        }
+        MYSQL_ROW row;
+        while((row = mysql_fetch_row(res)) != nullptr) {
+            if(row[0]) { exists.insert(row[0]); }
+        }
+        mysql_free_result(res);
+        for(request* req : lookups) {
+            filter->reportLookup(exists.count(req->name) > 0);
+        }
+    }
+
+    std::string values;
+    for(size_t i = 0; i < rows.size(); i++) {
+        if(exists.count(rows[i]->name)) {
+            continue;
+        }
+        values += (values.empty() ? "(" : ",(") + names[i] + "," + passwds[i] + ")";
+    }
+    if(!values.empty()) {
+        std::string query = "INSERT INTO user(username, password) VALUES " + values;
+        if(mysql_query(sql, query.c_str()) != 0) {
+            LOG_WARN("Register batch insert error: %s", mysql_error(sql));
+            mysql_query(sql, "ROLLBACK");
+            return false;
+        }
+    }
+    if(mysql_query(sql, "COMMIT") != 0) {
+        LOG_WARN("Register batch commit error: %s", mysql_error(sql));
+        mysql_query(sql, "ROLLBACK");
+        return false;
+    }
+    for(request* req : rows) {
+        if(exists.count(req->name)) {
+            req->result = REG_DUP;
+            duplicates_++;
+        } else {
+            req->result = REG_OK;
+            rows_++;
+        }
+        filter->add(req->name);
+    }
+    return true;
+}
+
+void registerBatcher::insertEach_(MYSQL* sql, std::vector<request*>& rows) {
+    sqlConnPool* pool = sqlConnPool::getInstance();
+    userFilter* filter = userFilter::getInstance();
+    for(request* req : rows) {
+        MYSQL_BIND param[2];
+        memset(param, 0, sizeof(param));
+        unsigned long nameLen = req->name.size(), passwdLen = req->passwd.size();
+        param[0].buffer_type = MYSQL_TYPE_STRING;
+        param[0].buffer = const_cast<char*>(req->name.data());
+        param[0].buffer_length = nameLen;
+        param[0].length = &nameLen;
+        param[1].buffer_type = MYSQL_TYPE_STRING;
+        param[1].buffer = const_cast<char*>(req->passwd.data());
+        param[1].buffer_length = passwdLen;
+        param[1].length = &passwdLen;
+        unsigned int err = 0;
+        if(pool->execStmt(sql, sqlConnPool::STMT_REGISTER_INSERT, param, &err)) {
+            req->result = REG_OK;
+            rows_++;
+            filter->add(req->name);
+        } else if(err == ER_DUP_ENTRY) {
+            req->result = REG_DUP;
+            duplicates_++;
+            filter->add(req->name);
+        } else {
+            req->result = REG_ERROR;
+        }
+    }
+}
+
+registerBatchStats registerBatcher::getStats() const {
+    registerBatchStats stats;
+    stats.batches = batches_;
+    stats.rows = rows_;
+    stats.duplicates = duplicates_;
+    stats.fallbacks = fallbacks_;
+    stats.maxBatch = maxBatch_;
+    return stats;
+}
@@ -0,0 +1,79 @@
+#ifndef REGISTER_BATCHER_H
+#define REGISTER_BATCHER_H
+
+#include <mysql/mysql.h>
+#include <mysql/mysqld_error.h> // ER_DUP_ENTRY
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <condition_variable>
+#include "../log/log.h"
+
+struct registerBatchStats {
+    uint64_t batches;           // 提交的批次数（每批一个事务、一次提交）
+    uint64_t rows;              // 成功注册的行数
+    uint64_t duplicates;        // 用户名已存在或同一批内重复
+    uint64_t fallbacks;         // 批量事务失败后逐行插入的批次数
+    uint64_t maxBatch;
+};
+
+// 注册请求的组提交：工作线程提交用户名密码后阻塞等待，后台线程把一个时间窗口内
+// （或凑满maxRows条）的注册合并到一个事务里：
+//   BEGIN; SELECT username ... IN(...) FOR UPDATE; INSERT ... VALUES (...),(...); COMMIT
+// 数据库每批只落盘一次。已存在和同批重复的用户名逐条判定为失败，其余成功；
+// 事务出错时回滚并退回逐行插入，由唯一键判定每一行的结果
+class registerBatcher {
+public:
+    enum RESULT {
+        REG_OK = 0,
+        REG_DUP,                // 用户名已被占用
+        REG_UNAVAILABLE,        // 借不到数据库连接
+        REG_ERROR,
+    };
+
+    static registerBatcher* getInstance();
+
+    // windowMS为第一条请求到达后最多等待的时间，maxRows为每批上限
+    void init(int windowMS, size_t maxRows);
+    void close();
+    bool isOpen() const { return isOpen_.load(std::memory_order_acquire); }
+
+    RESULT submit(const std::string& name, const std::string& passwd);   // 阻塞到所在批次完成
+
+    registerBatchStats getStats() const;
+
+private:
+    struct request {
+        std::string name;
+        std::string passwd;
+        RESULT result;
+        bool done;
+    };
+
+    registerBatcher();
+    ~registerBatcher();
+
+    void batchThread_();
+    void commit_(std::vector<request*>& batch);
+    bool commitTxn_(MYSQL* sql, std::vector<request*>& rows);          // 事务方式提交，失败返回false且已回滚
+    void insertEach_(MYSQL* sql, std::vector<request*>& rows);         // 逐行插入兜底
+    bool quote_(MYSQL* sql, const std::string& str, std::string* out);  // 追加转义并加引号的值，转义失败返回false
+
+    int windowMS_;
+    size_t maxRows_;
+    std::atomic<bool> isOpen_;
+    bool isClose_;
+    std::deque<request*> queue_;
+    std::mutex mtx_;
+    std::condition_variable cond_;          // 唤醒批处理线程
+    std::condition_variable doneCond_;      // 批次完成，唤醒等待的工作线程
+    std::unique_ptr<std::thread> thread_;
+
+    std::atomic<uint64_t> batches_, rows_, duplicates_, fallbacks_, maxBatch_;
+};
+
+#endif
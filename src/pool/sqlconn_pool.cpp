@@ -1,66 +1,372 @@
+#define LOG_MODULE Log::MODULE_POOL
 #include "sqlconn_pool.h"
 
+const char* sqlConnPool::STMT_SQL[STMT_COUNT] = {
+    "SELECT password FROM user WHERE username=? LIMIT 1",
+    "INSERT INTO user(username, password) VALUES(?,?)",
+};
+
+const int sqlConnPool::IDLE_CHECK_MS;
+const int sqlConnPool::SHRINK_IDLE_MS;
+
 // 懒汉式单例 局部静态变量法 （这种方法不需要加锁解锁操作）
 sqlConnPool* sqlConnPool::getInstance() {
     static sqlConnPool pool;
     return &pool;
 }
 
+sqlConnPool::sqlConnPool() {
+    port_ = 0;
+    minConn_ = maxConn_ = 0;
+    timeoutMS_ = 500;
+    total_ = pending_ = waiters_ = 0;
+    connectFailed_ = false;
+    isClose_ = true;
+    checkouts_ = timeouts_ = pingFailures_ = connectErrors_ = 0;
+    waitUsTotal_ = waitUsMax_ = checkoutUsTotal_ = 0;
+    ready_ = false;
+    warmUpUs_ = 0;
+}
+
 // 初始化
 void sqlConnPool::init(const char* host, int port,
                        const char* user, const char* pwd,
-                       const char* dbName, int connSize = 10) {
+                       const char* dbName, int connSize,
+                       int maxConnSize, int timeoutMS,
+                       bool lazyWarmUp) {
     assert(connSize > 0);
-    for(int i = 0; i < connSize; i++) {
-        MYSQL* conn = nullptr;
-        conn = mysql_init(conn);
-        if(!conn) {
-            LOG_ERROR("MySQL init error!");
-            assert(conn);
+    host_ = host;
+    user_ = user;
+    pwd_ = pwd;
+    dbName_ = dbName;
+    port_ = port;
+    minConn_ = connSize;
+    maxConn_ = maxConnSize > connSize ? maxConnSize : connSize;
+    timeoutMS_ = timeoutMS;
+    initTime_ = std::chrono::steady_clock::now();
+    ready_ = false;
+    warmUpUs_ = 0;
+    {
+        lock_guard<mutex> locker(mtx_);
+        isClose_ = false;
+    }
+    // 第一个连接同步建立：尽早暴露配置错误，也保证开始服务时至少有一个可用连接
+    MYSQL* conn = connect_();
+    {
+        lock_guard<mutex> locker(mtx_);
+        if(conn) {
+            addConn_(conn);
+            // 其余常驻连接并行建立，总耗时约为一次建连而不是connSize次
+            for(int i = 1; i < connSize; i++) {
+                pending_++;
+                warmers_.emplace_back(&sqlConnPool::warmUpThread_, this);
+            }
+        } else { // 连不上的由后台线程继续重试
+            connectFailed_ = true;
         }
-        conn = mysql_real_connect(conn, host, user, pwd, dbName, port, nullptr, 0);
-        if(!conn) {
-            LOG_ERROR("MySQL connect error!");
+    }
+    if(!lazyWarmUp) {
+        for(auto& t : warmers_) {
+            t.join();
         }
-        connQue_.emplace(conn);
+        warmers_.clear();
+    }
+    keeper_.reset(new std::thread(&sqlConnPool::keeperThread_, this));
+    LOG_INFO("SqlConnPool connected: %d, min: %d, max: %d%s", total_, minConn_, maxConn_,
+             isReady() ? "" : ", warming up in background");
+}
+
+void sqlConnPool::warmUpThread_() {
+    MYSQL* conn = connect_();
+    lock_guard<mutex> locker(mtx_);
+    pending_--;
+    if(!conn) { // 失败的由维护线程按退避策略补足
+        keeperCond_.notify_one();
+        return;
     }
-    MAX_CONN_ = connSize;
-    sem_init(&semId_, 0, MAX_CONN_);
+    addConn_(conn);
+}
 
+void sqlConnPool::addConn_(MYSQL* conn) {
+    total_++;
+    connectFailed_ = false;
+    if(isClose_) {
+        destroy_(conn);
+        return;
+    }
+    idle_.push_back({conn, std::chrono::steady_clock::now()});
+    cond_.notify_one();
+    if(!ready_ && total_ >= minConn_) {
+        warmUpUs_ = std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - initTime_).count();
+        ready_.store(true, std::memory_order_release);
+        LOG_INFO("SqlConnPool ready: %d connections in %llums", total_,
+                 static_cast<unsigned long long>(warmUpUs_ / 1000));
+    }
 }
 
-MYSQL* sqlConnPool::getConn() {
-    MYSQL* conn = nullptr;
-    if(connQue_.empty()) {
-        LOG_WARN("SqlConnPool busy!");
+MYSQL* sqlConnPool::connect_() {
+    MYSQL* conn = mysql_init(nullptr);
+    if(!conn) {
+        LOG_ERROR("MySQL init error!");
+        return nullptr;
+    }
+    bool reconnect = true; // 连接断开时由客户端库自动重连，之后的预编译语句需要重新准备
+    mysql_options(conn, MYSQL_OPT_RECONNECT, &reconnect);
+    unsigned int timeout = 3; // 数据库故障切换时尽快失败，不让工作线程长时间阻塞
+    mysql_options(conn, MYSQL_OPT_CONNECT_TIMEOUT, &timeout);
+    mysql_options(conn, MYSQL_OPT_READ_TIMEOUT, &timeout);
+    mysql_options(conn, MYSQL_OPT_WRITE_TIMEOUT, &timeout);
+    if(!mysql_real_connect(conn, host_.c_str(), user_.c_str(), pwd_.c_str(), dbName_.c_str(), port_, nullptr, 0)) {
+        LOG_ERROR("MySQL connect error: %s", mysql_error(conn));
+        mysql_close(conn);
+        connectErrors_++;
         return nullptr;
     }
-    sem_wait(&semId_); // -1
     lock_guard<mutex> locker(mtx_);
-    conn = connQue_.front();
-    connQue_.pop();
+    stmtCache cache = {};
+    stmts_[conn] = cache;
     return conn;
 }
 
+void sqlConnPool::destroy_(MYSQL* conn) {
+    auto it = stmts_.find(conn);
+    if(it != stmts_.end()) {
+        closeStmts_(&it->second);
+        stmts_.erase(it);
+    }
+    mysql_close(conn);
+    total_--;
+}
+
+MYSQL* sqlConnPool::getConn(int timeoutMS) {
+    using namespace std::chrono;
+    auto begin = steady_clock::now();
+    auto deadline = begin + milliseconds(timeoutMS < 0 ? timeoutMS_ : timeoutMS);
+    unique_lock<mutex> locker(mtx_);
+    while(true) {
+        if(isClose_) {
+            return nullptr;
+        }
+        if(!idle_.empty()) {
+            idleConn entry = idle_.back(); // 优先用最近归还的连接
+            idle_.pop_back();
+            locker.unlock();
+            auto now = steady_clock::now();
+            // 长时间空闲的连接可能已被服务端或中间设备断开，借出前先校验
+            if(now - entry.lastUsed > milliseconds(IDLE_CHECK_MS) && mysql_ping(entry.conn) != 0) {
+                LOG_WARN("SqlConnPool drop dead connection: %s", mysql_error(entry.conn));
+                pingFailures_++;
+                locker.lock();
+                destroy_(entry.conn);
+                keeperCond_.notify_one();
+                continue;
+            }
+            uint64_t checkoutUs = duration_cast<microseconds>(steady_clock::now() - begin).count();
+            checkouts_++;
+            checkoutUsTotal_ += checkoutUs;
+            WS_PROBE2(sql_checkout, entry.conn, checkoutUs);
+            return entry.conn;
+        }
+        if(total_ == 0 && pending_ == 0 && connectFailed_) { // 数据库不可用，快速失败
+            timeouts_++;
+            return nullptr;
+        }
+        if(total_ + pending_ < maxConn_) { // 还能扩容，请后台线程建连接，自己继续等
+            keeperCond_.notify_one();
+        }
+        waiters_++;
+        auto waitBegin = steady_clock::now();
+        bool timeout = (cond_.wait_until(locker, deadline) == std::cv_status::timeout);
+        waiters_--;
+        uint64_t waited = duration_cast<microseconds>(steady_clock::now() - waitBegin).count();
+        waitUsTotal_ += waited;
+        if(waited > waitUsMax_) { waitUsMax_ = waited; }
+        if(timeout && idle_.empty()) {
+            LOG_WARN("SqlConnPool busy!");
+            timeouts_++;
+            return nullptr;
+        }
+    }
+}
+
 // 存入连接池，实际上没有关闭
 void sqlConnPool::freeConn(MYSQL* conn) {
     assert(conn);
+    WS_PROBE1(sql_return, conn);
     lock_guard<mutex> locker(mtx_);
-    connQue_.push(conn);
-    sem_post(&semId_); // +1
+    if(isClose_) {
+        destroy_(conn);
+        return;
+    }
+    idle_.push_back({conn, std::chrono::steady_clock::now()});
+    cond_.notify_one();
+}
+
+void sqlConnPool::dropConn(MYSQL* conn) {
+    assert(conn);
+    lock_guard<mutex> locker(mtx_);
+    destroy_(conn);
+    keeperCond_.notify_one();
+}
+
+void sqlConnPool::keeperThread_() {
+    using namespace std::chrono;
+    unique_lock<mutex> locker(mtx_);
+    while(!isClose_) {
+        // 低于最少连接数，或有线程在等待且未达上限时建立新连接
+        bool grow = (total_ + pending_ < minConn_) || (waiters_ > 0 && total_ + pending_ < maxConn_);
+        if(grow) {
+            pending_++;
+            locker.unlock();
+            MYSQL* conn = connect_();
+            locker.lock();
+            pending_--;
+            if(conn) {
+                addConn_(conn);
+                continue;
+            }
+            connectFailed_ = true;
+            cond_.notify_all(); // 让等待者检查是否应快速失败
+            keeperCond_.wait_for(locker, seconds(1)); // 重连退避
+            continue;
+        }
+        // 回收超出最少连接数且长期空闲的连接（头部是最久未用的）
+        auto now = steady_clock::now();
+        while(total_ > minConn_ && !idle_.empty() && now - idle_.front().lastUsed > milliseconds(SHRINK_IDLE_MS)) {
+            destroy_(idle_.front().conn);
+            idle_.pop_front();
+        }
+        keeperCond_.wait_for(locker, seconds(1));
+    }
 }
 
 void sqlConnPool::closePool() {
+    {
+        lock_guard<mutex> locker(mtx_);
+        if(isClose_ && !keeper_) {
+            return;
+        }
+        isClose_ = true;
+    }
+    keeperCond_.notify_all();
+    cond_.notify_all();
+    if(keeper_ && keeper_->joinable()) {
+        keeper_->join();
+    }
+    keeper_.reset();
+    for(auto& t : warmers_) { // 建连有超时，最多等待一个连接超时时间
+        t.join();
+    }
+    warmers_.clear();
+    ready_ = false;
     lock_guard<mutex> locker(mtx_);
-    while(!connQue_.empty()) {
-        auto conn = connQue_.front();
-        connQue_.pop();
-        mysql_close(conn);
+    while(!idle_.empty()) {
+        destroy_(idle_.front().conn);
+        idle_.pop_front();
     }
     mysql_library_end();
 }
 
 int sqlConnPool::getFreeConnCount() {
     lock_guard<mutex> locker(mtx_);
-    return connQue_.size();
-}
\ No newline at end of file
+    return idle_.size();
+}
+
+sqlPoolStats sqlConnPool::getStats() {
+    sqlPoolStats stats;
+    {
+        lock_guard<mutex> locker(mtx_);
+        stats.total = total_;
+        stats.idle = idle_.size();
+        stats.inUse = total_ - static_cast<int>(idle_.size());
+        stats.waiters = waiters_;
+    }
+    stats.checkouts = checkouts_;
+    stats.timeouts = timeouts_;
+    stats.pingFailures = pingFailures_;
+    stats.connectErrors = connectErrors_;
+    stats.waitUsTotal = waitUsTotal_;
+    stats.waitUsMax = waitUsMax_;
+    stats.checkoutUsTotal = checkoutUsTotal_;
+    stats.ready = isReady();
+    stats.warmUpUs = warmUpUs_;
+    return stats;
+}
+
+sqlConnPool::stmtCache* sqlConnPool::stmtCache_(MYSQL* conn) {
+    lock_guard<mutex> locker(mtx_);
+    auto it = stmts_.find(conn);
+    if(it == stmts_.end()) {
+        return nullptr;
+    }
+    return &it->second; // 缓存内容只由持有该连接的线程访问，不需要一直持锁
+}
+
+void sqlConnPool::closeStmts_(stmtCache* cache) {
+    for(int i = 0; i < STMT_COUNT; i++) {
+        if(cache->stmts[i]) {
+            mysql_stmt_close(cache->stmts[i]);
+            cache->stmts[i] = nullptr;
+        }
+    }
+}
+
+MYSQL_STMT* sqlConnPool::getStmt(MYSQL* conn, STMT_ID id) {
+    assert(conn && id >= 0 && id < STMT_COUNT);
+    stmtCache* cache = stmtCache_(conn);
+    if(!cache) {
+        return nullptr;
+    }
+    unsigned long threadId = mysql_thread_id(conn);
+    if(cache->threadId != threadId) { // 自动重连后服务端的语句句柄都已失效
+        closeStmts_(cache);
+        cache->threadId = threadId;
+    }
+    if(!cache->stmts[id]) {
+        MYSQL_STMT* stmt = mysql_stmt_init(conn);
+        if(!stmt) {
+            LOG_ERROR("MySQL stmt init error!");
+            return nullptr;
+        }
+        if(mysql_stmt_prepare(stmt, STMT_SQL[id], strlen(STMT_SQL[id]))) {
+            LOG_ERROR("MySQL stmt prepare error: %s", mysql_stmt_error(stmt));
+            mysql_stmt_close(stmt);
+            return nullptr;
+        }
+        cache->stmts[id] = stmt;
+    }
+    return cache->stmts[id];
+}
+
+MYSQL_STMT* sqlConnPool::execStmt(MYSQL* conn, STMT_ID id, MYSQL_BIND* params, unsigned int* errNo) {
+    if(errNo) { *errNo = 0; }
+    for(int retry = 0; retry < 2; retry++) {
+        MYSQL_STMT* stmt = getStmt(conn, id);
+        if(!stmt) {
+            if(retry == 0 && mysql_ping(conn) == 0) { continue; } // 可能是连接断开导致预编译失败
+            return nullptr;
+        }
+        if(mysql_stmt_bind_param(stmt, params) == 0 && mysql_stmt_execute(stmt) == 0) {
+            return stmt;
+        }
+        unsigned int err = mysql_stmt_errno(stmt);
+        if(errNo) { *errNo = err; }
+        // 连接断开，或重连后服务端已不认识该语句句柄
+        if(retry == 0 && (err == CR_SERVER_GONE_ERROR || err == CR_SERVER_LOST || err == ER_UNKNOWN_STMT_HANDLER)) {
+            LOG_WARN("MySQL stmt lost connection, reprepare: %s", mysql_stmt_error(stmt));
+            stmtCache* cache = stmtCache_(conn);
+            closeStmts_(cache);
+            mysql_ping(conn); // 触发自动重连
+            cache->threadId = mysql_thread_id(conn);
+            continue;
+        }
+        if(err == ER_DUP_ENTRY) { // 唯一键冲突由调用方按业务处理
+            LOG_DEBUG("MySQL stmt duplicate entry: %s", mysql_stmt_error(stmt));
+        } else {
+            LOG_ERROR("MySQL stmt execute error: %s", mysql_stmt_error(stmt));
+        }
+        return nullptr;
+    }
+    return nullptr;
+}
@@ -2,35 +2,124 @@
 #define SQLCONNPOOL_H
 
 #include <mysql/mysql.h>
+#include <mysql/errmsg.h>       // CR_SERVER_GONE_ERROR
+#include <mysql/mysqld_error.h> // ER_DUP_ENTRY
 #include <string>
-#include <queue>
+#include <deque>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <unordered_map>
 #include <mutex>
 #include <thread>
+#include <vector>
+#include <condition_variable>
 #include <cassert>
-#include <semaphore.h>
 #include "../log/log.h"
+#include "../metrics/usdt.h"
+
+// 连接池统计，时间单位为微秒
+struct sqlPoolStats {
+    int total;                  // 已建立的连接数（含借出）
+    int idle;
+    int inUse;
+    int waiters;                // 正在等待空闲连接的线程数
+    uint64_t checkouts;         // 成功借出次数
+    uint64_t timeouts;          // 等待超时或快速失败次数
+    uint64_t pingFailures;      // 借出前校验失败而丢弃的连接数
+    uint64_t connectErrors;     // 后台建立连接失败次数
+    uint64_t waitUsTotal;       // 等待空闲连接的累计时间
+    uint64_t waitUsMax;
+    uint64_t checkoutUsTotal;   // 借出总耗时（等待 + 校验）
+    bool ready;                 // 是否已预热到最少连接数
+    uint64_t warmUpUs;          // 从init到预热完成的耗时
+};
 
 
 class sqlConnPool {
 public:
+    // 预编译语句编号，每个连接各自缓存一份
+    enum STMT_ID {
+        STMT_LOGIN_SELECT = 0,  // SELECT password FROM user WHERE username=? LIMIT 1
+        STMT_REGISTER_INSERT,   // INSERT INTO user(username, password) VALUES(?,?)
+        STMT_COUNT,
+    };
+
     static sqlConnPool* getInstance(); // 单例模式
-    MYSQL* getConn(); // 从sql链接池中获取sql链接
+    MYSQL* getConn(int timeoutMS = -1); // 从sql链接池中获取sql链接，超时或数据库不可用时返回nullptr（-1使用默认超时）
     void freeConn(MYSQL* conn); // 释放sql链接回归链接池
+    void dropConn(MYSQL* conn); // 归还一个已损坏的连接，由后台线程补充新连接
     int getFreeConnCount(); // 获取sql链接池中目前有多少空闲链接
+    sqlPoolStats getStats();
+    bool isReady() const { return ready_.load(std::memory_order_acquire); } // 常驻连接是否已全部建立
 
+    // 取出conn上已预编译的语句（首次使用或重连后自动重新预编译），调用方需持有该连接
+    MYSQL_STMT* getStmt(MYSQL* conn, STMT_ID id);
+    // 绑定参数并执行，连接断开时重连、重新预编译后重试一次；失败返回nullptr，errNo带回错误码
+    MYSQL_STMT* execStmt(MYSQL* conn, STMT_ID id, MYSQL_BIND* params, unsigned int* errNo = nullptr);
+
+    // connSize为常驻的最少连接数，maxConnSize为繁忙时可扩展到的上限（0表示与connSize相同）
+    // timeoutMS为借出连接的默认等待上限
+    // 常驻连接并行建立；lazyWarmUp为true时只同步建立第一个连接，其余在后台预热，init立即返回
     void init(const char* host, int port,
               const char* user, const char* pwd,
-              const char* dbName, int connSize);
+              const char* dbName, int connSize,
+              int maxConnSize = 0, int timeoutMS = 500,
+              bool lazyWarmUp = false);
     void closePool();
 
 private:
-    sqlConnPool() = default;
+    sqlConnPool();
     ~sqlConnPool() {closePool();}
 
-    int MAX_CONN_;
-    std::queue<MYSQL*> connQue_;
+    struct idleConn {
+        MYSQL* conn;
+        std::chrono::steady_clock::time_point lastUsed;
+    };
+
+    MYSQL* connect_();                      // 建立一个新连接（不持锁调用）
+    void destroy_(MYSQL* conn);             // 关闭连接并清理语句缓存（调用方持有mtx_）
+    void addConn_(MYSQL* conn);             // 新建的连接放入空闲队列（调用方持有mtx_）
+    void warmUpThread_();                   // 预热线程：建立一个常驻连接
+    void keeperThread_();                   // 后台维护线程：补足/扩容连接、回收长期空闲连接
+
+    struct stmtCache {
+        MYSQL_STMT* stmts[STMT_COUNT];
+        unsigned long threadId;     // 预编译时的服务端连接id，重连后会变化
+    };
+    stmtCache* stmtCache_(MYSQL* conn);
+    static void closeStmts_(stmtCache* cache);
+
+    static const char* STMT_SQL[STMT_COUNT];
+
+    static const int IDLE_CHECK_MS = 30000;     // 空闲超过该时间的连接借出前先mysql_ping校验
+    static const int SHRINK_IDLE_MS = 60000;    // 超出最少连接数且空闲超过该时间的连接会被关闭
+
+    std::string host_, user_, pwd_, dbName_;
+    int port_;
+    int minConn_;
+    int maxConn_;
+    int timeoutMS_;
+
+    std::deque<idleConn> idle_;             // 空闲连接，尾部是最近归还的
+    int total_;                             // 已建立的连接数（含借出）
+    int pending_;                           // 后台正在建立的连接数
+    int waiters_;
+    bool connectFailed_;                    // 最近一次建立连接失败，且池中已无连接时借出直接失败
+    bool isClose_;
+    std::unordered_map<MYSQL*, stmtCache> stmts_; // 每个连接的预编译语句缓存
     std::mutex mtx_;
-    sem_t semId_; // 信号量
+    std::condition_variable cond_;          // 等待空闲连接
+    std::condition_variable keeperCond_;    // 唤醒后台维护线程
+    std::unique_ptr<std::thread> keeper_;
+    std::vector<std::thread> warmers_;      // 并行预热线程，closePool时回收
+
+    std::atomic<bool> ready_;
+    std::chrono::steady_clock::time_point initTime_;
+    std::atomic<uint64_t> warmUpUs_;
+
+    std::atomic<uint64_t> checkouts_, timeouts_, pingFailures_, connectErrors_;
+    std::atomic<uint64_t> waitUsTotal_, waitUsMax_, checkoutUsTotal_;
 };
 
 /* 资源在对象构造时初始化 资源在对象析构时释放*/
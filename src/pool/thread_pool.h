@@ -7,35 +7,52 @@
 #include <functional>
 #include <thread>
 #include <cassert>
+#include <chrono>
+#include "../metrics/metrics.h"
+#include "../metrics/usdt.h"
+#include "codel.h"
 
 class threadPool {
 public:
     threadPool() = default;
     threadPool(threadPool&&) = default;
     // 尽量用make_shared代替new，如果通过new再传递给shared_ptr，内存是不连续的，会造成内存碎片化
-    explicit threadPool(int threadCount = 8) : pool_(std::make_shared<pool>()) { // make_shared:传递右值，功能是在动态内存中分配一个对象并初始化它，返回指向此对象的shared_ptr
+    // threadInit在每个工作线程启动时（取任务之前）执行一次，用于绑核等线程级设置，resize新建的线程同样执行
+    explicit threadPool(int threadCount = 8, std::function<void()> threadInit = nullptr)
+        : pool_(std::make_shared<pool>()) { // make_shared:传递右值，功能是在动态内存中分配一个对象并初始化它，返回指向此对象的shared_ptr
         assert(threadCount > 0);
-        for(int i = 0; i < threadCount; i++) {
-            // 创建 thread，让它去执行声明的匿名函数，且创建完毕就 detach()，由操作系统调度
-            std::thread([this]() { // this 捕获当前类对象
-                std::unique_lock<std::mutex> locker(pool_->mtx_);
-                while(true) {
-                    if(!pool_->tasks_.empty()) {
-                        auto task = std::move(pool_->tasks_.front());
-                        pool_->tasks_.pop();
-                        locker.unlock(); // 任务获取完毕，解锁任务队列，让其他线程可以去获取任务
-                        task();
-                        locker.lock(); // 马上又要取任务了，上锁
-                    } else if(pool_->isClosed_) {
-                        break;
-                    } else {
-                        pool_->cond_.wait(locker); // // 如果任务队列空，并且线程池未关闭，就等待addTask的的通知
-                    }
-
-                }
+        pool_->threadInit_ = std::move(threadInit);
+        resize(threadCount);
+    }
 
-            }).detach();
+    // 调整工作线程数：增加时立即创建，减少时多余的线程做完手头任务后自行退出
+    void resize(int threadCount) {
+        assert(threadCount > 0);
+        {
+            std::unique_lock<std::mutex> locker(pool_->mtx_);
+            pool_->target_ = threadCount;
+            while(pool_->threads_ < threadCount) {
+                pool_->threads_++;
+                // 创建 thread，让它去执行worker_，且创建完毕就 detach()，由操作系统调度
+                // 传入shared_ptr而不是this：threadPool析构后工作线程仍持有pool，取完剩余任务再退出
+                std::thread(worker_, pool_).detach();
+            }
         }
+        pool_->cond_.notify_all(); // 唤醒空闲线程，多出来的线程检查到后退出
+    }
+
+    // 过载判定（见codelMonitor）：任务排队时间在intervalMS内持续超过targetMS时overloaded()返回true，targetMS为0关闭
+    void setOverloadControl(int targetMS, int intervalMS) {
+        pool_->codel_.configure(targetMS * 1000, intervalMS * 1000);
+    }
+    bool overloaded() {
+        return pool_->codel_.overloaded(codelMonitor::nowUs());
+    }
+    const codelMonitor& overloadControl() const { return pool_->codel_; }
+
+    int threadCount() { // 当前工作线程数（缩减时包含还未退出的线程）
+        std::unique_lock<std::mutex> locker(pool_->mtx_);
+        return pool_->threads_;
     }
 
     ~threadPool() {
@@ -49,16 +66,64 @@ public:
     template<typename T>
     void addTask(T&& task) {
         std::unique_lock<std::mutex> locker(pool_->mtx_);
-        pool_->tasks_.emplace(std::forward<T>(task));
+        pool_->tasks_.push({std::forward<T>(task), std::chrono::steady_clock::now()});
+        WS_PROBE1(task_enqueue, pool_->tasks_.size());
         pool_->cond_.notify_one();
     }
 
+    size_t queueSize() { // 排队中的任务数，供指标抓取
+        std::unique_lock<std::mutex> locker(pool_->mtx_);
+        return pool_->tasks_.size();
+    }
+
 private:
+    struct pool;
+    static void worker_(std::shared_ptr<pool> pool_) {
+        if(pool_->threadInit_) {
+            pool_->threadInit_();
+        }
+        std::unique_lock<std::mutex> locker(pool_->mtx_);
+        while(true) {
+            if(pool_->threads_ > pool_->target_) { // 线程数已被调小
+                pool_->threads_--;
+                if(!pool_->tasks_.empty()) { // 可能是被addTask唤醒的，把通知转给其他线程
+                    pool_->cond_.notify_one();
+                }
+                break;
+            } else if(!pool_->tasks_.empty()) {
+                auto task = std::move(pool_->tasks_.front());
+                pool_->tasks_.pop();
+                locker.unlock(); // 任务获取完毕，解锁任务队列，让其他线程可以去获取任务
+                auto now = std::chrono::steady_clock::now();
+                uint64_t waitUs = std::chrono::duration_cast<std::chrono::microseconds>(now - task.enqueued).count();
+                pool_->codel_.onSample(waitUs, std::chrono::duration_cast<std::chrono::microseconds>(
+                    now.time_since_epoch()).count());
+                metrics::add(metrics::TASKS);
+                metrics::add(metrics::TASK_WAIT_US, waitUs);
+                WS_PROBE1(task_dequeue, waitUs);
+                task.func();
+                locker.lock(); // 马上又要取任务了，上锁
+            } else if(pool_->isClosed_) {
+                break;
+            } else {
+                pool_->cond_.wait(locker); // 如果任务队列空，并且线程池未关闭，就等待addTask的的通知
+            }
+        }
+    }
+
+    struct task {
+        std::function<void()> func;
+        std::chrono::steady_clock::time_point enqueued; // 入队时间，用于统计排队等待
+    };
     struct pool {
         std::mutex mtx_;
         std::condition_variable cond_;
-        bool isClosed_;
-        std::queue<std::function<void()>> tasks_; // 任务队列，函数类型为void()
+        bool isClosed_ = false;
+        int threads_ = 0;        // 存活的工作线程数
+        int target_ = 0;         // 期望的工作线程数
+        std::queue<task> tasks_; // 任务队列，函数类型为void()
+        std::function<void()> threadInit_; // 构造后只读
+        codelMonitor codel_;     // 出队时采样排队时间
     };
     std::shared_ptr<pool> pool_;
 };
@@ -0,0 +1,201 @@
+#define LOG_MODULE Log::MODULE_POOL
+#include "user_filter.h"
+#include "sqlconn_pool.h"
+#include <math.h>
+#include <functional>
+
+userFilter::userFilter() {
+    numBits_ = 0;
+    numHashes_ = 0;
+    targetFpr_ = 0;
+    ready_ = false;
+    isClose_ = true;
+    items_ = definiteMisses_ = maybeHits_ = falsePositives_ = 0;
+}
+
+userFilter::~userFilter() {
+    close();
+}
+
+// 懒汉模式 局部静态变量法
+userFilter* userFilter::getInstance() {
+    static userFilter filter;
+    return &filter;
+}
+
+bool userFilter::init(size_t expectedItems, double fpr, size_t maxBytes) {
+    close();
+    if(expectedItems == 0 || fpr <= 0 || fpr >= 1) {
+        return false;
+    }
+    // m = -n*ln(p)/ln(2)^2, k = m/n*ln(2)
+    double ln2 = log(2.0);
+    uint64_t bits = static_cast<uint64_t>(ceil(-static_cast<double>(expectedItems) * log(fpr) / (ln2 * ln2)));
+    if(maxBytes > 0 && bits > maxBytes * 8) {
+        bits = maxBytes * 8;
+    }
+    uint64_t words = (bits + 63) / 64;
+    numBits_ = words * 64;
+    numHashes_ = static_cast<int>(round(static_cast<double>(numBits_) / expectedItems * ln2));
+    numHashes_ = numHashes_ < 1 ? 1 : (numHashes_ > 16 ? 16 : numHashes_);
+    targetFpr_ = fpr;
+    bits_.reset(new std::atomic<uint64_t>[words]); // 只在启动时调用，此时没有并发访问
+    for(uint64_t i = 0; i < words; i++) {
+        bits_[i].store(0, std::memory_order_relaxed);
+    }
+    ready_ = false;
+    isClose_ = false;
+    items_ = definiteMisses_ = maybeHits_ = falsePositives_ = 0;
+    LOG_INFO("UserFilter: %llu KB, %d hashes, expected %zu users",
+             static_cast<unsigned long long>(numBits_ / 8 / 1024), numHashes_, expectedItems);
+    return true;
+}
+
+void userFilter::loadAsync() {
+    if(!isOpen() || loader_) {
+        return;
+    }
+    loader_.reset(new std::thread(&userFilter::loadThread_, this));
+}
+
+void userFilter::load(const std::vector<std::string>& names) {
+    if(!isOpen() || loader_) {
+        return;
+    }
+    for(const std::string& name : names) {
+        add(name);
+    }
+    ready_.store(true, std::memory_order_release);
+}
+
+void userFilter::close() {
+    isClose_ = true;
+    if(loader_ && loader_->joinable()) {
+        loader_->join();
+    }
+    loader_.reset();
+    ready_ = false; // 位数组保留到析构，退出时仍在运行的工作线程不会访问到已释放的内存
+}
+
+void userFilter::loadThread_() {
+    // 连接池可能还在预热，失败后间隔重试
+    for(int retry = 0; !isClose_ && retry < 10; retry++) {
+        if(load_()) {
+            return;
+        }
+        for(int i = 0; i < 10 && !isClose_; i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    }
+    LOG_WARN("UserFilter load failed, registration keeps querying the database");
+}
+
+// mysql_use_result 逐行从服务端读取，不把整张表放进客户端内存
+bool userFilter::load_() {
+    sqlConnPool* pool = sqlConnPool::getInstance();
+    MYSQL* sql = pool->getConn(3000);
+    if(!sql) {
+        return false;
+    }
+    auto begin = std::chrono::steady_clock::now();
+    uint64_t count = 0;
+    bool ok = false;
+    if(mysql_query(sql, "SELECT username FROM user") == 0) {
+        MYSQL_RES* res = mysql_use_result(sql);
+        if(res) {
+            MYSQL_ROW row;
+            while((row = mysql_fetch_row(res)) != nullptr) {
+                unsigned long* lens = mysql_fetch_lengths(res);
+                if(row[0] && lens) {
+                    add(std::string(row[0], lens[0]));
+                    count++;
+                }
+            }
+            ok = (mysql_errno(sql) == 0); // 读取中途断开时结果不完整
+            mysql_free_result(res);
+        }
+    }
+    if(!ok) {
+        LOG_ERROR("UserFilter load error: %s", mysql_error(sql));
+        pool->dropConn(sql);
+        return false;
+    }
+    pool->freeConn(sql);
+    ready_.store(true, std::memory_order_release);
+    userFilterStats stats = getStats();
+    LOG_INFO("UserFilter loaded %llu users in %lldms, fill %.3f, estimated fpr %.4f",
+             static_cast<unsigned long long>(count),
+             static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                 std::chrono::steady_clock::now() - begin).count()),
+             stats.fillRatio, stats.estimatedFpr);
+    return true;
+}
+
+// 64位哈希拆成两个，用 h1 + i*h2 模拟k个哈希函数
+uint64_t userFilter::hash_(const std::string& name) {
+    uint64_t h = std::hash<std::string>()(name);
+    // splitmix64 末端混合，避免 std::hash 低位分布不均
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return h;
+}
+
+void userFilter::add(const std::string& name) {
+    if(!isOpen()) {
+        return;
+    }
+    uint64_t h = hash_(name);
+    uint64_t h1 = h & 0xffffffff, h2 = (h >> 32) | 1;
+    for(int i = 0; i < numHashes_; i++) {
+        uint64_t bit = (h1 + i * h2) % numBits_;
+        bits_[bit / 64].fetch_or(1ULL << (bit % 64), std::memory_order_relaxed);
+    }
+    items_.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool userFilter::mayContain(const std::string& name) {
+    if(!isReady()) {
+        return true;
+    }
+    uint64_t h = hash_(name);
+    uint64_t h1 = h & 0xffffffff, h2 = (h >> 32) | 1;
+    for(int i = 0; i < numHashes_; i++) {
+        uint64_t bit = (h1 + i * h2) % numBits_;
+        if(!(bits_[bit / 64].load(std::memory_order_relaxed) & (1ULL << (bit % 64)))) {
+            definiteMisses_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    }
+    maybeHits_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void userFilter::reportLookup(bool found) {
+    if(isReady() && !found) {
+        falsePositives_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+userFilterStats userFilter::getStats() const {
+    userFilterStats stats;
+    stats.bits = numBits_;
+    stats.hashes = numHashes_;
+    stats.targetFpr = targetFpr_;
+    stats.items = items_;
+    uint64_t set = 0;
+    for(uint64_t i = 0; i < numBits_ / 64; i++) {
+        set += __builtin_popcountll(bits_[i].load(std::memory_order_relaxed));
+    }
+    stats.fillRatio = numBits_ ? static_cast<double>(set) / numBits_ : 0;
+    stats.estimatedFpr = pow(stats.fillRatio, numHashes_);
+    stats.definiteMisses = definiteMisses_;
+    stats.maybeHits = maybeHits_;
+    stats.falsePositives = falsePositives_;
+    uint64_t negatives = stats.falsePositives + stats.definiteMisses;
+    stats.measuredFpr = negatives ? static_cast<double>(stats.falsePositives) / negatives : 0;
+    stats.ready = isReady();
+    return stats;
+}
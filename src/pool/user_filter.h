@@ -0,0 +1,68 @@
+#ifndef USER_FILTER_H
+#define USER_FILTER_H
+
+#include <mysql/mysql.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <stdint.h>
+#include "../log/log.h"
+
+struct userFilterStats {
+    uint64_t bits;
+    int hashes;
+    double targetFpr;           // init时按预计用户数设定的目标误判率
+    uint64_t items;             // 已加入的用户名数（含重复加入）
+    double fillRatio;           // 置1的位所占比例
+    double estimatedFpr;        // 按填充率估算的误判率 fillRatio^k
+    uint64_t definiteMisses;    // 判定一定不存在、跳过SELECT的次数
+    uint64_t maybeHits;         // 判定可能存在、仍需SELECT的次数
+    uint64_t falsePositives;    // 可能存在但SELECT没查到
+    double measuredFpr;         // falsePositives / (falsePositives + definiteMisses)
+    bool ready;
+};
+
+// 用户名布隆过滤器：注册时判定用户名一定不存在则跳过SELECT，直接由唯一键约束保护INSERT
+// 启动时后台线程流式读取user表建立，加载完成前一律返回"可能存在"，走原来的查询路径
+// 位数组为原子字，add/mayContain 无锁，可在多个工作线程并发调用
+class userFilter {
+public:
+    static userFilter* getInstance();
+
+    // expectedItems为预计用户数，按fpr计算位数和哈希函数个数；maxBytes限制位数组大小（0不限制）
+    bool init(size_t expectedItems, double fpr = 0.01, size_t maxBytes = 0);
+    void loadAsync();               // 后台从连接池借连接加载user表
+    void load(const std::vector<std::string>& names);   // 直接用给定的用户名建立并标记就绪（不经数据库，测试用）
+    void close();
+
+    bool isOpen() const { return bits_ != nullptr; }
+    bool isReady() const { return ready_.load(std::memory_order_acquire); }
+
+    bool mayContain(const std::string& name);               // 统计definiteMisses/maybeHits
+    void add(const std::string& name);
+    void reportLookup(bool found);                          // mayContain为真后SELECT的结果，用于统计误判率
+
+    userFilterStats getStats() const;
+
+private:
+    userFilter();
+    ~userFilter();
+
+    bool load_();
+    void loadThread_();
+    static uint64_t hash_(const std::string& name);
+
+    std::unique_ptr<std::atomic<uint64_t>[]> bits_;
+    uint64_t numBits_;
+    int numHashes_;
+    double targetFpr_;
+    std::atomic<bool> ready_;
+    std::atomic<bool> isClose_;
+    std::unique_ptr<std::thread> loader_;
+
+    std::atomic<uint64_t> items_, definiteMisses_, maybeHits_, falsePositives_;
+};
+
+#endif
@@ -0,0 +1,13 @@
+#include "user_store.h"
+#include "mysql_user_store.h"
+
+std::atomic<userStore*> userStore::instance_(nullptr);
+
+userStore* userStore::getInstance() {
+    userStore* store = instance_.load(std::memory_order_acquire);
+    return store ? store : mysqlUserStore::getInstance();
+}
+
+void userStore::setInstance(userStore* store) {
+    instance_.store(store, std::memory_order_release);
+}
@@ -0,0 +1,31 @@
+#ifndef USER_STORE_H
+#define USER_STORE_H
+
+#include <string>
+#include <atomic>
+
+// 用户存储接口：登录校验和注册，httpRequest只依赖这个接口
+// 启动时由webServer选择后端：mysqlUserStore（默认）或嵌入式的memUserStore
+class userStore {
+public:
+    enum RESULT {
+        STORE_OK = 0,
+        STORE_FAIL,             // 登录：用户不存在或密码错误；注册：用户名已被占用
+        STORE_UNAVAILABLE,      // 后端暂时不可用（借不到连接等），应返回503
+    };
+
+    virtual ~userStore() = default;
+
+    virtual RESULT login(const std::string& name, const std::string& passwd) = 0;
+    virtual RESULT registerUser(const std::string& name, const std::string& passwd) = 0;
+    virtual const char* name() const = 0;
+    virtual bool isReady() const { return true; }  // 是否可以满负荷服务（如连接池已预热完成）
+
+    static userStore* getInstance();            // 当前使用的后端
+    static void setInstance(userStore* store);  // 启动时设置，后端对象由各自的单例持有
+
+private:
+    static std::atomic<userStore*> instance_;
+};
+
+#endif
@@ -0,0 +1,221 @@
+#define LOG_MODULE Log::MODULE_SERVER
+#include "admin_server.h"
+#include <algorithm>
+#include <sstream>
+
+adminServer::adminServer() : epoller_(nullptr), listenFd_(-1) {
+    addCommand("help", "help                         list commands", [this](const argList&) {
+        std::string out;
+        for(auto& it : commands_) {
+            out += it.second.usage + "\n";
+        }
+        return out;
+    });
+}
+
+adminServer::~adminServer() {
+    close();
+}
+
+bool adminServer::init(Epoller* epoller, const char* path, int inheritedFd) {
+    assert(epoller && path);
+    if(inheritedFd >= 0) {
+        if(!epoller->addFd(inheritedFd, EPOLLIN)) {
+            LOG_ERROR("Admin socket %s init error: %s", path, strerror(errno));
+            ::close(inheritedFd);
+            return false;
+        }
+        fcntl(inheritedFd, F_SETFL, fcntl(inheritedFd, F_GETFL) | O_NONBLOCK);
+        epoller_ = epoller;
+        listenFd_ = inheritedFd;
+        path_ = path;
+        LOG_INFO("Admin socket: %s (inherited)", path);
+        return true;
+    }
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(strlen(path) >= sizeof(addr.sun_path)) {
+        LOG_ERROR("Admin socket path too long: %s", path);
+        return false;
+    }
+    strcpy(addr.sun_path, path);
+
+    // socket文件已存在：能连上说明另一个实例在用，否则是上次异常退出留下的，删掉重建
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(probe >= 0) {
+        bool inUse = (connect(probe, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+        ::close(probe);
+        if(inUse) {
+            LOG_ERROR("Admin socket %s is in use!", path);
+            return false;
+        }
+    }
+    unlink(path);
+
+    listenFd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(listenFd_ < 0) {
+        LOG_ERROR("Create admin socket error!");
+        return false;
+    }
+    if(bind(listenFd_, (struct sockaddr*)&addr, sizeof(addr)) < 0 || chmod(path, 0600) < 0 ||
+       listen(listenFd_, 4) < 0 || !epoller->addFd(listenFd_, EPOLLIN)) {
+        LOG_ERROR("Admin socket %s init error: %s", path, strerror(errno));
+        ::close(listenFd_);
+        listenFd_ = -1;
+        unlink(path);
+        return false;
+    }
+    epoller_ = epoller;
+    path_ = path;
+    LOG_INFO("Admin socket: %s", path);
+    return true;
+}
+
+void adminServer::close() {
+    while(!clients_.empty()) {
+        closeClient_(clients_.begin()->first);
+    }
+    if(listenFd_ < 0) {
+        return;
+    }
+    epoller_->delFd(listenFd_);
+    ::close(listenFd_);
+    listenFd_ = -1;
+    unlink(path_.c_str());
+}
+
+void adminServer::stopListening() {
+    if(listenFd_ < 0) {
+        return;
+    }
+    epoller_->delFd(listenFd_);
+    ::close(listenFd_);
+    listenFd_ = -1;
+    path_.clear();
+}
+
+void adminServer::addCommand(const std::string& name, const std::string& usage, const handler& func) {
+    commands_[name] = {usage, func};
+}
+
+bool adminServer::ownsFd(int fd) const {
+    return fd >= 0 && (fd == listenFd_ || clients_.count(fd));
+}
+
+void adminServer::handleEvent(int fd, uint32_t events) {
+    if(fd == listenFd_) {
+        accept_();
+        return;
+    }
+    if(events & (EPOLLHUP | EPOLLERR)) {
+        closeClient_(fd);
+        return;
+    }
+    if(events & EPOLLIN) {
+        onRead_(fd);
+    } else if(events & EPOLLOUT) {
+        onWrite_(fd);
+    }
+}
+
+std::string adminServer::execute(const std::string& line) {
+    argList argv;
+    std::istringstream iss(line);
+    std::string word;
+    while(iss >> word) {
+        argv.push_back(word);
+    }
+    if(argv.empty()) {
+        return "";
+    }
+    auto it = commands_.find(argv[0]);
+    if(it == commands_.end()) {
+        return "error: unknown command '" + argv[0] + "', try help";
+    }
+    LOG_INFO("Admin command: %s", line.c_str());
+    return it->second.func(argv);
+}
+
+void adminServer::accept_() {
+    while(true) {
+        int fd = accept4(listenFd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd < 0) {
+            return;
+        }
+        if(clients_.size() >= MAX_CLIENTS || !epoller_->addFd(fd, EPOLLIN)) {
+            ::close(fd);
+            LOG_WARN("Admin clients is full!");
+            continue;
+        }
+        clients_[fd];
+    }
+}
+
+void adminServer::onRead_(int fd) {
+    client& c = clients_[fd];
+    int readErrno = 0;
+    ssize_t len = c.in.readFd(fd, &readErrno);
+    if(len < 0 && readErrno == EAGAIN) {
+        return;
+    }
+    // 按行执行已收到的完整命令，对端关闭写端（如 echo ... | socat）时也要先把已收到的命令执行完
+    while(true) {
+        const char* begin = c.in.peek();
+        const char* end = begin + c.in.readableBytes();
+        const char* eol = std::find(begin, end, '\n');
+        if(eol == end) {
+            break;
+        }
+        std::string line(begin, eol);
+        c.in.retrieveUntil(eol + 1);
+        if(!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        std::string resp = execute(line);
+        if(resp.empty()) {
+            continue;
+        }
+        if(resp.back() != '\n') {
+            resp += '\n';
+        }
+        c.out.append(resp);
+        c.out.append(".\n", 2);
+    }
+    if(c.in.readableBytes() > MAX_LINE) {
+        LOG_WARN("Admin command line too long, closing client[%d]", fd);
+        closeClient_(fd);
+        return;
+    }
+    if(len <= 0) { // 对端已关闭写端或出错，发完响应后关闭
+        c.closing = true;
+    }
+    onWrite_(fd);
+}
+
+void adminServer::onWrite_(int fd) {
+    client& c = clients_[fd];
+    while(c.out.readableBytes() > 0) {
+        ssize_t len = send(fd, c.out.peek(), c.out.readableBytes(), MSG_NOSIGNAL);
+        if(len < 0 && errno == EAGAIN) {
+            break;
+        } else if(len <= 0) {
+            closeClient_(fd);
+            return;
+        }
+        c.out.retrieve(len);
+    }
+    if(c.out.readableBytes() > 0) { // 连接表可能很大，发不完就等可写
+        epoller_->modFd(fd, EPOLLOUT);
+    } else if(c.closing) {
+        closeClient_(fd);
+    } else {
+        epoller_->modFd(fd, EPOLLIN);
+    }
+}
+
+void adminServer::closeClient_(int fd) {
+    epoller_->delFd(fd);
+    ::close(fd);
+    clients_.erase(fd);
+}
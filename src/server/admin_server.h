@@ -0,0 +1,71 @@
+#ifndef ADMIN_SERVER_H
+#define ADMIN_SERVER_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>       // chmod
+#include <sys/un.h>         // sockaddr_un
+
+#include "epoller.h"
+#include "../buffer/buffer.h"
+#include "../log/log.h"
+
+// 管理控制接口：Unix域socket上的按行文本协议，不重启、不断开已有连接即可查看和调整运行状态。
+// 监听fd和客户端fd都注册在webServer的Epoller中（LT），命令在事件循环线程里执行，
+// 因此命令可以直接访问事件循环独占的数据（连接表、定时器）。
+//   socat - UNIX-CONNECT:./webserver.sock
+//   echo "conns 20" | socat - UNIX-CONNECT:./webserver.sock
+// 每行一条命令，参数以空白分隔；每条命令的响应以单独一行 "." 结束，连接保持可继续发送
+class adminServer {
+public:
+    typedef std::vector<std::string> argList;   // argv[0] 为命令名
+    typedef std::function<std::string(const argList& argv)> handler;
+
+    adminServer();
+    ~adminServer();
+
+    // 创建socket文件（权限0600）并注册到epoller；inheritedFd >= 0 时直接使用平滑升级时从旧进程接管的监听fd
+    bool init(Epoller* epoller, const char* path, int inheritedFd = -1);
+    void close();
+    void stopListening();   // 平滑升级：监听fd已交给新进程，停止accept且不删除socket文件
+    int listenFd() const { return listenFd_; }
+    // 注册命令，usage用于help输出；handler返回响应正文，出错时以 "error: " 开头
+    void addCommand(const std::string& name, const std::string& usage, const handler& func);
+
+    bool ownsFd(int fd) const;
+    void handleEvent(int fd, uint32_t events);
+    std::string execute(const std::string& line);   // 执行一行命令并返回响应正文
+
+private:
+    struct client {
+        Buffer in;
+        Buffer out;
+        bool closing = false;   // 对端已关闭写端，响应发完后关闭
+    };
+    struct command {
+        std::string usage;
+        handler func;
+    };
+
+    void accept_();
+    void onRead_(int fd);
+    void onWrite_(int fd);
+    void closeClient_(int fd);
+
+    static const size_t MAX_LINE = 4096;    // 单行命令上限，超过视为异常客户端
+    static const size_t MAX_CLIENTS = 8;
+
+    Epoller* epoller_;
+    int listenFd_;
+    std::string path_;
+    std::map<std::string, command> commands_;   // 有序，help按名字列出
+    std::unordered_map<int, client> clients_;
+};
+
+#endif
@@ -0,0 +1,219 @@
+#define LOG_MODULE Log::MODULE_SERVER
+#include "cpu_placement.h"
+#include <set>
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>    // MPOL_PREFERRED，直接走系统调用，不依赖libnuma
+#include "../log/log.h"
+
+cpuPlacement::cpuPlacement() : enabled_(false), reactorCpu_(-1), node_(0), pinnedWorkers_(0) {}
+
+// 懒汉模式 局部静态变量法
+cpuPlacement* cpuPlacement::getInstance() {
+    static cpuPlacement inst;
+    return &inst;
+}
+
+bool cpuPlacement::parseList(const char* s, std::vector<int>* cpus) {
+    std::set<int> out;
+    while(s && *s) {
+        char* end = nullptr;
+        long lo = strtol(s, &end, 10);
+        if(end == s || lo < 0 || lo >= CPU_SETSIZE) { return false; }
+        long hi = lo;
+        s = end;
+        if(*s == '-') {
+            hi = strtol(s + 1, &end, 10);
+            if(end == s + 1 || hi < lo || hi >= CPU_SETSIZE) { return false; }
+            s = end;
+        }
+        for(long cpu = lo; cpu <= hi; cpu++) {
+            out.insert(static_cast<int>(cpu));
+        }
+        if(*s == ',') {
+            s++;
+        } else if(*s) {
+            return false;
+        }
+    }
+    cpus->assign(out.begin(), out.end());
+    return !cpus->empty();
+}
+
+int cpuPlacement::nodeOf(int cpu) {
+    // /sys/devices/system/cpu/cpuN/ 下有一个 nodeK 的链接
+    std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+    DIR* dir = opendir(path.c_str());
+    if(!dir) {
+        return 0;
+    }
+    int node = 0;
+    while(struct dirent* ent = readdir(dir)) {
+        if(strncmp(ent->d_name, "node", 4) == 0 && ent->d_name[4] >= '0' && ent->d_name[4] <= '9') {
+            node = atoi(ent->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+bool cpuPlacement::init(const char* servingCpus, const char* housekeepingCpus) {
+    std::lock_guard<std::mutex> locker(mtx_);
+    if(!servingCpus || !*servingCpus) {
+        enabled_ = false;
+        return true;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if(sched_getaffinity(0, sizeof(set), &set) < 0) {
+        return false;
+    }
+    allowed_.clear();
+    for(int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if(CPU_ISSET(cpu, &set)) { allowed_.push_back(cpu); }
+    }
+    std::vector<int> serving, housekeeping;
+    if(!parseList(servingCpus, &serving)) {
+        return false;
+    }
+    if(housekeepingCpus && *housekeepingCpus && !parseList(housekeepingCpus, &housekeeping)) {
+        return false;
+    }
+    auto allowed = [this](int cpu) { return std::binary_search(allowed_.begin(), allowed_.end(), cpu); };
+    serving.erase(std::remove_if(serving.begin(), serving.end(), [&](int cpu) { return !allowed(cpu); }), serving.end());
+    housekeeping.erase(std::remove_if(housekeeping.begin(), housekeeping.end(), [&](int cpu) { return !allowed(cpu); }),
+                       housekeeping.end());
+    if(serving.empty()) {
+        return false;
+    }
+    if(housekeeping.empty()) { // 默认：允许的CPU中服务集合以外的部分；服务集合占满时只能共用
+        for(int cpu : allowed_) {
+            if(!std::binary_search(serving.begin(), serving.end(), cpu)) { housekeeping.push_back(cpu); }
+        }
+        if(housekeeping.empty()) { housekeeping = allowed_; }
+    }
+    serving_ = serving;
+    housekeeping_ = housekeeping;
+    enabled_ = true;
+    plan_();
+    return true;
+}
+
+void cpuPlacement::setServing(const std::vector<int>& cpus) {
+    std::lock_guard<std::mutex> locker(mtx_);
+    if(!enabled_ || cpus.empty()) {
+        return;
+    }
+    serving_ = cpus;
+    std::sort(serving_.begin(), serving_.end());
+    plan_();
+}
+
+void cpuPlacement::plan_() {
+    reactorCpu_ = serving_[0];
+    node_ = nodeOf(reactorCpu_);
+    workerCpus_.clear();
+    for(int cpu : serving_) {
+        if(cpu != reactorCpu_ && nodeOf(cpu) == node_) {
+            workerCpus_.push_back(cpu);
+        }
+    }
+    if(workerCpus_.empty()) { // 只有一个服务CPU时线程池与事件循环共用
+        workerCpus_.push_back(reactorCpu_);
+    }
+}
+
+bool cpuPlacement::pin_(const std::vector<int>& cpus, const char* who) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for(int cpu : cpus) {
+        CPU_SET(cpu, &set);
+    }
+    // 只影响调用线程；之后由它创建的线程继承同样的亲和性
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if(err != 0) {
+        LOG_WARN("Pin %s thread to cpus %s error: %s", who, format_(cpus).c_str(), strerror(err));
+        return false;
+    }
+    return true;
+}
+
+void cpuPlacement::preferNode_(int node) {
+    // 默认策略本来就是在本地节点分配，但进程可能在 numactl --interleave 之类的策略下启动（线程继承），这里显式设为本节点优先
+    unsigned long mask = 0;
+    if(node < 0 || node >= static_cast<int>(sizeof(mask) * 8)) {
+        return;
+    }
+    mask = 1UL << node;
+    if(syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask, sizeof(mask) * 8 + 1) < 0) {
+        LOG_DEBUG("set_mempolicy node %d error: %s", node, strerror(errno));
+    }
+}
+
+void cpuPlacement::pinReactor() {
+    std::lock_guard<std::mutex> locker(mtx_);
+    if(!enabled_) {
+        return;
+    }
+    pin_(std::vector<int>(1, reactorCpu_), "reactor");
+    preferNode_(node_);
+}
+
+void cpuPlacement::pinWorker() {
+    std::lock_guard<std::mutex> locker(mtx_);
+    if(!enabled_) {
+        return;
+    }
+    if(pin_(workerCpus_, "worker")) {
+        pinnedWorkers_++;
+    }
+    preferNode_(node_);
+}
+
+void cpuPlacement::pinHousekeeping() {
+    std::lock_guard<std::mutex> locker(mtx_);
+    if(!enabled_) {
+        return;
+    }
+    pin_(housekeeping_, "housekeeping");
+    syscall(SYS_set_mempolicy, MPOL_DEFAULT, nullptr, 0);
+}
+
+std::string cpuPlacement::describe() {
+    std::lock_guard<std::mutex> locker(mtx_);
+    if(!enabled_) {
+        return "placement off, threads are scheduled freely";
+    }
+    std::string out = "serving " + format_(serving_) + "\n";
+    out += "housekeeping " + format_(housekeeping_) + "\n";
+    out += "reactor cpu " + std::to_string(reactorCpu_) + " node " + std::to_string(node_) + "\n";
+    out += "workers cpus " + format_(workerCpus_) + " node " + std::to_string(node_) +
+           " pinned " + std::to_string(pinnedWorkers_.load()) + "\n";
+    std::vector<int> unused;
+    for(int cpu : serving_) {
+        if(cpu != reactorCpu_ && nodeOf(cpu) != node_) { unused.push_back(cpu); }
+    }
+    if(!unused.empty()) {
+        out += "unused (other node) " + format_(unused) + "\n";
+    }
+    return out;
+}
+
+std::string cpuPlacement::format_(const std::vector<int>& cpus) {
+    std::string out;
+    for(size_t i = 0; i < cpus.size(); ) {
+        size_t j = i;
+        while(j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) { j++; }
+        if(!out.empty()) { out += ","; }
+        out += std::to_string(cpus[i]);
+        if(j > i) { out += "-" + std::to_string(cpus[j]); }
+        i = j + 1;
+    }
+    return out;
+}
@@ -0,0 +1,55 @@
+#ifndef CPU_PLACEMENT_H
+#define CPU_PLACEMENT_H
+
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <sched.h>          // sched_setaffinity
+#include <pthread.h>        // pthread_setaffinity_np
+
+// 线程的CPU/NUMA放置策略：处理请求的线程（事件循环、线程池）绑定到服务CPU集合，
+// 日志写线程、日志压缩、SQL预热/保活、布隆过滤器加载等后台线程绑定到后台CPU集合，不与请求线程抢核。
+// - 事件循环独占服务集合中的第一个CPU，线程池线程绑定到同一NUMA节点上的其余服务CPU（作为一个集合，由调度器均衡）
+// - 请求线程的内存策略设为优先本节点：连接对象由事件循环分配，缓冲区由线程池线程扩容，都落在本节点上
+// - 服务集合跨多个NUMA节点时，单进程模式只用事件循环所在节点的CPU，跨节点应使用预派生模式（-w），每个worker一个CPU
+// 后台线程不单独调用接口，而是继承创建者的亲和性：webServer构造时主线程先切到后台集合，
+// 创建完日志、SQL连接池等后台线程后再切回事件循环CPU。之后在请求线程里新建的后台线程会落在服务CPU上。
+// 未配置时（init传空）所有接口都不做任何事，线程由调度器自由安排。
+class cpuPlacement {
+public:
+    static cpuPlacement* getInstance();
+
+    // CPU列表格式同taskset -c："0-3,8,10-11"；housekeeping为空时取允许的CPU中除服务集合外的部分
+    bool init(const char* servingCpus, const char* housekeepingCpus);
+    void setServing(const std::vector<int>& cpus);  // 预派生worker：缩小到分给本进程的CPU
+    bool enabled() const { return enabled_; }
+    const std::vector<int>& servingCpus() const { return serving_; }
+
+    void pinReactor();          // 事件循环线程
+    void pinWorker();           // 线程池线程启动时
+    void pinHousekeeping();     // 调用线程（及其之后创建的线程）切到后台集合
+    std::string describe();     // 管理接口 placement 命令的输出
+
+    static bool parseList(const char* s, std::vector<int>* cpus);
+    static int nodeOf(int cpu); // 读取sysfs，未知时返回0
+
+private:
+    cpuPlacement();
+    void plan_();
+    bool pin_(const std::vector<int>& cpus, const char* who);
+    void preferNode_(int node);
+    static std::string format_(const std::vector<int>& cpus);
+
+    std::mutex mtx_;
+    bool enabled_;
+    std::vector<int> allowed_;          // 启动时允许运行的CPU（taskset/cgroup限制后的集合）
+    std::vector<int> serving_;
+    std::vector<int> housekeeping_;
+    int reactorCpu_;
+    int node_;                          // 事件循环所在NUMA节点
+    std::vector<int> workerCpus_;       // 线程池线程的CPU集合
+    std::atomic<int> pinnedWorkers_;
+};
+
+#endif
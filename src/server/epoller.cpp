@@ -1,3 +1,4 @@
+#define LOG_MODULE Log::MODULE_SERVER
 #include "epoller.h"
 
 Epoller::Epoller(int maxEvent):epollFd_(epoll_create(512)), events_(maxEvent) {
@@ -0,0 +1,159 @@
+#define LOG_MODULE Log::MODULE_SERVER
+#include "listener_handoff.h"
+#include <fstream>
+#include <iterator>
+#include <string.h>
+#include <stdlib.h>
+#include "../log/log.h"
+
+const char* listenerHandoff::ENV_NAME = "WEBSERVER_HANDOFF_FD";
+
+// 新进程里握手socket固定放在fd 3
+static const int HANDOFF_CHILD_FD = 3;
+
+std::vector<std::string> listenerHandoff::readCmdline_() {
+    std::ifstream in("/proc/self/cmdline", std::ios::binary);
+    std::string raw((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    std::vector<std::string> args;
+    size_t start = 0;
+    while(start < raw.size()) {
+        size_t end = raw.find('\0', start);
+        if(end == std::string::npos) { end = raw.size(); }
+        args.push_back(raw.substr(start, end - start));
+        start = end + 1;
+    }
+    return args;
+}
+
+pid_t listenerHandoff::spawn(int* sock) {
+    assert(sock);
+    // 用命令行里的路径而不是/proc/self/exe：部署时可执行文件已被替换，后者指向旧文件
+    std::vector<std::string> args = readCmdline_();
+    if(args.empty()) {
+        LOG_ERROR("Read /proc/self/cmdline error!");
+        return -1;
+    }
+    int fds[2];
+    if(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+        LOG_ERROR("Handoff socketpair error: %s", strerror(errno));
+        return -1;
+    }
+
+    // 多线程进程fork后子进程只能调用async-signal-safe函数，argv/envp在fork前准备好
+    std::vector<char*> argv;
+    for(auto& arg : args) {
+        argv.push_back(&arg[0]);
+    }
+    argv.push_back(nullptr);
+    std::string envVar = std::string(ENV_NAME) + "=" + std::to_string(HANDOFF_CHILD_FD);
+    size_t nameLen = strlen(ENV_NAME);
+    std::vector<char*> envp;
+    for(char** env = environ; *env; env++) {
+        if(strncmp(*env, ENV_NAME, nameLen) != 0 || (*env)[nameLen] != '=') {
+            envp.push_back(*env);
+        }
+    }
+    envp.push_back(&envVar[0]);
+    envp.push_back(nullptr);
+    struct rlimit rl;
+    int maxFd = 65536;
+    if(getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY) {
+        maxFd = static_cast<int>(rl.rlim_cur);
+    }
+
+    pid_t pid = fork();
+    if(pid == 0) {
+        if(fds[1] == HANDOFF_CHILD_FD) {
+            fcntl(HANDOFF_CHILD_FD, F_SETFD, 0);    // dup2到同一个fd不会清除CLOEXEC
+        } else {
+            dup2(fds[1], HANDOFF_CHILD_FD);
+        }
+        // 客户端连接、epoll等没有CLOEXEC的fd不能带进新进程，否则旧进程关闭连接时对端收不到FIN
+#ifdef SYS_close_range
+        if(syscall(SYS_close_range, HANDOFF_CHILD_FD + 1, ~0U, 0) != 0)
+#endif
+        {
+            for(int fd = HANDOFF_CHILD_FD + 1; fd < maxFd; fd++) {
+                close(fd);
+            }
+        }
+        execvpe(argv[0], argv.data(), envp.data());
+        _exit(127);
+    }
+    close(fds[1]);
+    if(pid < 0) {
+        LOG_ERROR("Handoff fork error: %s", strerror(errno));
+        close(fds[0]);
+        return -1;
+    }
+    *sock = fds[0];
+    return pid;
+}
+
+int listenerHandoff::inherited() {
+    const char* env = getenv(ENV_NAME);
+    if(!env) {
+        return -1;
+    }
+    int fd = atoi(env);
+    unsetenv(ENV_NAME); // 本进程再升级时不会误用
+    if(fd < 0 || fcntl(fd, F_GETFD) < 0) {
+        return -1;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    return fd;
+}
+
+bool listenerHandoff::sendFds(int sock, const std::vector<int>& fds) {
+    assert(!fds.empty() && fds.size() <= MAX_FDS);
+    char count = static_cast<char>(fds.size());    // 至少要带一个字节的普通数据
+    struct iovec iov = {&count, 1};
+    char ctrl[CMSG_SPACE(sizeof(int) * MAX_FDS)];
+    memset(ctrl, 0, sizeof(ctrl));
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+    memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+    if(sendmsg(sock, &msg, MSG_NOSIGNAL) != 1) {
+        LOG_ERROR("Handoff sendmsg error: %s", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+std::vector<int> listenerHandoff::recvFds(int sock, int timeoutMS) {
+    std::vector<int> fds;
+    struct timeval tv = {timeoutMS / 1000, (timeoutMS % 1000) * 1000};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    char count = 0;
+    struct iovec iov = {&count, 1};
+    char ctrl[CMSG_SPACE(sizeof(int) * MAX_FDS)];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl;
+    msg.msg_controllen = sizeof(ctrl);
+    if(recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) != 1) {
+        LOG_ERROR("Handoff recvmsg error: %s", strerror(errno));
+        return fds;
+    }
+    for(struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            size_t n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            fds.resize(n);
+            memcpy(fds.data(), CMSG_DATA(cmsg), sizeof(int) * n);
+        }
+    }
+    if(fds.size() != static_cast<size_t>(count)) {
+        LOG_ERROR("Handoff expected %d fds, got %d", count, (int)fds.size());
+    }
+    return fds;
+}
@@ -0,0 +1,34 @@
+#ifndef LISTENER_HANDOFF_H
+#define LISTENER_HANDOFF_H
+
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/resource.h>   // getrlimit
+#include <sys/syscall.h>    // SYS_close_range
+
+// 平滑升级时在新旧进程之间传递监听socket：
+// 1. 旧进程 spawn() 重新exec自身（同样的命令行参数），通过socketpair连接新进程，fd号通过环境变量告知
+// 2. 旧进程 sendFds() 用SCM_RIGHTS发送监听fd（以及管理socket的监听fd），新进程 recvFds() 接管，不重新bind
+// 3. 新进程初始化成功后回一个字节的确认，旧进程收到后停止accept并排空连接；没收到确认则继续服务
+class listenerHandoff {
+public:
+    static const char* ENV_NAME;        // 新进程中记录握手socket fd号的环境变量
+    static const int MAX_FDS = 4;
+
+    // 以相同参数启动新进程，返回子进程pid，*sock为与其通信的socket；失败返回-1
+    static pid_t spawn(int* sock);
+    // 新进程中取出握手socket（同时从环境变量中删除），不是被旧进程拉起时返回-1
+    static int inherited();
+
+    static bool sendFds(int sock, const std::vector<int>& fds);
+    static std::vector<int> recvFds(int sock, int timeoutMS);  // 收到的fd带CLOEXEC
+
+private:
+    static std::vector<std::string> readCmdline_();
+};
+
+#endif
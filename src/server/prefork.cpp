@@ -0,0 +1,182 @@
+#define LOG_MODULE Log::MODULE_SERVER
+#include "prefork.h"
+#include <sys/prctl.h>      // PR_SET_PDEATHSIG
+
+const int preforkMaster::QUICK_EXIT_MS;
+const int preforkMaster::RESTART_DELAY_MS;
+
+preforkMaster::preforkMaster(int workers, const workerMain& func, int reportSec)
+    : func_(func), reportSec_(reportSec), workers_(workers), lastRequests_(0) {
+    assert(workers > 0 && workers <= sharedStats::MAX_WORKERS);
+    for(worker& w : workers_) {
+        w.pid = 0;
+    }
+    if(cpuPlacement::getInstance()->enabled()) { // 配置了服务CPU集合时worker只分到其中的CPU
+        cpus_ = cpuPlacement::getInstance()->servingCpus();
+        return;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if(sched_getaffinity(0, sizeof(set), &set) == 0) { // 只在允许的CPU上分配（taskset/cgroup限制后的集合）
+        for(int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if(CPU_ISSET(cpu, &set)) { cpus_.push_back(cpu); }
+        }
+    }
+}
+
+int preforkMaster::run() {
+    if(!sharedStats::getInstance()->init(static_cast<int>(workers_.size()))) {
+        LOG_ERROR("Prefork shared stats init error!");
+        return 1;
+    }
+    // 信号同步处理：阻塞后在主循环里用sigtimedwait取，worker在fork后恢复原来的信号屏蔽字
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGCHLD);
+    sigaddset(&set, SIGTERM);
+    sigaddset(&set, SIGINT);
+    sigprocmask(SIG_BLOCK, &set, &oldMask_);
+    // master本身和worker里的后台线程（fork后继承）都在后台CPU集合上
+    cpuPlacement::getInstance()->pinHousekeeping();
+
+    for(size_t i = 0; i < workers_.size(); i++) {
+        spawn_(static_cast<int>(i));
+    }
+    LOG_INFO("Prefork master %d started %d workers", getpid(), (int)workers_.size());
+    lastReport_ = std::chrono::steady_clock::now();
+    while(true) {
+        struct timespec ts = {1, 0}; // 每秒醒来处理延迟重启和定期汇总
+        int sig = sigtimedwait(&set, nullptr, &ts);
+        if(sig == SIGTERM || sig == SIGINT) {
+            shutdown_();
+            break;
+        }
+        reap_();
+        auto now = std::chrono::steady_clock::now();
+        for(size_t i = 0; i < workers_.size(); i++) {
+            if(workers_[i].pid == 0 && now >= workers_[i].restartAt) {
+                spawn_(static_cast<int>(i));
+            }
+        }
+        if(reportSec_ > 0 && now - lastReport_ >= std::chrono::seconds(reportSec_)) {
+            report_();
+        }
+    }
+    sigprocmask(SIG_SETMASK, &oldMask_, nullptr);
+    return 0;
+}
+
+void preforkMaster::spawn_(int idx) {
+    pid_t master = getpid();
+    pid_t pid = fork();
+    if(pid == 0) {
+        sigprocmask(SIG_SETMASK, &oldMask_, nullptr);
+        prctl(PR_SET_PDEATHSIG, SIGTERM);  // master被强杀时worker跟着退出
+        if(getppid() != master) {          // prctl之前master已经退出
+            _exit(0);
+        }
+        pinCpu_(idx);
+        sharedStats::getInstance()->attach(idx, 1000);
+        exit(func_(idx));   // 走正常退出流程，单例析构时日志落盘
+    }
+    auto now = std::chrono::steady_clock::now();
+    if(pid < 0) {
+        LOG_ERROR("Fork worker %d error: %s", idx, strerror(errno));
+        workers_[idx].restartAt = now + std::chrono::milliseconds(RESTART_DELAY_MS);
+        return;
+    }
+    workers_[idx].pid = pid;
+    workers_[idx].startAt = now;
+    sharedStats::getInstance()->workerStarted(idx, pid);
+    LOG_INFO("Worker %d started, pid %d, cpu %d", idx, pid,
+             cpus_.empty() ? -1 : cpus_[idx % cpus_.size()]);
+}
+
+void preforkMaster::reap_() {
+    int status = 0;
+    pid_t pid;
+    while((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        for(size_t i = 0; i < workers_.size(); i++) {
+            worker& w = workers_[i];
+            if(w.pid != pid) {
+                continue;
+            }
+            auto now = std::chrono::steady_clock::now();
+            bool quick = now - w.startAt < std::chrono::milliseconds(QUICK_EXIT_MS);
+            w.pid = 0;
+            w.restartAt = quick ? now + std::chrono::milliseconds(RESTART_DELAY_MS) : now;
+            sharedStats::getInstance()->workerExited(static_cast<int>(i));
+            if(WIFSIGNALED(status)) {
+                LOG_ERROR("Worker %d (pid %d) killed by signal %d, restarting%s",
+                          (int)i, pid, WTERMSIG(status), quick ? " after delay" : "");
+            } else {
+                LOG_WARN("Worker %d (pid %d) exited with code %d, restarting%s",
+                         (int)i, pid, WEXITSTATUS(status), quick ? " after delay" : "");
+            }
+        }
+    }
+}
+
+void preforkMaster::shutdown_() {
+    LOG_INFO("Prefork master shutting down");
+    for(worker& w : workers_) {
+        if(w.pid > 0) { kill(w.pid, SIGTERM); }
+    }
+    // 最多等5秒，之后强杀
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    int alive = 0;
+    do {
+        int status = 0;
+        pid_t pid;
+        while((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            for(worker& w : workers_) {
+                if(w.pid == pid) { w.pid = 0; }
+            }
+        }
+        alive = 0;
+        for(worker& w : workers_) {
+            alive += w.pid > 0 ? 1 : 0;
+        }
+        if(alive > 0) { usleep(50 * 1000); }
+    } while(alive > 0 && std::chrono::steady_clock::now() < deadline);
+    for(worker& w : workers_) {
+        if(w.pid > 0) {
+            LOG_WARN("Worker pid %d did not exit, killing", w.pid);
+            kill(w.pid, SIGKILL);
+            waitpid(w.pid, nullptr, 0);
+        }
+    }
+}
+
+void preforkMaster::report_() {
+    sharedStats* stats = sharedStats::getInstance();
+    uint64_t requests = 0;
+    for(int c = metrics::REQ_200; c <= metrics::REQ_OTHER; c++) {
+        requests += stats->total(static_cast<metrics::COUNTER>(c));
+    }
+    auto now = std::chrono::steady_clock::now();
+    double secs = std::chrono::duration<double>(now - lastReport_).count();
+    LOG_INFO("Workers %d/%d alive, restarts %llu, connections %lld, requests %llu (%.1f/s)",
+             stats->aliveWorkers(), stats->workerNum(), (unsigned long long)stats->restarts(),
+             (long long)stats->connections(), (unsigned long long)requests,
+             secs > 0 ? (requests - lastRequests_) / secs : 0.0);
+    lastRequests_ = requests;
+    lastReport_ = now;
+}
+
+void preforkMaster::pinCpu_(int idx) {
+    if(cpus_.empty()) {
+        return;
+    }
+    if(cpuPlacement::getInstance()->enabled()) {
+        // 只缩小服务集合：事件循环和线程池绑到分到的CPU，后台线程留在后台集合
+        cpuPlacement::getInstance()->setServing(std::vector<int>(1, cpus_[idx % cpus_.size()]));
+        return;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpus_[idx % cpus_.size()], &set);
+    if(sched_setaffinity(0, sizeof(set), &set) < 0) { // 之后创建的线程（线程池、日志线程）继承该亲和性
+        LOG_WARN("Worker %d set cpu affinity error: %s", idx, strerror(errno));
+    }
+}
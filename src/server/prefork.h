@@ -0,0 +1,56 @@
+#ifndef PREFORK_H
+#define PREFORK_H
+
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <signal.h>
+#include <unistd.h>
+#include <sched.h>          // sched_setaffinity
+#include <sys/wait.h>       // waitpid
+
+#include "../log/log.h"
+#include "../metrics/shared_stats.h"
+#include "cpu_placement.h"
+
+// 预派生多进程模式（类似nginx的master/worker）：master只负责fork和看护worker，不处理请求；
+// 每个worker是独立的进程，各自运行webServer事件循环，监听socket用SO_REUSEPORT由内核分发连接，
+// 日志、SQL连接池等单例每个进程一份，互不争用。
+// - worker按编号绑定到可用CPU中的一个（线程池线程继承同样的亲和性，worker内线程数宜少）；
+//   配置了CPU放置策略（cpuPlacement）时从服务CPU集合中分配，master和各worker的后台线程在后台集合上
+// - worker异常退出后由master重新拉起，启动后很快又退出的延迟重启，避免fork风暴
+// - SIGTERM/SIGINT：转发给所有worker，等待退出后master退出
+// - 计数器经共享内存汇总（sharedStats），master定期在日志中输出合计
+class preforkMaster {
+public:
+    typedef std::function<int(int worker)> workerMain;     // worker进程入口，返回值为退出码
+
+    preforkMaster(int workers, const workerMain& func, int reportSec = 10);
+    int run();
+
+private:
+    struct worker {
+        pid_t pid;
+        std::chrono::steady_clock::time_point startAt;
+        std::chrono::steady_clock::time_point restartAt;    // 延迟重启的时刻
+    };
+
+    void spawn_(int idx);
+    void reap_();
+    void shutdown_();
+    void report_();
+    void pinCpu_(int idx);
+
+    static const int QUICK_EXIT_MS = 1000;      // 启动后这么快就退出视为启动失败
+    static const int RESTART_DELAY_MS = 1000;
+
+    workerMain func_;
+    int reportSec_;
+    std::vector<worker> workers_;
+    std::vector<int> cpus_;     // master启动时允许运行的CPU
+    sigset_t oldMask_;          // worker恢复用
+    uint64_t lastRequests_;
+    std::chrono::steady_clock::time_point lastReport_;
+};
+
+#endif
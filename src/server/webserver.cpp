@@ -1,56 +1,586 @@
+#define LOG_MODULE Log::MODULE_SERVER
 #include "webserver.h"
 using namespace std;
 
-webServer::webServer(        
-        int port, int trigMode, int timeoutMS,
-        int sqlPort, const char* sqlUser, const char* sqlPasswd,
-        const char* dbName, int connPoolNum, int threadPoolNum,
-        bool openLog, int logLevel, bool isAsync):
-        port_(port), timeoutMS_(timeoutMS), isClose_(false),
-        timer_(new heapTimer()), threadpool_(new threadPool(threadPoolNum)), epoller_(new Epoller()) {
+// 过载时的预构造响应：不经过httpResponse，事件循环线程直接发送后关闭连接
+static const char OVERLOAD_RESPONSE[] =
+    "HTTP/1.1 503 Service Unavailable\r\n"
+    "Retry-After: 1\r\n"
+    "Content-Type: text/plain\r\n"
+    "Content-Length: 21\r\n"
+    "Connection: close\r\n"
+    "\r\n"
+    "Server is overloaded\n";
+
+// 新建连接超过该地址的限速时的预构造响应
+static const char RATE_LIMITED_RESPONSE[] =
+    "HTTP/1.1 429 Too Many Requests\r\n"
+    "Retry-After: 1\r\n"
+    "Content-Type: text/plain\r\n"
+    "Content-Length: 18\r\n"
+    "Connection: close\r\n"
+    "\r\n"
+    "Too many requests\n";
+
+webServer::webServer(const webServerConfig& config):
+        port_(config.port), reusePort_(config.reusePort), timeoutMS_(config.timeoutMS), isClose_(false), listenFd_(-1),
+        handoffFd_(-1), handoffPid_(-1), drainMS_(0), draining_(false),
+        overloadIntervalMS_(config.overloadIntervalMS), acceptPaused_(false),
+        timer_(new heapTimer()), threadpool_(new threadPool(config.threadNum, []() { cpuPlacement::getInstance()->pinWorker(); })),
+        epoller_(new Epoller()) {
+        // 配置了CPU放置策略时，先切到后台CPU集合：下面创建的日志、SQL连接池等后台线程继承该亲和性，初始化完成后再切回事件循环CPU
+        cpuPlacement::getInstance()->pinHousekeeping();
         // 是否打开日志
-        if(openLog) {
-            Log::getInstance()->init(logLevel, "./webserver_log", ".log", isAsync);
+        if(config.openLog) {
+            Log::getInstance()->init(config.logLevel, "./webserver_log", ".log", config.isAsync,
+                                     config.logRollSize, config.logMaxFiles);
+            // 访问日志：成功请求每accessLogSample条记一条，错误请求全部记录
+            if(config.accessLogSample > 0) {
+                accessLog::getInstance()->init("./webserver_log/access.log", config.accessLogSample, 1);
+            }
 
             srcDir_ = getcwd(nullptr, 256);
             assert(srcDir_);
             strcat(srcDir_, "/resources/");
             httpConn::userCount = 0;
             httpConn::srcDir = srcDir_;
+            // 写公平调度：大文件一次最多写writeQuantum字节/writeSliceUs微秒就让出工作线程，小请求不用排在整个下载后面
+            httpConn::writeQuantum = config.writeQuantum;
+            httpConn::writeSliceUs = config.writeSliceUs;
+            httpConn::pacingRate = config.pacingRate;
+            // 打包的静态资源：启动时整体mmap一次（bundlePopulate时预先建立全部页映射），请求不再stat/open/mmap；打不开时仍从目录读取
+            if(config.bundlePath && !resourceBundle::getInstance()->open(config.bundlePath, config.bundlePopulate)) {
+                LOG_ERROR("Open resource bundle %s error: %s, serving from %s", config.bundlePath, strerror(errno), srcDir_);
+            }
 
-            // 初始化SQL连接池(单例模式)
-            sqlConnPool::getInstance()->init("localhost", sqlPort, sqlUser, sqlPasswd, dbName, connPoolNum);
+            if(config.userStoreFile) {
+                // 嵌入式用户存储：不连接MySQL，用户数据在内存哈希表和只追加的数据文件中
+                if(memUserStore::getInstance()->init(config.userStoreFile)) {
+                    userStore::setInstance(memUserStore::getInstance());
+                } else {
+                    LOG_ERROR("User store init error!");
+                    isClose_ = true;
+                }
+            } else if(config.asyncSql) {
+                // 异步SQL模式：数据库连接由事件循环驱动，登录/注册不再占用工作线程等待数据库
+                // 超过sqlQueryTimeoutMS仍未完成的验证按数据库不可用回503
+                asyncSql_.reset(new asyncSqlClient());
+                if(!asyncSql_->init(epoller_.get(), "localhost", config.sqlPort, config.sqlUser, config.sqlPasswd,
+                                    config.dbName, config.connPoolNum, config.sqlQueryTimeoutMS)) {
+                    LOG_ERROR("Async sql init error!");
+                }
+                httpRequest::isAsyncVerify = true;
+            } else {
+                // 初始化SQL连接池(单例模式)：常驻connPoolNum个连接，繁忙时最多扩展到两倍
+                // lazySqlWarmUp时只等第一个连接，其余后台并行预热，静态资源可立即开始服务，预热进度见 /ready
+                sqlConnPool::getInstance()->init("localhost", config.sqlPort, config.sqlUser, config.sqlPasswd, config.dbName,
+                                                 config.connPoolNum, config.connPoolNum * 2, 500, config.lazySqlWarmUp);
+                // 用户名布隆过滤器：按预计用户数和目标误判率分配（不超过userFilterMaxBytes，0不限），后台从user表加载
+                if(config.userFilterItems > 0 &&
+                   userFilter::getInstance()->init(config.userFilterItems, config.userFilterFpr, config.userFilterMaxBytes)) {
+                    userFilter::getInstance()->loadAsync();
+                }
+                // 注册组提交：regBatchMS毫秒内（最多regBatchRows条）的注册合并为一个事务
+                if(config.regBatchRows > 1) {
+                    registerBatcher::getInstance()->init(config.regBatchMS, config.regBatchRows);
+                }
+            }
+            // 已验证凭据缓存（秒）与登录会话cookie有效期（秒），0关闭
+            credentialCache::getInstance()->init(config.credCacheTTL, config.sessionTTL);
+            // 按客户端地址限速（每秒）：新建连接、请求、登录/注册POST，0不限；桶容量为2秒的量
+            if(config.connRate > 0 || config.reqRate > 0 || config.authRate > 0) {
+                rateLimiter* limiter = rateLimiter::getInstance();
+                limiter->init(65536);
+                limiter->setLimit(rateLimiter::CONNECT, config.connRate);
+                limiter->setLimit(rateLimiter::REQUEST, config.reqRate);
+                limiter->setLimit(rateLimiter::AUTH, config.authRate);
+            }
+            // 冷文件预读：写之前检查接下来prefetchWindow字节是否在页缓存中，不在时交给fileIOThreads个I/O线程读入，工作线程不在缺页上阻塞
+            if(config.fileIOThreads > 0 && config.prefetchWindow > 0) {
+                fileIO_.reset(new fileIOPool());
+                if(fileIO_->init(epoller_.get(), config.fileIOThreads)) {
+                    httpConn::prefetchWindow = config.prefetchWindow;
+                } else {
+                    fileIO_.reset();
+                }
+            }
+            // 过载控制：任务排队时间在overloadIntervalMS内持续超过overloadTargetMS时，新请求直接回503，暂停accept
+            threadpool_->setOverloadControl(config.overloadTargetMS, config.overloadIntervalMS);
+            // Prometheus 指标：计数器在请求路径上按线程无锁累加，抓取时汇总
+            initMetrics_(config.metricsPath);
             // 初始化事件触发模式
-            initEventMode_(trigMode);
-            if(!initSocket_()) { isClose_ = true; }
+            initEventMode_(config.trigMode);
+            // 由旧进程平滑升级拉起时，从握手socket接管监听fd（和管理socket的监听fd），不重新bind
+            int handoff = listenerHandoff::inherited();
+            int adminFd = -1;
+            if(handoff >= 0) {
+                std::vector<int> fds = listenerHandoff::recvFds(handoff, 5000);
+                if(fds.empty()) { isClose_ = true; }
+                listenFd_ = fds.size() > 0 ? fds[0] : -1;
+                adminFd = fds.size() > 1 ? fds[1] : -1;
+            }
+            if(!isClose_ && !initSocket_()) { isClose_ = true; }
+            // 管理socket：查看连接表/池状态，调整日志等级、线程数、超时，无需重启
+            initAdmin_(config.adminPath, adminFd);
+            cpuPlacement::getInstance()->pinReactor();
 
             if(isClose_) {
                 LOG_ERROR("================= Server init error! ====================");
             } else {
                 LOG_INFO("================= Server init start! ====================");
                 LOG_INFO("Listen Mode: %s, Http Connection Mode: %s", listenEvent_ & EPOLLET ? "ET" : "LT", connEvent_ & EPOLLET ? "ET" : "LT");
-                LOG_INFO("LogSys Level: %d", logLevel);
+                LOG_INFO("LogSys Level: %d", config.logLevel);
                 LOG_INFO("Resource Dir: %s", httpConn::srcDir);
-                LOG_INFO("sqlConnPool num: %d, threadPool num: %d", connPoolNum, threadPoolNum);
+                resourceBundle* bundle = resourceBundle::getInstance();
+                if(bundle->isOpen()) {
+                    LOG_INFO("Resource bundle: %s, %zu files, %zuB%s", bundle->path().c_str(), bundle->fileCount(),
+                             bundle->size(), bundle->populated() ? ", populated" : "");
+                }
+                LOG_INFO("Metrics: %s", httpConn::metricsPath ? httpConn::metricsPath : "off");
+                LOG_INFO("Admin socket: %s", admin_ ? config.adminPath : "off");
+                LOG_INFO("Write quantum: %zuB/%dus, pacing: %llu B/s", config.writeQuantum, config.writeSliceUs,
+                         (unsigned long long)config.pacingRate);
+                LOG_INFO("File prefetch: %s", fileIO_ ? (std::to_string(fileIO_->threadNum()) + " threads, window " +
+                         std::to_string(httpConn::prefetchWindow) + "B").c_str() : "off");
+                LOG_INFO("Overload control: %s", config.overloadTargetMS > 0 ?
+                         (std::to_string(config.overloadTargetMS) + "ms/" + std::to_string(config.overloadIntervalMS) + "ms").c_str() : "off");
+                std::string placement = cpuPlacement::getInstance()->describe();
+                if(placement.back() == '\n') { placement.pop_back(); }
+                std::replace(placement.begin(), placement.end(), '\n', ';');
+                LOG_INFO("CPU placement: %s", placement.c_str());
+                LOG_INFO("User store: %s, sqlConnPool num: %d, threadPool num: %d",
+                         userStore::getInstance()->name(), config.connPoolNum, config.threadNum);
+            }
+            if(handoff >= 0) { // 初始化成功才确认，旧进程收到后停止accept；失败时旧进程继续服务
+                if(!isClose_ && ::write(handoff, "1", 1) != 1) {
+                    LOG_ERROR("Handoff ack error!");
+                }
+                close(handoff);
             }
 
         }
 }
 
 webServer::~webServer() {
-    close(listenFd_);
+    if(listenFd_ >= 0) {
+        close(listenFd_);
+    }
+    if(handoffFd_ >= 0) {
+        close(handoffFd_);
+    }
     isClose_ = true;
     free(srcDir_);
+    if(asyncSql_) {
+        asyncSql_->close();
+    }
+    if(fileIO_) {
+        fileIO_->close();
+    }
+    admin_.reset();
+    metrics::getInstance()->removeGauge("webserver_threadpool_queue_depth");
+    metrics::getInstance()->removeGauge("webserver_overload_active");
+    metrics::getInstance()->removeGauge("webserver_file_io_pending");
+    accessLog::getInstance()->close();
+    registerBatcher::getInstance()->close();
+    userFilter::getInstance()->close();
     sqlConnPool::getInstance()->closePool();
+    memUserStore::getInstance()->close();
+}
+
+void webServer::initMetrics_(const char* metricsPath) {
+    httpConn::metricsPath = metricsPath;
+    httpConn::tracePhases = (metricsPath != nullptr); // 各阶段耗时的分位数随指标一起输出
+    if(!metricsPath) {
+        return;
+    }
+    // 瞬时值只在抓取时读取，不在请求路径上维护
+    metrics* m = metrics::getInstance();
+    threadPool* pool = threadpool_.get();
+    m->addGauge("webserver_connections_active", "Open client connections (httpConn::userCount).",
+                []() { return static_cast<double>(httpConn::userCount.load()); });
+    m->addGauge("webserver_threadpool_queue_depth", "Tasks waiting for a worker.",
+                [pool]() { return static_cast<double>(pool->queueSize()); });
+    m->addGauge("webserver_overload_active", "1 while overload control is shedding new requests.",
+                [pool]() { return pool->overloaded() ? 1.0 : 0.0; });
+    if(fileIO_) {
+        fileIOPool* fileIO = fileIO_.get();
+        m->addGauge("webserver_file_io_pending", "Cold file reads queued or running on the file I/O threads.",
+                    [fileIO]() { return static_cast<double>(fileIO->pending()); });
+    }
+    if(userStore::getInstance() == mysqlUserStore::getInstance()) {
+        sqlConnPool* sql = sqlConnPool::getInstance();
+        m->addGauge("webserver_sqlpool_connections", "SQL connections established, idle or in use.",
+                    [sql]() { return static_cast<double>(sql->getStats().total); });
+        m->addGauge("webserver_sqlpool_idle_connections", "Idle SQL connections.",
+                    [sql]() { return static_cast<double>(sql->getStats().idle); });
+        m->addGauge("webserver_sqlpool_waiters", "Threads waiting to check out a SQL connection.",
+                    [sql]() { return static_cast<double>(sql->getStats().waiters); });
+        m->addGauge("webserver_sqlpool_checkouts_total", "Successful SQL connection checkouts.",
+                    [sql]() { return static_cast<double>(sql->getStats().checkouts); }, "counter");
+        m->addGauge("webserver_sqlpool_timeouts_total", "SQL connection checkouts that timed out.",
+                    [sql]() { return static_cast<double>(sql->getStats().timeouts); }, "counter");
+        m->addGauge("webserver_sqlpool_wait_microseconds_total", "Time spent waiting for an idle SQL connection.",
+                    [sql]() { return static_cast<double>(sql->getStats().waitUsTotal); }, "counter");
+    }
+    m->addGauge("webserver_log_dropped_bytes_total", "Log bytes dropped because the next mmap log file was not ready.",
+                []() { return static_cast<double>(Log::getInstance()->droppedBytes()); }, "counter");
+    userFilter* filter = userFilter::getInstance();
+    if(filter->isOpen()) {
+        // 填充率和估算误判率要扫一遍位数组，只在抓取时计算
+        m->addGauge("webserver_user_filter_bytes", "Size of the username bloom filter bit array.",
+                    [filter]() { return static_cast<double>(filter->getStats().bits / 8); });
+        m->addGauge("webserver_user_filter_items", "Usernames added to the bloom filter.",
+                    [filter]() { return static_cast<double>(filter->getStats().items); });
+        m->addGauge("webserver_user_filter_target_fpr", "Configured bloom filter false positive rate.",
+                    [filter]() { return filter->getStats().targetFpr; });
+        m->addGauge("webserver_user_filter_estimated_fpr", "False positive rate estimated from the fill ratio.",
+                    [filter]() { return filter->getStats().estimatedFpr; });
+        m->addGauge("webserver_user_filter_measured_fpr", "False positives over all lookups of absent names.",
+                    [filter]() { return filter->getStats().measuredFpr; });
+        m->addGauge("webserver_user_filter_definite_misses_total", "Registrations that skipped the SELECT.",
+                    [filter]() { return static_cast<double>(filter->getStats().definiteMisses); }, "counter");
+        m->addGauge("webserver_user_filter_maybe_hits_total", "Registrations the filter sent to the SELECT.",
+                    [filter]() { return static_cast<double>(filter->getStats().maybeHits); }, "counter");
+        m->addGauge("webserver_user_filter_false_positives_total", "SELECTs sent by the filter that found nothing.",
+                    [filter]() { return static_cast<double>(filter->getStats().falsePositives); }, "counter");
+    }
+    registerBatcher* batcher = registerBatcher::getInstance();
+    if(batcher->isOpen()) {
+        m->addGauge("webserver_register_batches_total", "Register batches committed.",
+                    [batcher]() { return static_cast<double>(batcher->getStats().batches); }, "counter");
+        m->addGauge("webserver_register_rows_total", "Users registered through the batcher.",
+                    [batcher]() { return static_cast<double>(batcher->getStats().rows); }, "counter");
+        m->addGauge("webserver_register_duplicates_total", "Batched registrations rejected as duplicates.",
+                    [batcher]() { return static_cast<double>(batcher->getStats().duplicates); }, "counter");
+        m->addGauge("webserver_register_fallbacks_total", "Register batches retried row by row.",
+                    [batcher]() { return static_cast<double>(batcher->getStats().fallbacks); }, "counter");
+        m->addGauge("webserver_register_batch_max", "Largest register batch so far.",
+                    [batcher]() { return static_cast<double>(batcher->getStats().maxBatch); });
+    }
+    credentialCache* cache = credentialCache::getInstance();
+    m->addGauge("webserver_credential_cache_hits_total", "Logins answered from the credential cache.",
+                [cache]() { return static_cast<double>(cache->getStats().hits); }, "counter");
+    m->addGauge("webserver_credential_cache_misses_total", "Logins that went to the user store.",
+                [cache]() { return static_cast<double>(cache->getStats().misses); }, "counter");
+}
+
+static const char* LOG_MODULE_NAMES[Log::MODULE_COUNT] = {"default", "http", "server", "pool", "timer"};
+static const char* LOG_LEVEL_NAMES[] = {"debug", "info", "warn", "error"};
+
+// 管理命令都在事件循环线程执行，可以直接访问users_、timer_、timeoutMS_
+void webServer::initAdmin_(const char* adminPath, int inheritedFd) {
+    if(!adminPath || isClose_) {
+        if(inheritedFd >= 0) { close(inheritedFd); }
+        return;
+    }
+    admin_.reset(new adminServer());
+    if(!admin_->init(epoller_.get(), adminPath, inheritedFd)) {
+        admin_.reset();
+        return;
+    }
+    admin_->addCommand("conns", "conns [limit]                connection table: fd, peer, state, bytes, requests, age",
+                       [this](const adminServer::argList& argv) {
+        size_t limit = argv.size() > 1 ? strtoul(argv[1].c_str(), nullptr, 10) : SIZE_MAX;
+        std::string out = "fd\tpeer\tstate\tbytes_in\tbytes_out\trequests\tage_ms\n";
+        char line[160];
+        size_t total = 0;
+        for(auto& it : users_) {
+            const httpConn& conn = it.second;
+            if(conn.state() == httpConn::STATE_CLOSED) {
+                continue;
+            }
+            if(total++ >= limit) {
+                continue;
+            }
+            snprintf(line, sizeof(line), "%d\t%s:%d\t%s\t%lu\t%lu\t%u\t%ld\n",
+                     conn.getFd(), conn.getIP(), conn.getPort(), conn.stateName(),
+                     (unsigned long)conn.bytesIn(), (unsigned long)conn.bytesOut(),
+                     conn.requests(), (long)conn.ageMs());
+            out += line;
+        }
+        out += "total " + std::to_string(total);
+        return out;
+    });
+    admin_->addCommand("pools", "pools                        thread pool and SQL pool state",
+                       [this](const adminServer::argList&) {
+        std::string out = "threadpool threads=" + std::to_string(threadpool_->threadCount()) +
+                          " queued=" + std::to_string(threadpool_->queueSize()) + "\n";
+        if(fileIO_) {
+            out += "fileio threads=" + std::to_string(fileIO_->threadNum()) + " pending=" +
+                   std::to_string(fileIO_->pending()) + " window=" + std::to_string(httpConn::prefetchWindow) + "\n";
+        }
+        if(userStore::getInstance() == mysqlUserStore::getInstance()) {
+            sqlPoolStats st = sqlConnPool::getInstance()->getStats();
+            out += "sqlpool total=" + std::to_string(st.total) + " idle=" + std::to_string(st.idle) +
+                   " inUse=" + std::to_string(st.inUse) + " waiters=" + std::to_string(st.waiters) +
+                   " checkouts=" + std::to_string(st.checkouts) + " timeouts=" + std::to_string(st.timeouts) +
+                   " waitUsMax=" + std::to_string(st.waitUsMax) + " ready=" + (st.ready ? "yes" : "no") + "\n";
+        } else {
+            out += std::string("sqlpool off (user store: ") + userStore::getInstance()->name() + ")\n";
+        }
+        if(userFilter::getInstance()->isOpen()) {
+            userFilterStats st = userFilter::getInstance()->getStats();
+            char line[256];
+            snprintf(line, sizeof(line), "userfilter bytes=%llu hashes=%d items=%llu fill=%.3f targetFpr=%.4f "
+                     "estimatedFpr=%.4f measuredFpr=%.4f misses=%llu maybe=%llu falsePositives=%llu ready=%s\n",
+                     (unsigned long long)(st.bits / 8), st.hashes, (unsigned long long)st.items, st.fillRatio,
+                     st.targetFpr, st.estimatedFpr, st.measuredFpr, (unsigned long long)st.definiteMisses,
+                     (unsigned long long)st.maybeHits, (unsigned long long)st.falsePositives, st.ready ? "yes" : "no");
+            out += line;
+        }
+        if(registerBatcher::getInstance()->isOpen()) {
+            registerBatchStats st = registerBatcher::getInstance()->getStats();
+            char line[160];
+            snprintf(line, sizeof(line), "regbatch batches=%llu rows=%llu duplicates=%llu fallbacks=%llu maxBatch=%llu\n",
+                     (unsigned long long)st.batches, (unsigned long long)st.rows, (unsigned long long)st.duplicates,
+                     (unsigned long long)st.fallbacks, (unsigned long long)st.maxBatch);
+            out += line;
+        }
+        return out;
+    });
+    admin_->addCommand("log", "log [module] [level|default]  show or set log level (debug/info/warn/error or 0-3)",
+                       [](const adminServer::argList& argv) {
+        Log* log = Log::getInstance();
+        auto parseLevel = [](const std::string& s) {
+            for(int i = 0; i < 4; i++) {
+                if(s == LOG_LEVEL_NAMES[i] || s == std::to_string(i)) { return i; }
+            }
+            return -2;
+        };
+        if(argv.size() == 2) {
+            int level = parseLevel(argv[1]);
+            if(level < 0) { return std::string("error: bad level '") + argv[1] + "'"; }
+            log->setLevel(level);
+        } else if(argv.size() == 3) {
+            int module = -1;
+            for(int i = 0; i < Log::MODULE_COUNT; i++) {
+                if(argv[1] == LOG_MODULE_NAMES[i]) { module = i; }
+            }
+            int level = argv[2] == "default" ? -1 : parseLevel(argv[2]);
+            if(module < 0) { return std::string("error: unknown module '") + argv[1] + "'"; }
+            if(level < -1) { return std::string("error: bad level '") + argv[2] + "'"; }
+            log->setModuleLevel(module, level);
+        } else if(argv.size() > 3) {
+            return std::string("error: usage: log [module] [level|default]");
+        }
+        auto levelName = [](int level) { return level >= 0 && level < 4 ? LOG_LEVEL_NAMES[level] : "?"; };
+        std::string out = std::string("global ") + levelName(log->getLevel()) + "\n";
+        for(int i = 0; i < Log::MODULE_COUNT; i++) {
+            out += std::string(LOG_MODULE_NAMES[i]) + " " + levelName(log->getLevel(i)) + "\n";
+        }
+        return out;
+    });
+    admin_->addCommand("threads", "threads <n>                  resize the worker thread pool",
+                       [this](const adminServer::argList& argv) {
+        int n = argv.size() == 2 ? atoi(argv[1].c_str()) : 0;
+        if(n <= 0 || n > 1024) {
+            return std::string("error: usage: threads <1-1024>");
+        }
+        threadpool_->resize(n);
+        LOG_INFO("threadPool resized to %d", n);
+        return "threadpool target=" + std::to_string(n);
+    });
+    admin_->addCommand("timeout", "timeout [ms]                 show or set the idle connection timeout",
+                       [this](const adminServer::argList& argv) {
+        if(argv.size() == 2) {
+            int ms = atoi(argv[1].c_str());
+            // 超时为0时连接未加入定时器，运行中无法再打开
+            if(timeoutMS_ <= 0 || ms <= 0) {
+                return std::string(timeoutMS_ <= 0 ? "error: connection timer is disabled"
+                                                   : "error: timeout must be > 0");
+            }
+            timeoutMS_ = ms; // 已有连接在下一次读写事件时按新值续期
+            LOG_INFO("Connection timeout set to %dms", ms);
+        }
+        return "timeout " + std::to_string(timeoutMS_) + "ms";
+    });
+    admin_->addCommand("overload", "overload [target_ms [interval_ms]]  show or set overload control (target 0 turns it off)",
+                       [this](const adminServer::argList& argv) {
+        const codelMonitor& codel = threadpool_->overloadControl();
+        if(argv.size() == 2 || argv.size() == 3) {
+            int targetMS = atoi(argv[1].c_str());
+            int intervalMS = argv.size() == 3 ? atoi(argv[2].c_str()) : codel.intervalUs() / 1000;
+            if(targetMS < 0 || intervalMS <= 0) {
+                return std::string("error: usage: overload [target_ms [interval_ms]]");
+            }
+            threadpool_->setOverloadControl(targetMS, intervalMS);
+            overloadIntervalMS_ = intervalMS;
+            LOG_INFO("Overload control set to %dms/%dms", targetMS, intervalMS);
+        } else if(argv.size() > 3) {
+            return std::string("error: usage: overload [target_ms [interval_ms]]");
+        }
+        metrics* m = metrics::getInstance();
+        return "target " + std::to_string(codel.targetUs() / 1000) + "ms interval " +
+               std::to_string(codel.intervalUs() / 1000) + "ms\n" +
+               "overloaded " + (threadpool_->overloaded() ? "yes" : "no") + " accept " +
+               (acceptPaused_ ? "paused" : "on") + " episodes " + std::to_string(codel.episodes()) + "\n" +
+               "shed requests " + std::to_string(m->value(metrics::SHED_REQUEST)) + " connections " +
+               std::to_string(m->value(metrics::SHED_CONN)) + " accept pauses " +
+               std::to_string(m->value(metrics::ACCEPT_PAUSE)) + " inline " +
+               std::to_string(m->value(metrics::INLINE_TASK)) + "\n";
+    });
+    admin_->addCommand("ratelimit", "ratelimit [conn|req|auth <rate> [burst]]  show or set per-client rate limits (per second, 0 = off)",
+                       [](const adminServer::argList& argv) {
+        rateLimiter* limiter = rateLimiter::getInstance();
+        if(argv.size() == 3 || argv.size() == 4) {
+            int kind = -1;
+            for(int k = 0; k < rateLimiter::KIND_NUM; k++) {
+                if(argv[1] == rateLimiter::kindName(static_cast<rateLimiter::KIND>(k))) { kind = k; }
+            }
+            double rate = atof(argv[2].c_str());
+            double burst = argv.size() == 4 ? atof(argv[3].c_str()) : 0;
+            if(kind < 0 || rate < 0 || burst < 0) {
+                return std::string("error: usage: ratelimit [conn|req|auth <rate> [burst]]");
+            }
+            if(!limiter->isOpen()) {
+                limiter->init(65536);
+            }
+            limiter->setLimit(static_cast<rateLimiter::KIND>(kind), rate, burst);
+            LOG_INFO("Rate limit %s set to %.1f/s", argv[1].c_str(), rate);
+        } else if(argv.size() != 1) {
+            return std::string("error: usage: ratelimit [conn|req|auth <rate> [burst]]");
+        }
+        if(!limiter->isOpen()) {
+            return std::string("rate limiting off");
+        }
+        rateLimiterStats st = limiter->getStats();
+        std::string out;
+        char line[160];
+        for(int k = 0; k < rateLimiter::KIND_NUM; k++) {
+            rateLimiter::KIND kind = static_cast<rateLimiter::KIND>(k);
+            snprintf(line, sizeof(line), "%s rate %.1f burst %.1f allowed %llu limited %llu\n",
+                     rateLimiter::kindName(kind), limiter->rate(kind), limiter->burst(kind),
+                     (unsigned long long)st.allowed[k], (unsigned long long)st.limited[k]);
+            out += line;
+        }
+        out += "clients " + std::to_string(st.clients) + "/" + std::to_string(st.capacity) +
+               " evictions " + std::to_string(st.evictions) + "\n";
+        return out;
+    });
+    admin_->addCommand("bundle", "bundle                       packed resource bundle in use (path, files, size, resident bytes)",
+                       [](const adminServer::argList&) {
+        resourceBundle* bundle = resourceBundle::getInstance();
+        if(!bundle->isOpen()) {
+            return std::string("bundle off, serving from ") + httpConn::srcDir + "\n";
+        }
+        return "bundle " + bundle->path() + " files=" + std::to_string(bundle->fileCount()) +
+               " size=" + std::to_string(bundle->size()) + " resident=" + std::to_string(bundle->residentBytes()) +
+               " populated=" + (bundle->populated() ? "yes" : "no") + "\n";
+    });
+    admin_->addCommand("placement", "placement                    CPU sets and NUMA node of reactor, worker and housekeeping threads",
+                       [](const adminServer::argList&) {
+        return cpuPlacement::getInstance()->describe();
+    });
+    if(reusePort_) { // 预派生模式下由master管理worker进程，不支持单个worker自行升级
+        return;
+    }
+    admin_->addCommand("upgrade", "upgrade [drain_ms]           exec a new process with the same args and hand over the listener",
+                       [this](const adminServer::argList& argv) {
+        int drainMS = argv.size() > 1 ? atoi(argv[1].c_str()) : 30000;
+        if(drainMS <= 0) {
+            return std::string("error: drain_ms must be > 0");
+        }
+        if(handoffFd_ >= 0 || draining_) {
+            return std::string("error: upgrade already in progress");
+        }
+        if(!startUpgrade_(drainMS)) {
+            return std::string("error: upgrade failed, see log");
+        }
+        return "new process " + std::to_string(handoffPid_) + " started, this process drains once it is ready";
+    });
+}
+
+bool webServer::startUpgrade_(int drainMS) {
+    int sock = -1;
+    pid_t pid = listenerHandoff::spawn(&sock);
+    if(pid < 0) {
+        return false;
+    }
+    std::vector<int> fds = {listenFd_};
+    if(admin_ && admin_->listenFd() >= 0) {
+        fds.push_back(admin_->listenFd());
+    }
+    if(!listenerHandoff::sendFds(sock, fds) || !epoller_->addFd(sock, EPOLLIN | EPOLLRDHUP)) {
+        close(sock);
+        kill(pid, SIGTERM);
+        waitpid(pid, nullptr, 0);
+        return false;
+    }
+    handoffFd_ = sock;
+    handoffPid_ = pid;
+    drainMS_ = drainMS;
+    LOG_INFO("Upgrade: listener handed to new process %d, waiting for it to be ready", pid);
+    return true;
+}
+
+void webServer::onHandoff_() {
+    char ack = 0;
+    ssize_t len = read(handoffFd_, &ack, 1);
+    epoller_->delFd(handoffFd_);
+    close(handoffFd_);
+    handoffFd_ = -1;
+    if(len != 1) { // 新进程初始化失败或已退出，监听fd仍在本进程，继续服务
+        LOG_ERROR("Upgrade: new process %d failed to start, keep serving", handoffPid_);
+        waitpid(handoffPid_, nullptr, WNOHANG);
+        return;
+    }
+    LOG_INFO("Upgrade: new process %d is ready", handoffPid_);
+    startDrain_();
+}
+
+void webServer::startDrain_() {
+    epoller_->delFd(listenFd_);
+    close(listenFd_);   // 新进程持有同一个监听socket，未accept的连接留给它
+    listenFd_ = -1;
+    if(admin_) {
+        admin_->stopListening();
+    }
+    draining_ = true;
+    httpConn::draining = true;
+    drainDeadline_ = std::chrono::steady_clock::now() + std::chrono::milliseconds(drainMS_);
+    // 之后的响应都带 Connection: close，写完即关闭。空闲的keep-alive连接不立即关闭（客户端可能正要复用，
+    // 会收到RST），而是把超时缩短到宽限期：期间来的请求正常响应后关闭，仍然空闲的由定时器关闭
+    int graceMS = std::min(1000, drainMS_ / 2);
+    int idle = 0;
+    for(auto& it : users_) {
+        if(it.second.state() != httpConn::STATE_READ) {
+            continue;
+        }
+        if(timeoutMS_ > 0) {
+            timer_->adjust(it.second.getFd(), graceMS);
+        } else {
+            closeConn_(&it.second);
+        }
+        idle++;
+    }
+    if(timeoutMS_ > 0) {
+        timeoutMS_ = std::min(timeoutMS_, graceMS);
+    }
+    LOG_INFO("Draining: %d idle connections, %d total, deadline %dms",
+             idle, (int)httpConn::userCount, drainMS_);
 }
 
 void webServer::start() {
     int timeMS = -1; // epoll wait timeout == -1 无事件将阻塞
     if(!isClose_) { LOG_INFO("=============== Server start ================="); }
     while(!isClose_) {
+        if(draining_ && (httpConn::userCount == 0 || std::chrono::steady_clock::now() >= drainDeadline_)) {
+            LOG_INFO("Drain finished, %d connections left, exit", (int)httpConn::userCount);
+            break;
+        }
         if(timeoutMS_ > 0) {
             timeMS = timer_->getNextTick();
         }
+        if(draining_ && (timeMS < 0 || timeMS > 100)) {
+            timeMS = 100;   // 排空期间定期检查是否可以退出
+        }
+        if(acceptPaused_) {
+            if(!threadpool_->overloaded()) {
+                resumeAccept_();
+            } else if(timeMS < 0 || timeMS > overloadIntervalMS_) {
+                timeMS = overloadIntervalMS_;   // 暂停期间没有新连接事件，定期检查是否恢复
+            }
+        }
         int eventCnt = epoller_->wait(timeMS);
         for(int i = 0; i < eventCnt; i++) {
             /* 处理事件 */
@@ -58,6 +588,14 @@ void webServer::start() {
             uint32_t events = epoller_->getEvents(i);
             if(fd == listenFd_) {
                 dealListen_();
+            } else if(fd == handoffFd_) {
+                onHandoff_();
+            } else if(asyncSql_ && asyncSql_->ownsFd(fd)) {
+                asyncSql_->handleEvent(fd, events);
+            } else if(fileIO_ && fileIO_->ownsFd(fd)) {
+                fileIO_->handleEvent(fd, events);
+            } else if(admin_ && admin_->ownsFd(fd)) {
+                admin_->handleEvent(fd, events);
             } else if(events & (EPOLLHUP | EPOLLRDHUP | EPOLLERR)) {
                 assert(users_.count(fd) > 0);
                 closeConn_(&users_[fd]);
@@ -75,6 +613,16 @@ void webServer::start() {
 }
 
 bool webServer::initSocket_() {
+    if(listenFd_ >= 0) { // 平滑升级时从旧进程接管的监听socket，已经bind和listen
+        if(!epoller_->addFd(listenFd_, listenEvent_ | EPOLLIN)) {
+            LOG_ERROR("Add listen error!");
+            close(listenFd_);
+            return false;
+        }
+        setFdNonBlock(listenFd_);
+        LOG_INFO("Server port:%d (inherited listen fd)", port_);
+        return true;
+    }
     int ret;
     struct sockaddr_in addr;
     addr.sin_family = AF_INET;
@@ -96,6 +644,11 @@ bool webServer::initSocket_() {
         close(listenFd_);
         return false;
     }
+    if(reusePort_ && setsockopt(listenFd_, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(int)) == -1) {
+        LOG_ERROR("set SO_REUSEPORT error !");
+        close(listenFd_);
+        return false;
+    }
 
     // 绑定
     ret = bind(listenFd_, (struct sockaddr *)&addr, sizeof(addr));
@@ -156,7 +709,6 @@ void webServer::addClient_(int fd, sockaddr_in addr) {
     }
     epoller_->addFd(fd, EPOLLIN | connEvent_);
     setFdNonBlock(fd);
-    LOG_INFO("Client[%d] in!", users_[fd].getFd());
 }
 
 // 处理监听套接字，主要逻辑是accept新的套接字，并加入timer和epoller中
@@ -167,10 +719,17 @@ void webServer::dealListen_() {
         int fd = accept(listenFd_, (struct sockaddr *)&addr, &len);
         if(fd <= 0) { return;}
         else if(httpConn::userCount >= MAX_FD) {
-            sendError_(fd, "Server busy!");
+            metrics::add(metrics::SHED_CONN);
+            sendError_(fd, OVERLOAD_RESPONSE);
             LOG_WARN("Clients is full!");
             return;
         }
+        if(!rateLimiter::getInstance()->allow(addr.sin_addr.s_addr, rateLimiter::CONNECT)) {
+            metrics::add(metrics::LIMITED_CONN);
+            sendError_(fd, RATE_LIMITED_RESPONSE);
+            continue;
+        }
+        WS_PROBE2(conn_accept, fd, addr.sin_addr.s_addr);
         addClient_(fd, addr);
     } while(listenEvent_ & EPOLLET);
 }
@@ -179,19 +738,90 @@ void webServer::dealListen_() {
 void webServer::dealWrite_(httpConn* client) {
     assert(client);
     extentTime_(client);
-    threadpool_->addTask(std::bind(&webServer::onWrite_, this, client));
+    if(threadpool_->overloaded() && (fileIO_ || client->fileBytesLen() == 0)) {
+        // 响应已经生成好，直接在事件循环里写，不再到拥堵的队列里排队。只做一次writev，大响应不会占住事件循环；
+        // 文件部分只在有文件I/O线程时内联，写前已确认驻留，否则冷页会让事件循环阻塞在缺页上
+        metrics::add(metrics::INLINE_TASK);
+        onWrite_(client, true);
+        return;
+    }
+    threadpool_->addTask(std::bind(&webServer::onWrite_, this, client, false));
 }
 
 // 处理读事件，主要逻辑是将OnRead加入线程池的任务队列中
 void webServer::dealRead_(httpConn* client) {
     assert(client);
+    if(threadpool_->overloaded()) {
+        if(!isProbeRequest_(client->getFd())) {
+            shedRequest_(client);
+            return;
+        }
+        // 探针和指标抓取处理很轻，在事件循环里直接处理，过载时正需要它们
+        metrics::add(metrics::INLINE_TASK);
+        extentTime_(client);
+        client->markReadReady();
+        onRead_(client);
+        return;
+    }
     extentTime_(client);
+    client->markReadReady();
     threadpool_->addTask(std::bind(&webServer::onRead_, this, client)); // 这是一个右值，bind将参数和函数绑定
 }
 
+bool webServer::isProbeRequest_(int fd) {
+    char buf[256];
+    ssize_t n = recv(fd, buf, sizeof(buf) - 1, MSG_PEEK | MSG_DONTWAIT); // 只窥探，数据留给onRead_读取
+    if(n <= 4 || strncmp(buf, "GET ", 4) != 0) {
+        return false;
+    }
+    buf[n] = '\0';
+    const char* paths[] = {"/ready", httpConn::metricsPath};
+    for(const char* path : paths) {
+        size_t len = path ? strlen(path) : 0;
+        if(len > 0 && strncmp(buf + 4, path, len) == 0 && buf[4 + len] == ' ') {
+            return true;
+        }
+    }
+    return false;
+}
+
+void webServer::shedRequest_(httpConn* client) {
+    int fd = client->getFd();
+    // 先读掉已到达的请求：带着未读数据close会发RST，客户端可能收不到503
+    char buf[4096];
+    for(int i = 0; i < 16 && recv(fd, buf, sizeof(buf), MSG_DONTWAIT) > 0; i++) {}
+    if(send(fd, OVERLOAD_RESPONSE, sizeof(OVERLOAD_RESPONSE) - 1, MSG_DONTWAIT | MSG_NOSIGNAL) < 0) {
+        LOG_DEBUG("send 503 to client[%d] error: %s", fd, strerror(errno));
+    }
+    metrics::add(metrics::SHED_REQUEST);
+    metrics::addRequest(503);
+    closeConn_(client);
+    pauseAccept_();
+}
+
+void webServer::pauseAccept_() {
+    if(acceptPaused_ || listenFd_ < 0) {
+        return;
+    }
+    // 新连接留在内核的全连接队列里（满了以后客户端的SYN重传），等排队时间回落后再accept
+    epoller_->modFd(listenFd_, listenEvent_);
+    acceptPaused_ = true;
+    metrics::add(metrics::ACCEPT_PAUSE);
+    LOG_WARN("Overloaded, shedding new requests and pausing accept");
+}
+
+void webServer::resumeAccept_() {
+    acceptPaused_ = false;
+    if(listenFd_ < 0) {
+        return;
+    }
+    epoller_->modFd(listenFd_, listenEvent_ | EPOLLIN); // EPOLL_CTL_MOD会重新检查就绪状态，暂停期间到达的连接不会丢事件
+    LOG_INFO("Overload cleared, accept resumed");
+}
+
 void webServer::sendError_(int fd, const char*info) {
     assert(fd > 0);
-    int ret = send(fd, info, strlen(info), 0);
+    int ret = send(fd, info, strlen(info), MSG_DONTWAIT | MSG_NOSIGNAL);
     if(ret < 0) {
         LOG_WARN("send error to client[%d] error!", fd);
     }
@@ -227,6 +857,10 @@ void webServer::onRead_(httpConn* client) {
 void webServer::onProcess(httpConn* client) {
     // 首先调用process()进行逻辑处理
     if(client->process()) { // 根据返回的信息重新将fd置为EPOLLOUT（写）或EPOLLIN（读）
+        if(client->isVerifyPending()) { // 登录/注册交给异步SQL，结果回来后再注册写事件
+            verifyAsync_(client);
+            return;
+        }
     //读完事件就跟内核说可以写了
         epoller_->modFd(client->getFd(), connEvent_ | EPOLLOUT);    // 响应成功，修改监听事件为写,等待OnWrite_()发送
     } else {
@@ -235,25 +869,71 @@ void webServer::onProcess(httpConn* client) {
     }
 }
 
-void webServer::onWrite_(httpConn* client) {
+void webServer::verifyAsync_(httpConn* client) {
+    uint64_t generation = client->generation();
+    // 回调在事件循环线程执行，连接在等待期间可能已超时关闭甚至被新连接复用
+    client->request().verifyAsync(asyncSql_.get(), [this, client, generation](httpRequest::VERIFY_RESULT ret) {
+        if(client->generation() != generation) {
+            return;
+        }
+        extentTime_(client); // SQL可能很慢，结果回来后重新计时，生成响应期间不会被定时器关闭
+        threadpool_->addTask(std::bind(&webServer::onResume_, this, client, generation, ret));
+    });
+}
+
+void webServer::onResume_(httpConn* client, uint64_t generation, httpRequest::VERIFY_RESULT ret) {
+    assert(client);
+    if(client->generation() != generation) { // 排队期间连接仍可能被关闭或复用
+        return;
+    }
+    client->resume(ret);
+    epoller_->modFd(client->getFd(), connEvent_ | EPOLLOUT);
+}
+
+void webServer::prefetchAsync_(httpConn* client, const std::string& path, size_t offset, size_t len) {
+    uint64_t generation = client->generation();
+    // 回调在事件循环线程执行；预读期间连接没有注册事件，只可能被定时器关闭
+    fileIO_->read(path, offset, len, [this, client, generation, path](bool ok) {
+        if(client->generation() != generation) {
+            return;
+        }
+        if(ok) {
+            client->markPrefetched();
+        } else {
+            metrics::add(metrics::FILE_PREFETCH_FAILED);
+            LOG_WARN("Client[%d] prefetch %s failed, writing without it", client->getFd(), path.c_str());
+            client->prefetchFailed();
+        }
+        dealWrite_(client);
+    });
+}
+
+void webServer::onWrite_(httpConn* client, bool inlined) {
     assert(client);
     int ret = -1;
     int writeErrno = 0;
-    ret = client->write(&writeErrno);
+    std::string path;
+    size_t offset = 0, len = 0;
+    if(fileIO_ && client->needPrefetch(&path, &offset, &len)) {
+        // 接下来要写的文件不在页缓存中：不在这里缺页等磁盘，交给文件I/O线程读入后再继续
+        prefetchAsync_(client, path, offset, len);
+        return;
+    }
+    ret = client->write(&writeErrno, inlined);
     if(client->writeBytesLen() == 0) {
         /* 传输完成 */
+        client->logAccess();
         if(client->isKeepAlive()) {
             // OnProcess(client);
             epoller_->modFd(client->getFd(), connEvent_ | EPOLLIN); // 回归换成监测读事件
             return;
         }
     }
-    else if(ret < 0) {
-        if(writeErrno == EAGAIN) {  // 缓冲区满了 
-            /* 继续传输 */
-            epoller_->modFd(client->getFd(), connEvent_ | EPOLLOUT);
-            return;
-        }
+    else if(ret > 0 || writeErrno == EAGAIN) {
+        // 缓冲区满了，或用完了写配额主动让出（LT模式下剩余不多时也会先返回）
+        /* 继续传输：重新注册EPOLLOUT，可写事件到来后排到任务队列末尾 */
+        epoller_->modFd(client->getFd(), connEvent_ | EPOLLOUT);
+        return;
     }
     closeConn_(client);
 }
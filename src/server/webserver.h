@@ -2,8 +2,10 @@
 #define WEBSERVER_H
 
 #include <unordered_map>
+#include <algorithm>
 #include <fcntl.h>              // fcntl()
 #include <unistd.h>             // close()
+#include <sys/wait.h>           // waitpid()
 #include <assert.h>
 #include <errno.h>
 #include <sys/socket.h>
@@ -11,27 +13,97 @@
 #include <arpa/inet.h>
 
 #include "epoller.h"
+#include "admin_server.h"
+#include "listener_handoff.h"
+#include "cpu_placement.h"
 #include "../timer/heap_timer.h"
 #include "../log/log.h"
 #include "../pool/sqlconn_pool.h"
 #include "../pool/thread_pool.h"
+#include "../pool/async_sqlconn.h"
+#include "../pool/file_io_pool.h"
+#include "../pool/mysql_user_store.h"
+#include "../pool/mem_user_store.h"
 #include "../http/http_conn.h"
+#include "../metrics/metrics.h"
+#include "../metrics/usdt.h"
+
+// 服务器配置：按字段名赋值，未赋值的字段取默认值；可选功能默认关闭（0/nullptr/false）
+struct webServerConfig {
+    int port = 1316;
+    int trigMode = 3;                   // 0~3，监听和连接是否使用ET
+    int timeoutMS = 60000;              // 空闲连接超时，0不超时
+
+    // MySQL
+    int sqlPort = 3306;
+    const char* sqlUser = "root";
+    const char* sqlPasswd = "";
+    const char* dbName = "mydb";
+    int connPoolNum = 16;
+    int threadNum = 8;                  // 线程池线程数
+
+    // 日志
+    bool openLog = true;
+    int logLevel = 1;
+    bool isAsync = true;                // 异步写日志
+    size_t logRollSize = 0;             // 单个日志文件大小（mmap写入），0按行数滚动
+    int logMaxFiles = 0;                // 保留的历史日志数，0不限
+    int accessLogSample = 0;            // 访问日志采样率（每N条记一条），0关闭
+
+    // 用户验证
+    bool asyncSql = false;              // 异步SQL模式：登录/注册由事件循环驱动
+    int sqlQueryTimeoutMS = 0;          // 异步SQL验证期限，超时回503，0不限
+    bool lazySqlWarmUp = false;         // SQL连接池后台并行预热
+    int credCacheTTL = 0;               // 登录凭据缓存时间（秒），0关闭
+    int sessionTTL = 0;                 // 会话cookie有效期（秒），0关闭
+    size_t userFilterItems = 0;         // 用户名布隆过滤器预计用户数，0关闭
+    double userFilterFpr = 0.01;        // 目标误判率
+    size_t userFilterMaxBytes = 0;      // 位数组上限（字节），0不限
+    int regBatchMS = 0;                 // 注册组提交窗口（毫秒）
+    int regBatchRows = 0;               // 每批最多条数，<=1关闭
+    const char* userStoreFile = nullptr;    // 嵌入式用户存储文件，nullptr使用MySQL
+
+    // 管理与观测
+    const char* metricsPath = nullptr;  // Prometheus指标路径，nullptr关闭
+    const char* adminPath = nullptr;    // 管理控制socket路径，nullptr关闭
+    bool reusePort = false;             // SO_REUSEPORT（预派生模式）
+
+    // 过载与限速
+    int overloadTargetMS = 0;           // 任务排队时间目标，0关闭过载控制
+    int overloadIntervalMS = 100;       // 判定窗口
+    double connRate = 0;                // 按客户端地址限速（每秒）：新建连接 请求 登录/注册，0不限
+    double reqRate = 0;
+    double authRate = 0;
+
+    // 写调度与静态资源
+    size_t writeQuantum = 0;            // 每次写的配额（字节），0不限
+    int writeSliceUs = 0;               // 每次写的时间片（微秒），0不限
+    uint64_t pacingRate = 0;            // 大响应按连接限速（字节/秒），0不限
+    int fileIOThreads = 0;              // 冷文件预读I/O线程数，0关闭
+    size_t prefetchWindow = 0;          // 写前检查驻留的窗口（字节），0关闭
+    const char* bundlePath = nullptr;   // 打包的静态资源，nullptr从resources目录读取
+    bool bundlePopulate = false;        // 启动时预先载入bundle的全部页
+};
 
 class webServer {
 public:
-    webServer(
-        int port, int trigMode, int timeoutMS,
-        int sqlPort, const char* sqlUser, const char* sqlPasswd,
-        const char* dbName, int connPoolNum, int threadNum,
-        bool openLog, int logLevel, bool isAsync
-    );
+    explicit webServer(const webServerConfig& config);
     ~webServer();
     void start();
 
 private:
     bool initSocket_();
     void initEventMode_(int trigMode);
+    void initMetrics_(const char* metricsPath);
+    void initAdmin_(const char* adminPath, int inheritedFd = -1);
+    bool startUpgrade_(int drainMS);    // 拉起新进程并把监听fd交给它
+    void onHandoff_();                  // 新进程的就绪确认
+    void startDrain_();                 // 停止accept，关闭空闲连接，处理中的连接写完后关闭
     void addClient_(int fd, sockaddr_in addr);
+    void shedRequest_(httpConn* client);    // 过载：直接回503并关闭，不进线程池
+    static bool isProbeRequest_(int fd);    // 窥探请求行：就绪探针和指标抓取过载时也要回答
+    void pauseAccept_();
+    void resumeAccept_();
 
     void dealListen_();
     void dealWrite_(httpConn* client);
@@ -42,25 +114,43 @@ private:
     void closeConn_(httpConn* client);
 
     void onRead_(httpConn* client);
-    void onWrite_(httpConn* client);
+    void onWrite_(httpConn* client, bool inlined);  // inlined：在事件循环里执行，只写一次
     void onProcess(httpConn* client);
+    void verifyAsync_(httpConn* client);
+    void onResume_(httpConn* client, uint64_t generation, httpRequest::VERIFY_RESULT ret);
+    void prefetchAsync_(httpConn* client, const std::string& path, size_t offset, size_t len);
 
     static const int MAX_FD = 65536;
     static int setFdNonBlock(int fd);
 
     int port_;
+    bool reusePort_;    // 预派生模式：每个worker各自bind同一端口，由内核分发连接
     // bool openLinger_;
     int timeoutMS_; // 毫秒 MS
     bool isClose_;
     int listenFd_;
     char* srcDir_;
 
+    // 平滑升级
+    int handoffFd_;         // 与新进程的握手socket，-1表示没有进行中的升级
+    pid_t handoffPid_;
+    int drainMS_;           // 收到确认后排空连接的最长时间
+    bool draining_;
+    std::chrono::steady_clock::time_point drainDeadline_;
+
+    // 过载控制：线程池排队时间持续超标时拒绝新请求并暂停accept
+    int overloadIntervalMS_;
+    bool acceptPaused_;
+
     uint32_t listenEvent_; // 监听事件
     uint32_t connEvent_;   // 连接事件
 
     std::unique_ptr<heapTimer> timer_;
     std::unique_ptr<threadPool> threadpool_;
     std::unique_ptr<Epoller> epoller_;
+    std::unique_ptr<asyncSqlClient> asyncSql_;     // 异步SQL模式下的数据库客户端，socket注册在epoller_中
+    std::unique_ptr<fileIOPool> fileIO_;           // 冷文件预读线程组，完成通知的eventfd注册在epoller_中
+    std::unique_ptr<adminServer> admin_;           // 管理控制socket，命令在事件循环线程执行
     std::unordered_map<int, httpConn> users_;
 
 };
@@ -1,3 +1,4 @@
+#define LOG_MODULE Log::MODULE_TIMER
 #include "heap_timer.h"
 
 void heapTimer::add(int id, int timeOut, const timeOutCallBack& cb) {
@@ -28,6 +29,8 @@ void heapTimer::tick() {
         if(std::chrono::duration_cast<ms>(node.expires - clock_::now()).count() > 0) { // 当前节点未超时，不再需要删除节点跳出循环
             break;
         }
+        metrics::add(metrics::TIMER_EXPIRED);
+        WS_PROBE1(timer_expire, node.id);
         node.cb();
         pop();
     }
@@ -47,8 +50,11 @@ void heapTimer::removeTarget(int id) {
 // 调整指定id的节点
 void heapTimer::adjust(int id, int newExpires) {
     assert(!heap_.empty() && ref_.count(id));
-    heap_[ref_[id]].expires = clock_::now() + ms(newExpires);
-    siftdown_(ref_[id], heap_.size());
+    size_t i = ref_[id];
+    heap_[i].expires = clock_::now() + ms(newExpires);
+    if(!siftdown_(i, heap_.size())) { // 超时时间可在运行中调小，新的到期时间可能比原来早
+        siftup_(i);
+    }
 }
 
 void heapTimer::clear() {
@@ -90,12 +96,11 @@ void heapTimer::del_(size_t i) {
 
 void heapTimer::siftup_(size_t i) {
     assert(i >= 0 && i < heap_.size());
-    size_t parent = (i - 1) / 2;
-    while(parent >= 0) {
+    while(i > 0) { // size_t 下 (0 - 1) / 2 不是负数，必须在根节点处停下
+        size_t parent = (i - 1) / 2;
         if(heap_[parent] > heap_[i]) {
             swapNode_(i, parent);
             i = parent;
-            parent = (i - 1) / 2;
         } else {
             break;
         }
@@ -10,6 +10,8 @@
 #include <assert.h>
 #include <chrono>
 #include "../log/log.h"
+#include "../metrics/metrics.h"
+#include "../metrics/usdt.h"
 
 typedef std::function<void()> timeOutCallBack;
 typedef std::chrono::high_resolution_clock clock_;
@@ -12,6 +12,24 @@
 #include "../src/pool/thread_pool.h"
 #include "../src/pool/sqlconn_pool.h"
 #include "../src/timer/heap_timer.h"
+#include "../src/pool/async_sqlconn.h"
+#include "../src/pool/register_batcher.h"
+#include "../src/pool/mem_user_store.h"
+#include "../src/server/epoller.h"
+#include "../src/server/admin_server.h"
+#include "../src/server/listener_handoff.h"
+#include "../src/metrics/shared_stats.h"
+#include "../src/server/cpu_placement.h"
+#include "../src/http/rate_limiter.h"
+#include "../src/pool/file_io_pool.h"
+#include "../src/http/resource_bundle.h"
+#include <sys/wait.h>
+#include <dirent.h>
+#include <zlib.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <map>
+#include <math.h>
 
 
 #if __GLIBC__ == 2 && __GLIBC_MINOR__ < 30
@@ -124,6 +142,758 @@ void testLogger() {
     }
 }
 
+// 测试分模块日志等级：只打开http模块的debug，其他模块沿用全局等级
+void testLogModuleLevel() {
+    Log::getInstance()->init(2, "./TestLogModule", ".log", false);
+    Log::getInstance()->setModuleLevel(Log::MODULE_HTTP, 0);
+    assert(Log::getInstance()->isEnabled(Log::MODULE_HTTP, 0));
+    assert(!Log::getInstance()->isEnabled(Log::MODULE_POOL, 1));
+    assert(Log::getInstance()->isEnabled(Log::MODULE_POOL, 2));
+    Log::getInstance()->setModuleLevel(Log::MODULE_HTTP, -1); // 恢复沿用全局等级
+    assert(!Log::getInstance()->isEnabled(Log::MODULE_HTTP, 0));
+}
+
+// 测试mmap日志写入器：按大小切换文件、后台压缩写满的文件、按数量清理历史文件
+void testMmapLogWriter() {
+    const char* dir = "./TestLogMmap";
+    auto clean = [dir]() {
+        DIR* d = opendir(dir);
+        if(!d) { return; }
+        while(struct dirent* e = readdir(d)) {
+            if(e->d_name[0] != '.') { unlink((std::string(dir) + "/" + e->d_name).c_str()); }
+        }
+        closedir(d);
+    };
+    clean();
+    mmapLogWriter writer;
+    bool ok = writer.init(dir, ".log", 4096, 2);
+    assert(ok);
+    std::string line(99, 'x');
+    line += '\n';
+    for(int i = 0; i < 40 * 5; i++) { // 每个文件正好装40行，共5个文件
+        writer.append(line.data(), line.size());
+        if(i % 40 == 39) {
+            usleep(50 * 1000); // 写满前给后台线程预创建下一个文件的时间
+        }
+    }
+    writer.close();
+    assert(writer.droppedBytes() == 0);
+    // 4个写满的文件压缩后只保留最近2个，当前文件截断到实际长度不压缩
+    int gzNum = 0, logNum = 0;
+    DIR* d = opendir(dir);
+    assert(d);
+    while(struct dirent* e = readdir(d)) {
+        std::string name = std::string(dir) + "/" + e->d_name;
+        size_t len = name.size();
+        if(len > 7 && name.compare(len - 7, 7, ".log.gz") == 0) {
+            gzNum++;
+            gzFile gz = gzopen(name.c_str(), "rb");
+            assert(gz);
+            char buff[8192];
+            assert(gzread(gz, buff, sizeof(buff)) == 40 * 100);
+            gzclose(gz);
+        } else if(len > 4 && name.compare(len - 4, 4, ".log") == 0) {
+            logNum++;
+            struct stat st;
+            assert(stat(name.c_str(), &st) == 0 && st.st_size == 40 * 100);
+        }
+    }
+    closedir(d);
+    assert(gzNum == 2 && logNum == 1);
+    clean();
+    rmdir(dir);
+
+    // 第一个文件创建失败时init返回false，Log据此退回fopen
+    int fd = open("./TestLogMmapFile", O_RDWR | O_CREAT, 0644);
+    assert(fd >= 0);
+    close(fd);
+    mmapLogWriter bad;
+    ok = bad.init("./TestLogMmapFile", ".log", 4096);
+    assert(!ok);
+    unlink("./TestLogMmapFile");
+    (void)ok;
+}
+
+// 测试访问日志：另一个线程持续写满批次时，低频线程未写满的批次也要在刷新间隔内写出
+void testAccessLog() {
+    const char* file = "./TestAccessLog/access.log";
+    unlink(file);
+    bool ok = accessLog::getInstance()->init(file, 1, 1, 16, 200);
+    assert(ok);
+    std::atomic<bool> stop(false);
+    std::thread busy([&stop]() {
+        accessRecord rec = {};
+        strcpy(rec.method, "GET");
+        strcpy(rec.path, "/busy");
+        while(!stop) {
+            for(int i = 0; i < 16; i++) { // 每毫秒交一个满批次，写线程等不到超时
+                accessLog::getInstance()->record(rec);
+            }
+            usleep(1000);
+        }
+    });
+    usleep(100 * 1000);
+    accessRecord rec = {};
+    strcpy(rec.method, "GET");
+    strcpy(rec.path, "/lowrate");
+    accessLog::getInstance()->record(rec);
+    auto start = std::chrono::steady_clock::now();
+    bool found = false;
+    while(!found && std::chrono::steady_clock::now() - start < std::chrono::milliseconds(600)) {
+        usleep(20 * 1000);
+        int fd = open(file, O_RDONLY);
+        assert(fd >= 0);
+        std::string content;
+        char buff[65536];
+        ssize_t n = 0;
+        while((n = read(fd, buff, sizeof(buff))) > 0) { content.append(buff, n); }
+        close(fd);
+        found = content.find("\t/lowrate\t") != std::string::npos;
+    }
+    stop = true;
+    busy.join();
+    accessLog::getInstance()->close();
+    assert(found);
+    unlink(file);
+    rmdir("./TestAccessLog");
+    (void)ok;
+}
+
+// 测试指标：各线程分槽计数，抓取时汇总，并输出注册的瞬时值
+void testMetrics() {
+    metrics* m = metrics::getInstance();
+    uint64_t before = m->value(metrics::BYTES_IN);
+    std::vector<std::thread> threads;
+    for(int i = 0; i < 4; i++) { // 每个线程写自己的槽，抓取时汇总
+        threads.emplace_back([]() {
+            for(int j = 0; j < 1000; j++) {
+                metrics::add(metrics::BYTES_IN, 2);
+            }
+            metrics::addRequest(404);
+        });
+    }
+    for(auto& t : threads) {
+        t.join();
+    }
+    assert(m->value(metrics::BYTES_IN) - before == 8000);
+    m->addGauge("test_gauge", "Test gauge.", []() { return 42.0; });
+    std::string text = m->render();
+    assert(text.find("webserver_requests_total{code=\"404\"} 4\n") != std::string::npos);
+    assert(text.find("# TYPE test_gauge gauge\ntest_gauge 42\n") != std::string::npos);
+    m->removeGauge("test_gauge");
+    assert(m->render().find("test_gauge") == std::string::npos);
+}
+
+// 测试HDR直方图：桶的相对误差有界，多个直方图合并后的分位数
+void testHdrHistogram() {
+    for(uint64_t v : {0ULL, 1ULL, 127ULL, 128ULL, 255ULL, 256ULL, 1000ULL, 123456ULL, 4294967295ULL}) {
+        int idx = hdrHistogram::index(v);
+        uint64_t high = hdrHistogram::highestEquivalent(idx);
+        assert(idx < hdrHistogram::BUCKET_NUM && high >= v);
+        assert(high - v <= v / hdrHistogram::SUB_COUNT); // 相对误差不超过 1/SUB_COUNT
+    }
+    hdrHistogram a, b;
+    for(uint64_t v = 1; v <= 10000; v++) { // 两个"线程"各记一半，合并后计算分位数
+        (v % 2 ? a : b).record(v);
+    }
+    hdrHistogram::snapshot snap;
+    a.mergeInto(snap);
+    b.mergeInto(snap);
+    assert(snap.total == 10000 && snap.max == 10000);
+    uint64_t p50 = snap.percentile(50), p99 = snap.percentile(99), p999 = snap.percentile(99.9);
+    assert(p50 >= 5000 && p50 <= 5000 + 5000 / hdrHistogram::SUB_COUNT);
+    assert(p99 >= 9900 && p99 <= 9900 + 9900 / hdrHistogram::SUB_COUNT);
+    assert(p999 >= 9990 && p999 <= 10000);
+
+    latencyTracker::record(latencyTracker::PHASE_QUEUE, 42);
+    assert(latencyTracker::getInstance()->merge(latencyTracker::PHASE_QUEUE).total >= 1);
+}
+
+// 测试预派生模式的共享统计：worker退出、重启后计数仍然累加
+void testSharedStats() {
+    sharedStats* stats = sharedStats::getInstance();
+    bool ok = stats->init(2);
+    assert(ok);
+    uint64_t before = metrics::getInstance()->value(metrics::REQ_503); // fork时子进程带着父进程的计数
+    for(int round = 0; round < 2; round++) { // 第二轮模拟worker重启，从槽里上次的值接着累加
+        pid_t pid = fork();
+        if(pid == 0) {
+            stats->attach(1, 1000);
+            metrics::add(metrics::REQ_503, 5);
+            stats->publish();
+            _exit(0);
+        }
+        stats->workerStarted(1, pid);
+        waitpid(pid, nullptr, 0);
+        stats->workerExited(1);
+    }
+    assert(stats->total(metrics::REQ_503) == 2 * (before + 5));
+    assert(stats->restarts() == 1 && stats->aliveWorkers() == 0 && stats->connections() == 0);
+    (void)ok;
+}
+
+// 测试管理接口：命令解析执行，以及线程池在线调整线程数
+void testAdmin() {
+    adminServer admin;
+    admin.addCommand("echo", "echo <args>", [](const adminServer::argList& argv) {
+        std::string out;
+        for(size_t i = 1; i < argv.size(); i++) {
+            out += (i > 1 ? " " : "") + argv[i];
+        }
+        return out;
+    });
+    assert(admin.execute("  echo a \t b ") == "a b");
+    assert(admin.execute("") == "");
+    assert(admin.execute("nope").compare(0, 7, "error: ") == 0);
+    assert(admin.execute("help").find("echo <args>") != std::string::npos);
+
+    // 线程池缩小后多余的线程退出，任务不会丢
+    threadPool pool(4);
+    pool.resize(1);
+    std::atomic<int> done(0);
+    for(int i = 0; i < 100; i++) {
+        pool.addTask([&done]() { done++; });
+    }
+    while(done < 100 || pool.threadCount() > 1) {
+        std::this_thread::yield();
+    }
+    pool.resize(3);
+    assert(pool.threadCount() == 3);
+}
+
+// 测试平滑升级时监听fd的传递（SCM_RIGHTS）
+void testHandoff() {
+    int sock[2], pipeFds[2];
+    bool ok = socketpair(AF_UNIX, SOCK_STREAM, 0, sock) == 0 && pipe(pipeFds) == 0;
+    assert(ok);
+    ok = listenerHandoff::sendFds(sock[0], {pipeFds[0], pipeFds[1]});
+    assert(ok);
+    std::vector<int> fds = listenerHandoff::recvFds(sock[1], 1000);
+    assert(fds.size() == 2);
+    // 收到的是同一个管道的新描述符
+    ssize_t n = write(fds[1], "x", 1);
+    char ch = 0;
+    ssize_t m = read(pipeFds[0], &ch, 1);
+    assert(n == 1 && m == 1 && ch == 'x');
+    for(int fd : {sock[0], sock[1], pipeFds[0], pipeFds[1]}) {
+        close(fd);
+    }
+    for(int fd : fds) {
+        close(fd);
+    }
+    assert(listenerHandoff::inherited() == -1);
+    (void)ok; (void)n; (void)m;
+}
+
+// 测试绑核：CPU列表解析，线程池线程启动时绑到服务CPU上
+void testCpuPlacement() {
+    std::vector<int> cpus;
+    assert(cpuPlacement::parseList("0-3,8,2", &cpus) && cpus == std::vector<int>({0, 1, 2, 3, 8}));
+    assert(!cpuPlacement::parseList("3-1", &cpus) && !cpuPlacement::parseList("0,x", &cpus));
+    assert(!cpuPlacement::parseList("", &cpus));
+    // 绑到当前允许的第一个CPU，线程池线程启动时执行绑核回调
+    cpu_set_t set;
+    int ret = sched_getaffinity(0, sizeof(set), &set);
+    assert(ret == 0);
+    int first = 0;
+    while(!CPU_ISSET(first, &set)) { first++; }
+    cpuPlacement* placement = cpuPlacement::getInstance();
+    bool ok = placement->init(std::to_string(first).c_str(), nullptr);
+    assert(ok && placement->enabled());
+    std::atomic<int> pinned(0);
+    {
+        threadPool pool(2, [&]() {
+            placement->pinWorker();
+            cpu_set_t mine;
+            pthread_getaffinity_np(pthread_self(), sizeof(mine), &mine);
+            if(CPU_COUNT(&mine) == 1 && CPU_ISSET(first, &mine)) { pinned++; }
+        });
+        while(pool.threadCount() < 2 || pinned < 2) { usleep(1000); }
+    }
+    assert(placement->describe().find("pinned 2") != std::string::npos);
+    ok = placement->init(nullptr, nullptr); // 恢复为不绑核
+    assert(ok && !placement->enabled());
+    (void)ret; (void)ok;
+}
+
+// 测试登录凭据缓存和会话：命中、密码错误、失效
+void testCredentialCache() {
+    credentialCache* cache = credentialCache::getInstance();
+    cache->init(60, 60);
+    assert(!cache->verify("alice", "secret"));
+    cache->put("alice", "secret");
+    assert(cache->verify("alice", "secret"));
+    assert(!cache->verify("alice", "wrong"));
+    std::string sid = cache->createSession("alice");
+    assert(sid.size() == 32);
+    assert(cache->checkSession(sid, "alice"));
+    assert(!cache->checkSession(sid, "bob"));
+    cache->invalidate("alice"); // 改密码/注册后凭据和会话都失效
+    assert(!cache->verify("alice", "secret"));
+    assert(!cache->checkSession(sid, "alice"));
+    credentialCacheStats stats = cache->getStats();
+    assert(stats.hits == 1 && stats.sessionHits == 1 && stats.invalidations == 1);
+    cache->init(0, 0);
+}
+
+// 测试按客户端地址限速：令牌桶、条目淘汰，以及同一网段的地址在桶间均匀分布
+void testRateLimiter() {
+    rateLimiter* limiter = rateLimiter::getInstance();
+    assert(limiter->allow(1, rateLimiter::REQUEST)); // 未init时一律放行
+    limiter->init(64 * 16);                          // 每个分片16个条目
+    limiter->setLimit(rateLimiter::REQUEST, 1, 5);   // 1个/秒，桶容量5
+    limiter->setLimit(rateLimiter::AUTH, 0);
+    uint32_t addr = inet_addr("10.0.0.1");
+    for(int i = 0; i < 5; i++) {
+        assert(limiter->allow(addr, rateLimiter::REQUEST));
+    }
+    assert(!limiter->allow(addr, rateLimiter::REQUEST));
+    assert(limiter->allow(inet_addr("10.0.0.2"), rateLimiter::REQUEST)); // 各地址独立
+    assert(limiter->allow(addr, rateLimiter::AUTH));                     // 速率0不限
+    // 运行中开启限速：已跟踪的地址按新容量满桶开始，而不是沿用关闭时的空桶
+    limiter->setLimit(rateLimiter::AUTH, 1, 2);
+    bool first = limiter->allow(addr, rateLimiter::AUTH);
+    bool second = limiter->allow(addr, rateLimiter::AUTH);
+    bool third = limiter->allow(addr, rateLimiter::AUTH);
+    assert(first && second && !third);
+    limiter->setLimit(rateLimiter::AUTH, 0);
+    (void)first; (void)second; (void)third;
+    // 大量地址挤满分片后，最久未访问的条目被淘汰，重新出现时按新客户端满桶
+    for(uint32_t i = 0; i < 100000; i++) {
+        limiter->allow(htonl(0x0b000000 + i), rateLimiter::REQUEST);
+    }
+    rateLimiterStats st = limiter->getStats();
+    assert(st.clients == st.capacity && st.evictions > 0);
+    assert(st.maxChain <= 8);
+    assert(limiter->allow(addr, rateLimiter::REQUEST));
+    assert(st.limited[rateLimiter::REQUEST] == 1);
+    // 同一个/16网段（NAT、机房出口）的地址也要均匀分到各个桶，否则查找退化为扫描整个分片
+    limiter->init(2 * 65536);  // 容量留余量，各分片装填不均时也不淘汰
+    for(uint32_t i = 0; i < 65536; i++) {
+        limiter->allow(htonl(0x0a000000 + i), rateLimiter::REQUEST);
+    }
+    st = limiter->getStats();
+    assert(st.clients == 65536 && st.evictions == 0 && st.maxChain <= 12);
+    limiter->setLimit(rateLimiter::REQUEST, 0);
+}
+
+// 测试静态资源打包：打包后逐个查找内容、MIME、ETag和预压缩版本，损坏的文件打不开
+void testResourceBundle() {
+    const char* dir = "./test_bundle_res";
+    const char* out = "./test_bundle.bin";
+    mkdir(dir, 0755);
+    mkdir("./test_bundle_res/css", 0755);
+    std::string page = "<html>" + std::string(8000, 'a') + "</html>";   // 可压缩，且跨页
+    std::map<std::string, std::string> files = {
+        {"/index.html", page}, {"/css/a.css", "body{}"}, {"/b.png", std::string(5000, '\x01')}, {"/empty.txt", ""},
+    };
+    for(auto& f : files) {
+        FILE* fp = fopen((std::string(dir) + f.first).c_str(), "wb");
+        assert(fp);
+        fwrite(f.second.data(), 1, f.second.size(), fp);
+        fclose(fp);
+    }
+    std::string err;
+    bool ok = resourceBundle::pack(dir, out, true, &err);
+    assert(ok);
+
+    resourceBundle* bundle = resourceBundle::getInstance();
+    ok = bundle->open(out, true);
+    assert(ok && bundle->fileCount() == files.size());
+    for(auto& f : files) {
+        resourceBundle::file rf;
+        assert(bundle->find(f.first, &rf) && rf.readable);
+        assert(std::string(rf.data, rf.len) == f.second && strlen(rf.etag) == 16);
+    }
+    resourceBundle::file rf;
+    assert(bundle->find("/index.html", &rf) && rf.gzData && rf.gzLen < page.size() / 10); // 文本预压缩
+    assert(rf.offset % 4096 == 0 && std::string(rf.mime) == "text/html");
+    assert(bundle->find("/b.png", &rf) && !rf.gzData);     // 非文本不压缩
+    assert(!bundle->find("/css", &rf) && !bundle->find("/index.htm", &rf) && !bundle->find("/z", &rf));
+    bundle->close();
+
+    // 截断或损坏的文件打开失败，不会在查找时越界
+    int ret = truncate(out, 100);
+    ok = bundle->open(out);
+    assert(ret == 0 && !ok);
+    assert(!bundle->isOpen());
+    for(auto& f : files) {
+        unlink((std::string(dir) + f.first).c_str());
+    }
+    rmdir("./test_bundle_res/css");
+    rmdir(dir);
+    unlink(out);
+    (void)ok; (void)ret;
+}
+
+// 测试写配额：大响应每次write最多写writeQuantum字节就让出（WRITE_YIELD计数），反复调用直到写完，内容完整
+void testWriteQuantum() {
+    const char* dir = "./test_quantum_res";
+    mkdir(dir, 0777);
+    std::string body(1 << 20, '\0');
+    for(size_t i = 0; i < body.size(); i++) {
+        body[i] = static_cast<char>(i * 131 + 7);
+    }
+    int fd = open("./test_quantum_res/big.bin", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    assert(fd >= 0);
+    ssize_t n = write(fd, body.data(), body.size());
+    assert(n == static_cast<ssize_t>(body.size()));
+    close(fd);
+
+    int sv[2];
+    int ret = socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+    assert(ret == 0);
+    fcntl(sv[0], F_SETFL, fcntl(sv[0], F_GETFL) | O_NONBLOCK);
+    fcntl(sv[1], F_SETFL, fcntl(sv[1], F_GETFL) | O_NONBLOCK);
+    const char* oldSrcDir = httpConn::srcDir;
+    bool oldET = httpConn::isET;
+    size_t oldQuantum = httpConn::writeQuantum;
+    int oldSlice = httpConn::writeSliceUs;
+    httpConn::srcDir = dir;
+    httpConn::isET = true;          // ET模式下一次write会一直写到EAGAIN，只有配额能让它提前返回
+    httpConn::writeQuantum = 64 << 10;
+    httpConn::writeSliceUs = 0;
+
+    httpConn conn;
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    conn.init(sv[0], addr);
+    const char* req = "GET /big.bin HTTP/1.1\r\nHost: test\r\nConnection: close\r\n\r\n";
+    n = write(sv[1], req, strlen(req));
+    assert(n == static_cast<ssize_t>(strlen(req)));
+    int err = 0;
+    n = conn.read(&err);
+    assert(n > 0 || err == EAGAIN);
+    bool ok = conn.process();
+    assert(ok);
+
+    uint64_t yields = metrics::getInstance()->value(metrics::WRITE_YIELD);
+    std::string received;
+    char buff[65536];
+    int calls = 0;
+    while(conn.writeBytesLen() > 0) {
+        err = 0;
+        ssize_t ret = conn.write(&err);
+        assert(ret > 0 || err == EAGAIN);
+        size_t got = 0;
+        ssize_t n = 0;
+        while((n = read(sv[1], buff, sizeof(buff))) > 0) { // 对端每次都读空，让下一次write不因缓冲区满而返回
+            received.append(buff, n);
+            got += n;
+        }
+        assert(got <= httpConn::writeQuantum);
+        calls++;
+    }
+    assert(calls >= static_cast<int>(body.size() / httpConn::writeQuantum));
+    assert(metrics::getInstance()->value(metrics::WRITE_YIELD) - yields >= body.size() / httpConn::writeQuantum - 1);
+    size_t headerEnd = received.find("\r\n\r\n");
+    assert(headerEnd != std::string::npos && received.compare(0, 15, "HTTP/1.1 200 OK") == 0);
+    assert(received.substr(headerEnd + 4) == body);
+
+    conn.closeConn();
+    close(sv[1]);
+    httpConn::srcDir = oldSrcDir;
+    httpConn::isET = oldET;
+    httpConn::writeQuantum = oldQuantum;
+    httpConn::writeSliceUs = oldSlice;
+    unlink("./test_quantum_res/big.bin");
+    rmdir(dir);
+    (void)n; (void)ret; (void)ok;
+}
+
+// 本地MySQL替身服务器：只实现握手（mysql_native_password，接受任意密码）和 COM_QUERY，
+// 用户表初始只有 alice/secret；SELECT ... username='x' 返回密码，SELECT ... IN (...) 返回存在的用户名，
+// INSERT（可多行）任一用户名已存在则返回 ER_DUP_ENTRY 且不插入，其余语句返回 OK
+static std::mutex standInMtx;
+static std::map<std::string, std::string> standInUsers = {{"alice", "secret"}};
+static int standInInserts = 0;
+
+// 按顺序取出语句中所有单引号括起的字符串（替身只处理不含转义的测试数据）
+static std::vector<std::string> standInQuoted(const std::string& query, size_t from = 0) {
+    std::vector<std::string> strs;
+    size_t begin;
+    while((begin = query.find('\'', from)) != std::string::npos) {
+        size_t end = query.find('\'', begin + 1);
+        if(end == std::string::npos) { break; }
+        strs.push_back(query.substr(begin + 1, end - begin - 1));
+        from = end + 1;
+    }
+    return strs;
+}
+
+static void standInSend(int fd, unsigned char seq, const std::string& payload) {
+    std::string pkt(4, '\0');
+    pkt[0] = payload.size() & 0xff;
+    pkt[1] = (payload.size() >> 8) & 0xff;
+    pkt[2] = (payload.size() >> 16) & 0xff;
+    pkt[3] = seq;
+    pkt += payload;
+    send(fd, pkt.data(), pkt.size(), MSG_NOSIGNAL);
+}
+
+static bool standInRecv(int fd, unsigned char& seq, std::string& payload) {
+    unsigned char head[4];
+    if(recv(fd, head, 4, MSG_WAITALL) != 4) { return false; }
+    size_t len = head[0] | (head[1] << 8) | (head[2] << 16);
+    seq = head[3];
+    payload.assign(len, '\0');
+    return len == 0 || recv(fd, &payload[0], len, MSG_WAITALL) == (ssize_t)len;
+}
+
+static std::string lenencStr(const std::string& str) {
+    return std::string(1, (char)str.size()) + str; // 替身只发送短字符串
+}
+
+static void standInSession(int fd) {
+    const uint32_t caps = 0x1 | 0x4 | 0x8 | 0x200 | 0x2000 | 0x8000 | 0x20000 | 0x80000;
+    std::string hs;
+    hs += '\x0a';
+    hs += std::string("5.7.0-standin") + '\0';
+    hs += std::string("\x01\x00\x00\x00", 4);           // connection id
+    hs += "abcdefgh";                                       // scramble part 1
+    hs += '\0';
+    hs += (char)(caps & 0xff);
+    hs += (char)((caps >> 8) & 0xff);
+    hs += '\x21';                                           // utf8_general_ci
+    hs += std::string("\x02\x00", 2);                      // SERVER_STATUS_AUTOCOMMIT
+    hs += (char)((caps >> 16) & 0xff);
+    hs += (char)((caps >> 24) & 0xff);
+    hs += (char)21;                                         // scramble 长度
+    hs += std::string(10, '\0');
+    hs += std::string("ijklmnopqrst") + '\0';               // scramble part 2
+    hs += std::string("mysql_native_password") + '\0';
+    standInSend(fd, 0, hs);
+
+    const std::string ok("\x00\x01\x00\x02\x00\x00\x00", 7);
+    const std::string eof("\xfe\x00\x00\x02\x00", 5);
+    unsigned char seq = 0;
+    std::string payload;
+    if(!standInRecv(fd, seq, payload)) { close(fd); return; }
+    standInSend(fd, seq + 1, ok);                            // 认证通过
+
+    while(standInRecv(fd, seq, payload) && !payload.empty()) {
+        if(payload[0] == 0x01) { break; }                   // COM_QUIT
+        if(payload[0] != 0x03) {                            // 其他命令一律 OK
+            standInSend(fd, 1, ok);
+            continue;
+        }
+        std::string query = payload.substr(1);
+        if(query.find("'stall'") != std::string::npos) {   // 模拟卡住的查询：不应答，直到客户端放弃连接
+            continue;
+        }
+        if(query.compare(0, 6, "INSERT") == 0) {
+            std::vector<std::string> values = standInQuoted(query, query.find("VALUES"));
+            std::lock_guard<std::mutex> locker(standInMtx);
+            standInInserts++;
+            bool dup = false;
+            for(size_t i = 0; i + 1 < values.size(); i += 2) {
+                dup = dup || standInUsers.count(values[i]);
+            }
+            if(dup) {
+                standInSend(fd, 1, std::string("\xff\x26\x04#23000Duplicate entry", 24)); // 1062
+                continue;
+            }
+            for(size_t i = 0; i + 1 < values.size(); i += 2) {
+                standInUsers[values[i]] = values[i + 1];
+            }
+            standInSend(fd, 1, ok);
+            continue;
+        }
+        if(query.compare(0, 6, "SELECT") != 0) {
+            standInSend(fd, 1, ok);
+            continue;
+        }
+        std::vector<std::string> rows;
+        {
+            std::lock_guard<std::mutex> locker(standInMtx);
+            bool inList = query.find(" IN (") != std::string::npos;
+            for(const std::string& name : standInQuoted(query)) {
+                auto it = standInUsers.find(name);
+                if(it != standInUsers.end()) {
+                    rows.push_back(inList ? it->first : it->second);
+                }
+            }
+        }
+        std::string col = lenencStr("def") + lenencStr("mydb") + lenencStr("user") + lenencStr("user")
+                        + lenencStr("password") + lenencStr("password") + '\x0c'
+                        + std::string("\x21\x00\x00\x01\x00\x00\xfd\x00\x00\x00\x00\x00", 12);
+        unsigned char n = 1;
+        standInSend(fd, n++, std::string(1, '\x01'));       // 列数
+        standInSend(fd, n++, col);
+        standInSend(fd, n++, eof);
+        for(const std::string& row : rows) {
+            standInSend(fd, n++, lenencStr(row));
+        }
+        standInSend(fd, n++, eof);
+    }
+    close(fd);
+}
+
+static int startStandInServer(int& port) {
+    int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    bind(listenFd, (struct sockaddr*)&addr, sizeof(addr));
+    listen(listenFd, 16);
+    socklen_t len = sizeof(addr);
+    getsockname(listenFd, (struct sockaddr*)&addr, &len);
+    port = ntohs(addr.sin_port);
+    std::thread([listenFd]() {
+        int fd;
+        while((fd = accept(listenFd, nullptr, nullptr)) >= 0) {
+            std::thread(standInSession, fd).detach();
+        }
+    }).detach();
+    return listenFd;
+}
+
+// 驱动一次异步验证：解析POST请求后由asyncSqlClient在本地事件循环中完成查询
+static httpRequest::VERIFY_RESULT runAsyncVerify(asyncSqlClient& client, Epoller& epoller,
+                                                  const char* path, const char* body) {
+    Buffer buff;
+    buff.append(std::string("POST ") + path + " HTTP/1.1\r\n"
+                "Content-Type: application/x-www-form-urlencoded\r\n\r\n" + body);
+    httpRequest request;
+    request.parse(buff);
+    assert(request.isVerifyPending());
+    int result = -1;
+    request.verifyAsync(&client, [&result](httpRequest::VERIFY_RESULT ret) { result = ret; });
+    while(result < 0) {
+        int n = epoller.wait(1000);
+        assert(n > 0);
+        for(int i = 0; i < n; i++) {
+            client.handleEvent(epoller.getEventFd(i), epoller.getEvents(i));
+        }
+    }
+    return static_cast<httpRequest::VERIFY_RESULT>(result);
+}
+
+// 测试异步SQL客户端（使用本地替身服务器，不依赖真实MySQL）：
+// 卡住的查询超过期限后按不可用结束，连接重连后继续可用
+void testAsyncSql() {
+    int port = 0;
+    int listenFd = startStandInServer(port);
+    Epoller epoller;
+    asyncSqlClient client;
+    bool ret = client.init(&epoller, "127.0.0.1", port, "root", "pwd", "mydb", 2, 200);
+    assert(ret);
+    httpRequest::isAsyncVerify = true;
+    assert(runAsyncVerify(client, epoller, "/login.html", "username=alice&passwd=secret") == httpRequest::VERIFY_OK);
+    assert(runAsyncVerify(client, epoller, "/login.html", "username=alice&passwd=wrong") == httpRequest::VERIFY_FAIL);
+    assert(runAsyncVerify(client, epoller, "/register.html", "username=alice&passwd=x") == httpRequest::VERIFY_FAIL);
+    assert(runAsyncVerify(client, epoller, "/register.html", "username=bob&passwd=x") == httpRequest::VERIFY_OK);
+    auto begin = std::chrono::steady_clock::now();
+    assert(runAsyncVerify(client, epoller, "/login.html", "username=stall&passwd=x") == httpRequest::VERIFY_UNAVAILABLE);
+    auto waited = std::chrono::steady_clock::now() - begin;
+    assert(waited >= std::chrono::milliseconds(200) && waited < std::chrono::seconds(2));
+    assert(runAsyncVerify(client, epoller, "/login.html", "username=bob&passwd=x") == httpRequest::VERIFY_OK);
+    httpRequest::isAsyncVerify = false;
+    (void)waited;
+    client.close();
+    close(listenFd);
+    (void)ret;
+}
+
+// 测试注册组提交（使用本地替身服务器）：并发注册合并为少数几条多行INSERT，
+// 已存在的用户名和同一批内重复的用户名都判定为失败
+void testRegisterBatch() {
+    int port = 0;
+    int listenFd = startStandInServer(port);
+    sqlConnPool::getInstance()->init("127.0.0.1", port, "root", "pwd", "mydb", 2);
+    registerBatcher* batcher = registerBatcher::getInstance();
+    batcher->init(50, 64);
+    const char* names[] = {"u1", "u2", "u3", "u4", "u5", "u6", "alice", "u1"};
+    const int n = sizeof(names) / sizeof(names[0]);
+    registerBatcher::RESULT results[n];
+    std::vector<std::thread> threads;
+    for(int i = 0; i < n; i++) {
+        threads.emplace_back([&, i]() { results[i] = batcher->submit(names[i], "pwd"); });
+    }
+    for(auto& t : threads) {
+        t.join();
+    }
+    int ok = 0, dup = 0;
+    for(int i = 0; i < n; i++) {
+        ok += (results[i] == registerBatcher::REG_OK);
+        dup += (results[i] == registerBatcher::REG_DUP);
+    }
+    assert(ok == 6 && dup == 2);
+    assert(batcher->submit("u2", "pwd") == registerBatcher::REG_DUP);
+    registerBatchStats stats = batcher->getStats();
+    assert(stats.rows == 6 && stats.fallbacks == 0);
+    {
+        std::lock_guard<std::mutex> locker(standInMtx);
+        assert(standInInserts < n); // 8个并发注册不应各自一条INSERT
+    }
+    batcher->close();
+    sqlConnPool::getInstance()->closePool();
+    close(listenFd);
+    (void)ok; (void)dup; (void)stats;
+}
+
+// 测试用户名布隆过滤器：加入过的用户名一定判为可能存在，误判率与getStats()估算的一致
+void testUserFilter() {
+    userFilter* filter = userFilter::getInstance();
+    bool ok = filter->init(10000, 0.01);
+    assert(ok);
+    assert(filter->mayContain("user0")); // 加载完成前一律判为可能存在
+    std::vector<std::string> names;
+    for(int i = 0; i < 10000; i++) {
+        names.push_back("user" + std::to_string(i));
+    }
+    filter->load(names);
+    assert(filter->isReady());
+    for(const std::string& name : names) {
+        assert(filter->mayContain(name));
+    }
+    for(int i = 0; i < 100000; i++) { // 不存在的用户名：判为可能存在的都是误判，相当于SELECT没查到
+        if(filter->mayContain("absent" + std::to_string(i))) {
+            filter->reportLookup(false);
+        }
+    }
+    userFilterStats stats = filter->getStats();
+    assert(stats.items == 10000 && stats.maybeHits >= 10000);
+    assert(stats.definiteMisses + stats.falsePositives == 100000);
+    assert(stats.estimatedFpr < 0.02 && stats.measuredFpr < 0.02);
+    assert(fabs(stats.measuredFpr - stats.estimatedFpr) < 0.005);
+    filter->close();
+    (void)ok; (void)stats;
+}
+
+// 测试嵌入式用户存储：重新加载后数据仍在，文件尾部的半条记录被截掉
+void testMemUserStore() {
+    const char* path = "./TestUserStore/users.db";
+    unlink(path);
+    memUserStore* store = memUserStore::getInstance();
+    bool ok = store->init(path);
+    assert(ok);
+    assert(store->registerUser("alice", "secret") == userStore::STORE_OK);
+    assert(store->registerUser("alice", "other") == userStore::STORE_FAIL);
+    assert(store->registerUser("bob", "pwd") == userStore::STORE_OK);
+    assert(store->login("alice", "secret") == userStore::STORE_OK);
+    assert(store->login("alice", "wrong") == userStore::STORE_FAIL);
+    assert(store->login("carol", "pwd") == userStore::STORE_FAIL);
+    store->close();
+
+    int fd = open(path, O_WRONLY | O_APPEND);
+    ssize_t n = write(fd, "\x01\x02\x03\x04\x05\x00" "ab", 8); // 模拟写到一半时进程退出
+    close(fd);
+    assert(n == 8);
+    ok = store->init(path);
+    assert(ok);
+    assert(store->size() == 2);
+    assert(store->login("bob", "pwd") == userStore::STORE_OK);
+    assert(store->registerUser("carol", "pwd") == userStore::STORE_OK);
+    store->close();
+    ok = store->init(path);
+    assert(ok);
+    assert(store->size() == 3 && store->login("carol", "pwd") == userStore::STORE_OK);
+    store->close();
+    (void)n; (void)ok;
+}
+
 // 测试线程池类
 void threadLogTask(int i, int cnt) {
     for(int j = 0; j < 100; j++ ){
@@ -155,7 +925,98 @@ void testSqlPool() {
 
 }
 
+// 测试sql连接池借出超时（使用本地替身服务器）：借满上限后再借，应在超时后返回nullptr而不是一直阻塞
+void testSqlPoolTimeout() {
+    int port = 0;
+    int listenFd = startStandInServer(port);
+    sqlConnPool* pool = sqlConnPool::getInstance();
+    pool->init("127.0.0.1", port, "root", "pwd", "mydb", 2, 4, 100); // 常驻2个，最多扩到4个
+    std::vector<MYSQL*> conns;
+    MYSQL* conn = nullptr;
+    while(conns.size() < 8 && (conn = pool->getConn(1000)) != nullptr) { // 扩容由后台建连，等得久一些
+        conns.push_back(conn);
+    }
+    assert(conns.size() == 4);
+    auto begin = std::chrono::steady_clock::now();
+    assert(pool->getConn(100) == nullptr);
+    int64_t waitedMS = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - begin).count();
+    assert(waitedMS >= 90 && waitedMS < 1000);
+    sqlPoolStats stats = pool->getStats();
+    assert(stats.timeouts >= 1);
+    assert(stats.total <= 4 && stats.inUse == 4 && stats.idle == 0);
+    for(MYSQL* c : conns) {
+        pool->freeConn(c);
+    }
+    conn = pool->getConn(100); // 归还后立即可借
+    assert(conn);
+    pool->freeConn(conn);
+    pool->closePool();
+    close(listenFd);
+    (void)waitedMS;
+}
+
+// 测试过载判定：排队时间在整个窗口内超过目标才算过载，排空后自动恢复
+void testCodel() {
+    codelMonitor codel;
+    assert(!codel.overloaded(0));
+    codel.configure(5000, 100000); // 目标5ms，窗口100ms
+    // 短暂超标（突发）不算过载
+    codel.onSample(20000, 1000000);
+    codel.onSample(20000, 1050000);
+    assert(!codel.overloaded(1050000));
+    // 一次低于目标就重新计时
+    codel.onSample(1000, 1060000);
+    codel.onSample(20000, 1070000);
+    codel.onSample(20000, 1160000);
+    assert(!codel.overloaded(1160000));
+    // 整个窗口都超标
+    codel.onSample(20000, 1171000);
+    assert(codel.overloaded(1171000) && codel.episodes() == 1);
+    // 队列排空后一个窗口内没有采样，自动恢复
+    assert(codel.overloaded(1250000));
+    assert(!codel.overloaded(1272000));
+    codel.configure(0, 100000);
+    codel.onSample(1000000, 2000000);
+    codel.onSample(1000000, 3000000);
+    assert(!codel.overloaded(3000000));
+}
+
+// 测试冷文件预读线程：读完经eventfd回调，打不开的文件回调ok为false
+void testFileIOPool() {
+    const char* path = "./test_fileio.bin";
+    std::string data(600 * 1024, 'x'); // 超过一块暂存缓冲区，分多次pread
+    FILE* fp = fopen(path, "wb");
+    assert(fp);
+    size_t n = fwrite(data.data(), 1, data.size(), fp);
+    assert(n == data.size());
+    fclose(fp);
+
+    Epoller epoller;
+    fileIOPool pool;
+    bool ok = pool.init(&epoller, 2);
+    assert(ok);
+    std::vector<int> results;  // 回调在handleEvent的调用线程执行
+    pool.read(path, 4096, data.size() - 4096, [&](bool ok) { results.push_back(ok); });
+    pool.read("./no_such_file", 0, 4096, [&](bool ok) { results.push_back(ok); });
+    while(results.size() < 2) {
+        int n = epoller.wait(1000);
+        assert(n > 0);
+        for(int i = 0; i < n; i++) {
+            assert(pool.ownsFd(epoller.getEventFd(i)));
+            pool.handleEvent(epoller.getEventFd(i), epoller.getEvents(i));
+        }
+    }
+    assert(std::count(results.begin(), results.end(), 1) == 1 && pool.pending() == 0);
+    pool.close();
+    unlink(path);
+    (void)n; (void)ok;
+}
+
 void testPools() {
+    testCodel();
+    testFileIOPool();
+    testSqlPoolTimeout();
     testSqlPool();
     testThreadPool();
 }
@@ -164,11 +1025,30 @@ int main() {
     testBuffer();
     printf("Test Buffer module end!\n");
     testLogger();
+    testLogModuleLevel();
+    testMmapLogWriter();
+    testAccessLog();
     printf("Test Logger module end!\n");
+    testMetrics();
+    testHdrHistogram();
+    testSharedStats();
+    printf("Test Metrics module end!\n");
+    testAdmin();
+    testHandoff();
+    testCpuPlacement();
+    printf("Test Server module end!\n");
+    testCredentialCache();
+    testRateLimiter();
+    testResourceBundle();
+    testWriteQuantum();
+    printf("Test Http module end!\n");
+    testAsyncSql();
+    testRegisterBatch();
+    testUserFilter();
+    testMemUserStore();
+    printf("Test AsyncSql module end!\n");
     testPools();
     printf("Test Pool module end!\n");
-    // testHttp();
-    // printf("Test Http module end!\n");
     // testTimer();
     // printf("Test Timer module end!\n");
     return 0;
@@ -0,0 +1,35 @@
+// 构建时把静态资源目录打包成一个bundle文件，服务器用 -b 加载后不再逐个文件访问文件系统
+// 用法: respack [-z] <资源目录> <输出文件>
+//   -z 为文本类资源（html/css/js/xml...）生成gzip预压缩版本，客户端带 Accept-Encoding: gzip 时直接发送
+#include <stdio.h>
+#include <unistd.h>
+#include <string>
+#include "../src/http/resource_bundle.h"
+
+int main(int argc, char* argv[]) {
+    bool gzip = false;
+    int ch;
+    while((ch = getopt(argc, argv, "z")) != -1) {
+        switch(ch) {
+            case 'z': gzip = true; break;
+            default: return 1;
+        }
+    }
+    if(argc - optind != 2) {
+        fprintf(stderr, "usage: %s [-z] <resource dir> <bundle file>\n", argv[0]);
+        return 1;
+    }
+    std::string err;
+    if(!resourceBundle::pack(argv[optind], argv[optind + 1], gzip, &err)) {
+        fprintf(stderr, "pack error: %s\n", err.c_str());
+        return 1;
+    }
+    // 回读一遍，确认产物能被服务器加载
+    resourceBundle* bundle = resourceBundle::getInstance();
+    if(!bundle->open(argv[optind + 1])) {
+        fprintf(stderr, "verify %s error\n", argv[optind + 1]);
+        return 1;
+    }
+    printf("%s: %zu files, %zu bytes\n", argv[optind + 1], bundle->fileCount(), bundle->size());
+    return 0;
+}